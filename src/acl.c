@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The rule list is compiled in one lookup structure per field, each of
+ * them mapping the value found in a frame to the set of rules matching
+ * that value, as a bitset. Classifying a frame is one lookup per field
+ * and the intersection of the bitsets, the first bit set is the matching
+ * rule of highest priority. The cost depends on the number of fields and
+ * not on the number of rules.
+ *
+ *  - MACs, ethertype, VLAN and protocol are looked up in hash tables,
+ *  - IP prefixes in binary tries, the deepest node reached gives the set,
+ *  - ports in a direct table of the elementary intervals of the ranges.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acl.h"
+#include "inet.h"
+
+enum {
+	EX_SRC_MAC,
+	EX_DST_MAC,
+	EX_ETHERTYPE,
+	EX_VLAN,
+	EX_PROTO,
+	EX_MAX
+};
+
+#define ACL_USED	(1ULL << 63)
+#define ACL_NONE	UINT32_MAX
+
+struct acl_exact {
+	uint64_t	*key;
+	uint32_t	*set;
+	uint32_t	 mask;
+	uint32_t	 wild;		/* rules not matching on the field */
+};
+
+struct acl_node {
+	uint32_t	child[2];
+	uint32_t	parent;
+	uint32_t	set;
+};
+
+struct acl_trie {
+	struct acl_node	*node;
+	uint32_t	 n;
+	uint32_t	 cap;
+};
+
+struct acl_set {
+	uint32_t	 n_rules;
+	uint32_t	 words;		/* bitset length */
+	uint8_t		 def;
+	uint8_t		 err;
+	uint8_t		*action;
+	uint64_t	*bits;
+	uint32_t	 n_bits;
+	uint32_t	 cap_bits;
+	struct acl_exact ex[EX_MAX];
+	struct acl_trie	 trie[2][2];	/* [src, dst][IPv4, IPv6] */
+	uint32_t	 ip_none[2];	/* non-IP frames */
+	uint16_t	*port[2];	/* port -> interval */
+	uint32_t	*port_set[2];	/* interval -> set */
+	uint32_t	 port_none[2];	/* frames without ports */
+};
+
+static uint64_t	*acl_bits(const acl_set *, uint32_t);
+static uint32_t	 acl_bits_new(acl_set *, uint32_t);
+static void	 acl_bit_set(acl_set *, uint32_t, uint32_t);
+static int	 acl_exact_key(const struct acl_rule *, int, uint64_t *);
+static void	 acl_exact_build(acl_set *, const struct acl_rule *, int);
+static uint32_t	 acl_exact_find(const struct acl_exact *, uint64_t);
+static uint32_t	 acl_node_new(acl_set *, struct acl_trie *, uint32_t);
+static void	 acl_trie_build(acl_set *, const struct acl_rule *, int, int);
+static uint32_t	 acl_trie_find(const struct acl_trie *, const uint8_t *, uint32_t);
+static void	 acl_port_build(acl_set *, const struct acl_rule *, int);
+static int	 acl_cmp(const void *, const void *);
+
+uint64_t *
+acl_bits(const acl_set *s, uint32_t idx)
+{
+	return (s->bits + (size_t)idx * s->words);
+}
+
+/*
+ * Allocates a bitset, a copy of `from' or empty if `from' is ACL_NONE.
+ * On allocation failure the error is latched in the set and the first
+ * bitset is returned so the build can run to its end.
+ */
+uint32_t
+acl_bits_new(acl_set *s, uint32_t from)
+{
+	uint64_t	*tmp;
+	uint32_t	 cap;
+
+	if (s->err)
+		return (0);
+
+	if (s->n_bits == s->cap_bits) {
+		cap = s->cap_bits ? s->cap_bits * 2 : 64;
+		if ((tmp = realloc(s->bits,
+		    (size_t)cap * s->words * sizeof(uint64_t))) == NULL) {
+			s->err = 1;
+			return (0);
+		}
+		s->bits = tmp;
+		s->cap_bits = cap;
+	}
+
+	if (from == ACL_NONE)
+		memset(acl_bits(s, s->n_bits), 0, s->words * sizeof(uint64_t));
+	else
+		memcpy(acl_bits(s, s->n_bits), acl_bits(s, from),
+		    s->words * sizeof(uint64_t));
+
+	return (s->n_bits++);
+}
+
+void
+acl_bit_set(acl_set *s, uint32_t idx, uint32_t rule)
+{
+	if (s->err)
+		return;
+	acl_bits(s, idx)[rule / 64] |= 1ULL << (rule % 64);
+}
+
+/*
+ * Returns the key of a rule for an exact match field, or 0 if the rule
+ * doesn't match on it.
+ */
+int
+acl_exact_key(const struct acl_rule *r, int field, uint64_t *key)
+{
+	switch (field) {
+	case EX_SRC_MAC:
+		*key = inet_macaddr_u64(r->src_mac);
+		return (r->fields & ACL_SRC_MAC);
+	case EX_DST_MAC:
+		*key = inet_macaddr_u64(r->dst_mac);
+		return (r->fields & ACL_DST_MAC);
+	case EX_ETHERTYPE:
+		*key = r->ethertype;
+		return (r->fields & ACL_ETHERTYPE);
+	case EX_VLAN:
+		*key = r->vlan;
+		return (r->fields & ACL_VLAN);
+	case EX_PROTO:
+		*key = r->proto;
+		return (r->fields & ACL_PROTO);
+	}
+
+	return (0);
+}
+
+void
+acl_exact_build(acl_set *s, const struct acl_rule *r, int field)
+{
+	struct acl_exact	*ex = &s->ex[field];
+	uint64_t		 key;
+	uint32_t		 i, j, n = 1;
+
+	ex->wild = acl_bits_new(s, ACL_NONE);
+	for (i = 0; i < s->n_rules; i++) {
+		if (!acl_exact_key(&r[i], field, &key))
+			acl_bit_set(s, ex->wild, i);
+		else
+			n++;
+	}
+
+	for (j = 1; j < n * 2; j <<= 1)
+		;
+	ex->mask = j - 1;
+	ex->key = calloc(j, sizeof(*ex->key));
+	ex->set = calloc(j, sizeof(*ex->set));
+	if (ex->key == NULL || ex->set == NULL) {
+		s->err = 1;
+		return;
+	}
+
+	for (i = 0; i < s->n_rules; i++) {
+		if (!acl_exact_key(&r[i], field, &key))
+			continue;
+		for (j = inet_macaddr_hash(key) & ex->mask; ex->key[j] &&
+		    ex->key[j] != (key | ACL_USED); j = (j + 1) & ex->mask)
+			;
+		if (ex->key[j] == 0) {
+			ex->key[j] = key | ACL_USED;
+			ex->set[j] = acl_bits_new(s, ex->wild);
+		}
+		acl_bit_set(s, ex->set[j], i);
+	}
+}
+
+uint32_t
+acl_exact_find(const struct acl_exact *ex, uint64_t key)
+{
+	uint32_t	j;
+
+	for (j = inet_macaddr_hash(key) & ex->mask; ex->key[j];
+	    j = (j + 1) & ex->mask)
+		if (ex->key[j] == (key | ACL_USED))
+			return (ex->set[j]);
+
+	return (ex->wild);
+}
+
+uint32_t
+acl_node_new(acl_set *s, struct acl_trie *t, uint32_t parent)
+{
+	struct acl_node	*tmp;
+	uint32_t	 cap;
+
+	if (t->n == t->cap) {
+		cap = t->cap ? t->cap * 2 : 64;
+		if ((tmp = realloc(t->node, cap * sizeof(*tmp))) == NULL) {
+			s->err = 1;
+			return (0);
+		}
+		t->node = tmp;
+		t->cap = cap;
+	}
+
+	t->node[t->n].child[0] = t->node[t->n].child[1] = 0;
+	t->node[t->n].parent = parent;
+	t->node[t->n].set = ACL_NONE;
+
+	return (t->n++);
+}
+
+/*
+ * Builds the prefix trie of one direction and one family. Each node ends
+ * up with the set of rules whose prefix covers it, nodes without a prefix
+ * of their own share the set of their parent.
+ */
+void
+acl_trie_build(acl_set *s, const struct acl_rule *r, int dir, int fam)
+{
+	struct acl_trie		*t = &s->trie[dir][fam];
+	const uint8_t		*ip;
+	uint32_t		 i, b, n, c, plen, field, own;
+
+	field = dir ? ACL_DST_IP : ACL_SRC_IP;
+
+	acl_node_new(s, t, 0);
+	if (s->err)
+		return;
+
+	for (i = 0; i < s->n_rules && !s->err; i++) {
+		if ((r[i].fields & field) == 0) {
+			n = 0;
+		} else if (r[i].ip_ver == (fam ? 6 : 4)) {
+			ip = dir ? r[i].dst_ip : r[i].src_ip;
+			plen = dir ? r[i].dst_plen : r[i].src_plen;
+			if (plen > (fam ? 128U : 32U))
+				plen = fam ? 128 : 32;
+			for (n = 0, b = 0; b < plen && !s->err; b++) {
+				c = (ip[b / 8] >> (7 - b % 8)) & 1;
+				if (t->node[n].child[c] == 0) {
+					own = acl_node_new(s, t, n);
+					t->node[n].child[c] = own;
+				}
+				n = t->node[n].child[c];
+			}
+		} else
+			continue;
+
+		if (t->node[n].set == ACL_NONE)
+			t->node[n].set = acl_bits_new(s, ACL_NONE);
+		acl_bit_set(s, t->node[n].set, i);
+	}
+
+	/* parents are created before their children */
+	for (n = 0; n < t->n && !s->err; n++) {
+		own = t->node[n].set;
+		if (n == 0) {
+			if (own == ACL_NONE)
+				t->node[n].set = acl_bits_new(s, ACL_NONE);
+			continue;
+		}
+		c = t->node[t->node[n].parent].set;
+		if (own == ACL_NONE) {
+			t->node[n].set = c;
+			continue;
+		}
+		for (b = 0; b < s->words; b++)
+			acl_bits(s, own)[b] |= acl_bits(s, c)[b];
+	}
+}
+
+uint32_t
+acl_trie_find(const struct acl_trie *t, const uint8_t *ip, uint32_t nbits)
+{
+	uint32_t	b, n = 0, c;
+
+	for (b = 0; b < nbits; b++) {
+		c = t->node[n].child[(ip[b / 8] >> (7 - b % 8)) & 1];
+		if (c == 0)
+			break;
+		n = c;
+	}
+
+	return (t->node[n].set);
+}
+
+int
+acl_cmp(const void *a, const void *b)
+{
+	return ((int)*(const uint32_t *)a - (int)*(const uint32_t *)b);
+}
+
+/*
+ * Splits the port space at every range boundary, each elementary interval
+ * gets the set of ranges covering it and every port maps to its interval.
+ */
+void
+acl_port_build(acl_set *s, const struct acl_rule *r, int dir)
+{
+	uint32_t	*pt, n = 0, i, k, p, lo, hi, field;
+
+	field = dir ? ACL_DPORT : ACL_SPORT;
+
+	s->port_none[dir] = acl_bits_new(s, ACL_NONE);
+	if ((pt = calloc(s->n_rules * 2 + 1, sizeof(*pt))) == NULL) {
+		s->err = 1;
+		return;
+	}
+
+	pt[n++] = 0;
+	for (i = 0; i < s->n_rules; i++) {
+		if ((r[i].fields & field) == 0) {
+			acl_bit_set(s, s->port_none[dir], i);
+			continue;
+		}
+		lo = dir ? r[i].dport_lo : r[i].sport_lo;
+		hi = dir ? r[i].dport_hi : r[i].sport_hi;
+		pt[n++] = lo;
+		if (hi < 65535)
+			pt[n++] = hi + 1;
+	}
+	qsort(pt, n, sizeof(*pt), acl_cmp);
+	for (i = 1, k = 1; i < n; i++)
+		if (pt[i] != pt[k - 1])
+			pt[k++] = pt[i];
+	n = k;
+
+	s->port[dir] = calloc(65536, sizeof(uint16_t));
+	s->port_set[dir] = calloc(n, sizeof(uint32_t));
+	if (s->port[dir] == NULL || s->port_set[dir] == NULL) {
+		s->err = 1;
+		free(pt);
+		return;
+	}
+
+	for (k = 0; k < n; k++) {
+		s->port_set[dir][k] = acl_bits_new(s, s->port_none[dir]);
+		for (i = 0; i < s->n_rules; i++) {
+			if ((r[i].fields & field) == 0)
+				continue;
+			lo = dir ? r[i].dport_lo : r[i].sport_lo;
+			hi = dir ? r[i].dport_hi : r[i].sport_hi;
+			if (lo <= pt[k] && pt[k] <= hi)
+				acl_bit_set(s, s->port_set[dir][k], i);
+		}
+		for (p = pt[k]; p < (k + 1 < n ? pt[k + 1] : 65536); p++)
+			s->port[dir][p] = k;
+	}
+	free(pt);
+}
+
+/*
+ * Compiles a rule list, ordered by priority, into a rule set. `def' is the
+ * action applied to frames matching no rule. If the list is too long or
+ * an error occurs, NULL is returned.
+ */
+acl_set *
+acl_compile(const struct acl_rule *r, const uint32_t n, const uint8_t def)
+{
+	acl_set		*s;
+	uint32_t	 i;
+	int		 d;
+
+	if (n > ACL_RULE_MAX || (s = calloc(1, sizeof(*s))) == NULL)
+		return (NULL);
+
+	s->n_rules = n;
+	s->words = n ? (n + 63) / 64 : 1;
+	s->def = def;
+	if ((s->action = calloc(n ? n : 1, 1)) == NULL) {
+		free(s);
+		return (NULL);
+	}
+	for (i = 0; i < n; i++)
+		s->action[i] = r[i].action;
+
+	for (i = 0; i < EX_MAX; i++)
+		acl_exact_build(s, r, i);
+
+	for (d = 0; d < 2; d++) {
+		acl_trie_build(s, r, d, 0);
+		acl_trie_build(s, r, d, 1);
+
+		s->ip_none[d] = acl_bits_new(s, ACL_NONE);
+		for (i = 0; i < n; i++)
+			if ((r[i].fields & (d ? ACL_DST_IP : ACL_SRC_IP)) == 0)
+				acl_bit_set(s, s->ip_none[d], i);
+
+		acl_port_build(s, r, d);
+	}
+
+	if (s->err) {
+		acl_set_free(s);
+		return (NULL);
+	}
+
+	return (s);
+}
+
+void
+acl_set_free(acl_set *s)
+{
+	int	i;
+
+	if (s == NULL)
+		return;
+
+	for (i = 0; i < EX_MAX; i++) {
+		free(s->ex[i].key);
+		free(s->ex[i].set);
+	}
+	for (i = 0; i < 2; i++) {
+		free(s->trie[i][0].node);
+		free(s->trie[i][1].node);
+		free(s->port[i]);
+		free(s->port_set[i]);
+	}
+	free(s->bits);
+	free(s->action);
+	free(s);
+}
+
+/*
+ * Publishes a new rule set in `slot' atomically, readers see either the
+ * old or the new set. The previous set is returned, it must only be freed
+ * once no reader can still hold it.
+ */
+acl_set *
+acl_swap(acl_set **slot, acl_set *s)
+{
+	return (__atomic_exchange_n(slot, s, __ATOMIC_ACQ_REL));
+}
+
+acl_set *
+acl_get(acl_set **slot)
+{
+	return (__atomic_load_n(slot, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Returns the action of the first rule matching the frame, or the default
+ * action. The index of the matching rule is stored in `rule' if not NULL,
+ * -1 if no rule matched.
+ */
+uint8_t
+acl_classify(const acl_set *s, const struct inet_frame *f, int32_t *rule)
+{
+	const uint64_t	*v[9];
+	uint8_t		 ip[2][4];
+	uint64_t	 x;
+	uint32_t	 w, i, fam;
+
+	v[0] = acl_bits(s, acl_exact_find(&s->ex[EX_SRC_MAC],
+	    inet_macaddr_u64(f->data + ETHER_ADDR_LEN)));
+	v[1] = acl_bits(s, acl_exact_find(&s->ex[EX_DST_MAC],
+	    inet_macaddr_u64(f->data)));
+	v[2] = acl_bits(s,
+	    acl_exact_find(&s->ex[EX_ETHERTYPE], f->ethertype));
+	v[3] = acl_bits(s, acl_exact_find(&s->ex[EX_VLAN], f->vlan));
+
+	if (f->ip_ver == 4 || f->ip_ver == 6) {
+		fam = f->ip_ver == 6;
+		if (fam == 0) {
+			for (i = 0; i < 4; i++) {
+				ip[0][i] = f->src.v4 >> (24 - i * 8);
+				ip[1][i] = f->dst.v4 >> (24 - i * 8);
+			}
+		}
+		v[4] = acl_bits(s,
+		    acl_exact_find(&s->ex[EX_PROTO], f->ip_proto));
+		v[5] = acl_bits(s, acl_trie_find(&s->trie[0][fam],
+		    fam ? f->src.v6 : ip[0], fam ? 128 : 32));
+		v[6] = acl_bits(s, acl_trie_find(&s->trie[1][fam],
+		    fam ? f->dst.v6 : ip[1], fam ? 128 : 32));
+	} else {
+		v[4] = acl_bits(s, s->ex[EX_PROTO].wild);
+		v[5] = acl_bits(s, s->ip_none[0]);
+		v[6] = acl_bits(s, s->ip_none[1]);
+	}
+
+	if (f->l4_off && (f->ip_proto == 6 || f->ip_proto == 17)) {
+		v[7] = acl_bits(s, s->port_set[0][s->port[0][f->sport]]);
+		v[8] = acl_bits(s, s->port_set[1][s->port[1][f->dport]]);
+	} else {
+		v[7] = acl_bits(s, s->port_none[0]);
+		v[8] = acl_bits(s, s->port_none[1]);
+	}
+
+	for (w = 0; w < s->words; w++) {
+		x = v[0][w] & v[1][w] & v[2][w] & v[3][w] & v[4][w] &
+		    v[5][w] & v[6][w] & v[7][w] & v[8][w];
+		if (x) {
+			i = w * 64 + __builtin_ctzll(x);
+			if (rule)
+				*rule = i;
+			return (s->action[i]);
+		}
+	}
+
+	if (rule)
+		*rule = -1;
+	return (s->def);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ACL_H
+#define ACL_H
+
+#include <stdint.h>
+
+#include "inet.h"
+
+#define ACL_ALLOW	0x1
+#define ACL_DENY	0x2
+
+#define ACL_RULE_MAX	4096
+
+/* fields a rule matches on, the others are wildcards */
+#define ACL_SRC_MAC	0x001
+#define ACL_DST_MAC	0x002
+#define ACL_ETHERTYPE	0x004
+#define ACL_VLAN	0x008
+#define ACL_SRC_IP	0x010
+#define ACL_DST_IP	0x020
+#define ACL_PROTO	0x040
+#define ACL_SPORT	0x080
+#define ACL_DPORT	0x100
+
+/*
+ * A rule. IP prefixes are in network order, IPv4 prefixes use the first
+ * four bytes, `ip_ver' applies to both prefixes. Port ranges are
+ * inclusive and only match TCP and UDP.
+ */
+struct acl_rule {
+	uint32_t	fields;
+	uint8_t		action;
+	uint8_t		src_mac[ETHER_ADDR_LEN];
+	uint8_t		dst_mac[ETHER_ADDR_LEN];
+	uint16_t	ethertype;
+	uint16_t	vlan;
+	uint8_t		ip_ver;
+	uint8_t		src_ip[16];
+	uint8_t		src_plen;
+	uint8_t		dst_ip[16];
+	uint8_t		dst_plen;
+	uint8_t		proto;
+	uint16_t	sport_lo, sport_hi;
+	uint16_t	dport_lo, dport_hi;
+};
+
+typedef struct acl_set acl_set;
+
+acl_set		*acl_compile(const struct acl_rule *, const uint32_t, const uint8_t);
+void		 acl_set_free(acl_set *);
+acl_set		*acl_swap(acl_set **, acl_set *);
+acl_set		*acl_get(acl_set **);
+uint8_t		 acl_classify(const acl_set *, const struct inet_frame *, int32_t *);
+
+#endif
@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arp.h"
+#include "fbuf.h"
+#include "inet.h"
+
+#define ARP_ETHERTYPE	0x0806
+#define ARP_LEN		28
+#define ARP_REQUEST	1
+#define ARP_REPLY	2
+
+#define ND_NS		135
+#define ND_NA		136
+#define ND_NS_LEN	24	/* icmp6 header + target */
+#define ND_OPT_SLLA	1
+#define ND_OPT_TLLA	2
+
+/*
+ * Bindings are keyed by the IPv6 address, or the IPv4-mapped IPv6 address,
+ * in an open addressing table with linear probing. Bindings pushed by the
+ * controller are static and aren't overridden by what is observed.
+ */
+struct arp_entry {
+	uint8_t		ip[16];
+	uint8_t		macaddr[ETHER_ADDR_LEN];
+	uint8_t		used;
+	uint8_t		pinned;
+};
+
+struct arp_proxy {
+	struct arp_entry	*e;
+	uint32_t		 mask;
+	uint32_t		 n;
+	uint32_t		 max;
+	struct fbuf_pool	*pool;
+	struct arp_proxy_stats	 stats;
+};
+
+static const uint8_t	v4mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+static void		 arp_key(uint8_t *, const uint8_t, const void *);
+static uint32_t		 arp_hash(const uint8_t *);
+static struct arp_entry	*arp_find(arp_proxy *, const uint8_t *);
+static int32_t		 arp_insert(arp_proxy *, const uint8_t *, const uint8_t *, uint8_t);
+static void		 arp_remove(arp_proxy *, struct arp_entry *);
+static struct fbuf	*arp_reply4(arp_proxy *, const struct inet_frame *);
+static struct fbuf	*arp_reply6(arp_proxy *, const struct inet_frame *);
+static const uint8_t	*nd_option(const struct inet_frame *, uint32_t, uint8_t);
+static uint16_t		 nd_csum(const uint8_t *, const uint8_t *, const uint8_t *, uint32_t);
+
+void
+arp_key(uint8_t *key, const uint8_t ip_ver, const void *ip)
+{
+	if (ip_ver == 4) {
+		memcpy(key, v4mapped, 12);
+		memcpy(key + 12, ip, 4);
+	} else
+		memcpy(key, ip, 16);
+}
+
+uint32_t
+arp_hash(const uint8_t *key)
+{
+	uint64_t	a, b;
+
+	memcpy(&a, key, 8);
+	memcpy(&b, key + 8, 8);
+
+	return (inet_macaddr_hash(a ^ (b * 0x9e3779b97f4a7c15ULL)));
+}
+
+struct arp_entry *
+arp_find(arp_proxy *p, const uint8_t *key)
+{
+	uint32_t	i;
+
+	for (i = arp_hash(key) & p->mask; p->e[i].used; i = (i + 1) & p->mask)
+		if (memcmp(p->e[i].ip, key, 16) == 0)
+			return (&p->e[i]);
+
+	return (NULL);
+}
+
+int32_t
+arp_insert(arp_proxy *p, const uint8_t *key, const uint8_t *macaddr, uint8_t pinned)
+{
+	struct arp_entry	*e;
+	uint32_t		 i;
+
+	if ((e = arp_find(p, key)) != NULL) {
+		if (e->pinned && !pinned)
+			return (0);
+		memcpy(e->macaddr, macaddr, ETHER_ADDR_LEN);
+		e->pinned = pinned;
+		return (0);
+	}
+
+	if (p->n == p->max) {
+		p->stats.full++;
+		return (-1);
+	}
+
+	for (i = arp_hash(key) & p->mask; p->e[i].used; i = (i + 1) & p->mask)
+		;
+	e = &p->e[i];
+	memcpy(e->ip, key, 16);
+	memcpy(e->macaddr, macaddr, ETHER_ADDR_LEN);
+	e->used = 1;
+	e->pinned = pinned;
+	p->n++;
+
+	return (0);
+}
+
+/*
+ * Removes an entry and shifts back the entries of its probe sequence, so
+ * the table never holds tombstones.
+ */
+void
+arp_remove(arp_proxy *p, struct arp_entry *e)
+{
+	uint32_t	i, j, k;
+
+	i = e - p->e;
+	p->e[i].used = 0;
+	p->n--;
+
+	for (j = (i + 1) & p->mask; p->e[j].used; j = (j + 1) & p->mask) {
+		k = arp_hash(p->e[j].ip) & p->mask;
+		/* leave the entry if its home slot is cyclically in ]i, j] */
+		if ((i < j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		p->e[i] = p->e[j];
+		p->e[j].used = 0;
+		i = j;
+	}
+}
+
+/*
+ * Creates a proxy holding up to `max' bindings, replies are synthesized in
+ * buffers taken from `pool', or from the heap if `pool' is NULL. If an
+ * error occurs, NULL is returned.
+ */
+arp_proxy *
+arp_proxy_new(const uint32_t max, struct fbuf_pool *pool)
+{
+	arp_proxy	*p;
+	uint32_t	 n;
+
+	if (max == 0 || (p = calloc(1, sizeof(*p))) == NULL)
+		return (NULL);
+
+	for (n = 1; n < max * 2; n <<= 1)
+		;
+
+	if ((p->e = calloc(n, sizeof(*p->e))) == NULL) {
+		free(p);
+		return (NULL);
+	}
+	p->mask = n - 1;
+	p->max = max;
+	p->pool = pool;
+
+	return (p);
+}
+
+void
+arp_proxy_free(arp_proxy *p)
+{
+	if (p == NULL)
+		return;
+
+	free(p->e);
+	free(p);
+}
+
+/*
+ * Installs a static binding pushed by the controller. `ip' is an IPv4 or
+ * IPv6 address in network order, depending on `ip_ver'. If the table is
+ * full, -1 is returned.
+ */
+int32_t
+arp_proxy_set(arp_proxy *p, const uint8_t ip_ver, const void *ip, const uint8_t *macaddr)
+{
+	uint8_t	key[16];
+
+	if (ip_ver != 4 && ip_ver != 6)
+		return (-1);
+
+	arp_key(key, ip_ver, ip);
+
+	return (arp_insert(p, key, macaddr, 1));
+}
+
+/*
+ * Removes a binding, learned or static. If the address is unknown, -1 is
+ * returned.
+ */
+int32_t
+arp_proxy_del(arp_proxy *p, const uint8_t ip_ver, const void *ip)
+{
+	struct arp_entry	*e;
+	uint8_t			 key[16];
+
+	if (ip_ver != 4 && ip_ver != 6)
+		return (-1);
+
+	arp_key(key, ip_ver, ip);
+	if ((e = arp_find(p, key)) == NULL)
+		return (-1);
+
+	arp_remove(p, e);
+
+	return (0);
+}
+
+/*
+ * Returns the link-layer address option `type' of a neighbor discovery
+ * message whose fixed part is `fixed' bytes long, or NULL.
+ */
+const uint8_t *
+nd_option(const struct inet_frame *f, uint32_t fixed, uint8_t type)
+{
+	const uint8_t	*opt, *end;
+
+	end = f->data + f->len;
+	for (opt = f->data + f->l4_off + fixed; opt + 8 <= end && opt[1] != 0;
+	    opt += opt[1] * 8)
+		if (opt[0] == type && opt[1] == 1)
+			return (opt + 2);
+
+	return (NULL);
+}
+
+/*
+ * Learns the bindings advertised by the ARP and neighbor discovery traffic
+ * of a parsed frame: the sender of an ARP message, the source of a
+ * neighbor solicitation and the target of a neighbor advertisement.
+ */
+void
+arp_proxy_learn(arp_proxy *p, const struct inet_frame *f)
+{
+	const uint8_t	*a, *mac;
+	uint8_t		 key[16];
+
+	if (f->ethertype == ARP_ETHERTYPE) {
+		if (f->len < (uint32_t)f->l3_off + ARP_LEN)
+			return;
+		a = f->data + f->l3_off;
+		/* ethernet/IPv4 only, and skip the probes */
+		if (a[0] != 0 || a[1] != 1 || a[2] != 0x08 || a[3] != 0 ||
+		    memcmp(a + 14, "\0\0\0\0", 4) == 0)
+			return;
+		arp_key(key, 4, a + 14);
+		if (arp_insert(p, key, a + 8, 0) == 0)
+			p->stats.learned++;
+		return;
+	}
+
+	if (f->ip_ver != 6 || f->ip_proto != 58 || f->l4_off == 0 ||
+	    f->len < (uint32_t)f->l4_off + ND_NS_LEN)
+		return;
+
+	a = f->data + f->l4_off;
+	if (a[0] == ND_NS) {
+		if ((mac = nd_option(f, ND_NS_LEN, ND_OPT_SLLA)) == NULL ||
+		    memcmp(f->src.v6, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16) == 0)
+			return;
+		arp_key(key, 6, f->src.v6);
+	} else if (a[0] == ND_NA) {
+		if ((mac = nd_option(f, ND_NS_LEN, ND_OPT_TLLA)) == NULL)
+			mac = f->data + ETHER_ADDR_LEN;
+		arp_key(key, 6, a + 8);
+	} else
+		return;
+
+	if (arp_insert(p, key, mac, 0) == 0)
+		p->stats.learned++;
+}
+
+struct fbuf *
+arp_reply4(arp_proxy *p, const struct inet_frame *f)
+{
+	struct arp_entry	*e;
+	struct fbuf		*fb;
+	const uint8_t		*a;
+	uint8_t			*r, key[16];
+
+	if (f->len < (uint32_t)f->l3_off + ARP_LEN)
+		return (NULL);
+
+	a = f->data + f->l3_off;
+	if (a[0] != 0 || a[1] != 1 || a[2] != 0x08 || a[3] != 0 ||
+	    a[6] != 0 || a[7] != ARP_REQUEST)
+		return (NULL);
+
+	/* gratuitous ARP announces itself, there is nothing to answer */
+	if (memcmp(a + 14, a + 24, 4) == 0)
+		return (NULL);
+
+	arp_key(key, 4, a + 24);
+	if ((e = arp_find(p, key)) == NULL)
+		return (NULL);
+
+	if ((fb = fbuf_alloc(p->pool)) == NULL)
+		return (NULL);
+	if ((r = fbuf_append(fb, f->l3_off + ARP_LEN)) == NULL) {
+		fbuf_unref(fb);
+		return (NULL);
+	}
+
+	/* keep the VLAN tags of the request */
+	memcpy(r, f->data, f->l3_off);
+	memcpy(r, f->data + ETHER_ADDR_LEN, ETHER_ADDR_LEN);
+	memcpy(r + ETHER_ADDR_LEN, e->macaddr, ETHER_ADDR_LEN);
+
+	r += f->l3_off;
+	memcpy(r, a, 6);
+	r[6] = 0;
+	r[7] = ARP_REPLY;
+	memcpy(r + 8, e->macaddr, ETHER_ADDR_LEN);
+	memcpy(r + 14, a + 24, 4);
+	memcpy(r + 18, a + 8, ETHER_ADDR_LEN);
+	memcpy(r + 24, a + 14, 4);
+
+	return (fb);
+}
+
+/*
+ * Checksum of an ICMPv6 message and its pseudo-header.
+ */
+uint16_t
+nd_csum(const uint8_t *src, const uint8_t *dst, const uint8_t *msg, uint32_t len)
+{
+	uint32_t	sum = 0, i;
+
+	for (i = 0; i < 16; i += 2)
+		sum += ((uint32_t)src[i] << 8 | src[i + 1]) +
+		    ((uint32_t)dst[i] << 8 | dst[i + 1]);
+	sum += len + 58;
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (uint32_t)msg[i] << 8 | msg[i + 1];
+	if (len & 1)
+		sum += (uint32_t)msg[len - 1] << 8;
+
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return (~sum & 0xffff);
+}
+
+struct fbuf *
+arp_reply6(arp_proxy *p, const struct inet_frame *f)
+{
+	static const uint8_t	 allnodes[16] = { 0xff, 0x02, 0, 0, 0, 0, 0, 0,
+				     0, 0, 0, 0, 0, 0, 0, 1 };
+	struct arp_entry	*e;
+	struct fbuf		*fb;
+	const uint8_t		*ns, *dst;
+	uint8_t			*r, *ip6, *na, key[16];
+	uint16_t		 csum;
+	int			 dad;
+
+	if (f->l4_off == 0 || f->len < (uint32_t)f->l4_off + ND_NS_LEN)
+		return (NULL);
+
+	ns = f->data + f->l4_off;
+	if (ns[0] != ND_NS || ns[1] != 0)
+		return (NULL);
+
+	arp_key(key, 6, ns + 8);
+	if ((e = arp_find(p, key)) == NULL)
+		return (NULL);
+
+	/* duplicate address detection is answered to all-nodes, unsolicited */
+	dad = memcmp(f->src.v6, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16) == 0;
+	dst = dad ? allnodes : f->src.v6;
+
+	if ((fb = fbuf_alloc(p->pool)) == NULL)
+		return (NULL);
+	if ((r = fbuf_append(fb, f->l3_off + 40 + 32)) == NULL) {
+		fbuf_unref(fb);
+		return (NULL);
+	}
+
+	memcpy(r, f->data, f->l3_off);
+	if (dad)
+		memcpy(r, "\x33\x33\x00\x00\x00\x01", ETHER_ADDR_LEN);
+	else
+		memcpy(r, f->data + ETHER_ADDR_LEN, ETHER_ADDR_LEN);
+	memcpy(r + ETHER_ADDR_LEN, e->macaddr, ETHER_ADDR_LEN);
+
+	ip6 = r + f->l3_off;
+	memset(ip6, 0, 40);
+	ip6[0] = 0x60;
+	ip6[5] = 32;		/* payload length */
+	ip6[6] = 58;		/* icmp6 */
+	ip6[7] = 255;		/* hop limit */
+	memcpy(ip6 + 8, ns + 8, 16);
+	memcpy(ip6 + 24, dst, 16);
+
+	na = ip6 + 40;
+	memset(na, 0, 32);
+	na[0] = ND_NA;
+	na[4] = dad ? 0x20 : 0x60;	/* override, solicited unless DAD */
+	memcpy(na + 8, ns + 8, 16);
+	na[24] = ND_OPT_TLLA;
+	na[25] = 1;
+	memcpy(na + 26, e->macaddr, ETHER_ADDR_LEN);
+
+	csum = nd_csum(ip6 + 8, ip6 + 24, na, 32);
+	na[2] = csum >> 8;
+	na[3] = csum;
+
+	return (fb);
+}
+
+/*
+ * Answers an ARP request or a neighbor solicitation on behalf of a known
+ * host. Returns the reply, holding one reference, to send back to the
+ * ingress peer. NULL is returned when the frame isn't a request, the
+ * target is unknown, or no buffer is available, the frame must then be
+ * flooded as usual.
+ */
+struct fbuf *
+arp_proxy_reply(arp_proxy *p, const struct inet_frame *f)
+{
+	struct fbuf	*fb;
+
+	if (f->ethertype == ARP_ETHERTYPE &&
+	    f->len >= (uint32_t)f->l3_off + ARP_LEN &&
+	    f->data[f->l3_off + 7] == ARP_REQUEST)
+		fb = arp_reply4(p, f);
+	else if (f->ip_ver == 6 && f->ip_proto == 58 && f->l4_off != 0 &&
+	    f->data[f->l4_off] == ND_NS)
+		fb = arp_reply6(p, f);
+	else
+		return (NULL);
+
+	if (fb)
+		p->stats.replies++;
+	else
+		p->stats.misses++;
+
+	return (fb);
+}
+
+void
+arp_proxy_stats(const arp_proxy *p, struct arp_proxy_stats *stats)
+{
+	*stats = p->stats;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ARP_H
+#define ARP_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+#include "inet.h"
+
+typedef struct arp_proxy arp_proxy;
+
+struct arp_proxy_stats {
+	uint64_t	replies;	/* requests answered locally */
+	uint64_t	misses;		/* requests left to flood */
+	uint64_t	learned;
+	uint64_t	full;		/* bindings lost to a full table */
+};
+
+arp_proxy	*arp_proxy_new(const uint32_t, struct fbuf_pool *);
+void		 arp_proxy_free(arp_proxy *);
+int32_t		 arp_proxy_set(arp_proxy *, const uint8_t, const void *, const uint8_t *);
+int32_t		 arp_proxy_del(arp_proxy *, const uint8_t, const void *);
+void		 arp_proxy_learn(arp_proxy *, const struct inet_frame *);
+struct fbuf	*arp_proxy_reply(arp_proxy *, const struct inet_frame *);
+void		 arp_proxy_stats(const arp_proxy *, struct arp_proxy_stats *);
+
+#endif
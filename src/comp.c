@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "comp.h"
+#include "fbuf.h"
+#include "inet.h"
+
+/*
+ * Frames are compressed one by one in the LZ4 block format, so the peer
+ * may as well decode them with liblz4. The encoder is a greedy single
+ * probe matcher, its hash table belongs to the peer's context and is never
+ * cleared: positions are stored biased by a base that moves past every
+ * frame, the entries left by the previous frames fall below it.
+ */
+#define COMP_HASHLOG	12
+#define COMP_MINMATCH	4
+#define COMP_MFLIMIT	12	/* no match starts in the last 12 bytes */
+#define COMP_LASTLIT	5	/* the last 5 bytes are literals */
+#define COMP_MIN	64	/* smaller frames are not worth it */
+#define COMP_MAX	65535
+
+/*
+ * The compression ratio of a flow is tracked in 1/1024 units. A flow
+ * whose ratio stays above COMP_THRESH is bypassed for a number of frames
+ * that doubles every time a new trial fails.
+ */
+#define COMP_FLOWS	1024
+#define COMP_THRESH	960
+#define COMP_SKIP_MIN	16
+#define COMP_SKIP_MAX	4096
+
+struct comp_flow {
+	uint32_t	hash;
+	uint16_t	ratio;
+	uint16_t	skip;		/* frames left to bypass */
+	uint16_t	backoff;	/* bypass after the next failure */
+};
+
+struct comp {
+	struct fbuf_pool	*pool;
+	uint32_t		 base;
+	uint32_t		 tbl[1 << COMP_HASHLOG];
+	struct comp_flow	 flow[COMP_FLOWS];
+	struct comp_stats	 stats;
+};
+
+static uint32_t		 comp_rd32(const uint8_t *);
+static int		 comp_len(uint8_t **, uint8_t *, uint32_t);
+static int		 comp_seq(uint8_t **, uint8_t *, const uint8_t *, uint32_t,
+			    uint32_t, uint32_t);
+static uint32_t		 comp_lz4(comp *, const uint8_t *, uint32_t, uint8_t *,
+			    uint32_t);
+static int32_t		 comp_unlz4(const uint8_t *, uint32_t, uint8_t *, uint32_t);
+static struct comp_flow	*comp_flow(comp *, const struct fbuf *);
+static int		 comp_raw(struct fbuf *);
+
+uint32_t
+comp_rd32(const uint8_t *p)
+{
+	uint32_t	v;
+
+	memcpy(&v, p, 4);
+	return (v);
+}
+
+/* Writes the extension bytes of a literal or match length. */
+int
+comp_len(uint8_t **op, uint8_t *oend, uint32_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (*op >= oend)
+			return (-1);
+		*(*op)++ = 255;
+	}
+	if (*op >= oend)
+		return (-1);
+	*(*op)++ = len;
+
+	return (0);
+}
+
+/*
+ * Writes a sequence, `nlit' literals at `lit' then a match of `ml' bytes
+ * `off' bytes back, or only literals if `ml' is 0. If the output is full,
+ * -1 is returned.
+ */
+int
+comp_seq(uint8_t **op, uint8_t *oend, const uint8_t *lit, uint32_t nlit,
+    uint32_t off, uint32_t ml)
+{
+	uint8_t	*token;
+
+	if (*op >= oend)
+		return (-1);
+	token = (*op)++;
+	*token = (nlit < 15 ? nlit : 15) << 4;
+	if (nlit >= 15 && comp_len(op, oend, nlit - 15) < 0)
+		return (-1);
+
+	if ((uint32_t)(oend - *op) < nlit)
+		return (-1);
+	memcpy(*op, lit, nlit);
+	*op += nlit;
+
+	if (ml == 0)
+		return (0);
+
+	if (oend - *op < 2)
+		return (-1);
+	*(*op)++ = off;
+	*(*op)++ = off >> 8;
+
+	ml -= COMP_MINMATCH;
+	*token |= ml < 15 ? ml : 15;
+	if (ml >= 15 && comp_len(op, oend, ml - 15) < 0)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Compresses `len' bytes into at most `cap' bytes. Returns the compressed
+ * length, or 0 if it doesn't fit.
+ */
+uint32_t
+comp_lz4(comp *c, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+	const uint8_t	*ip = src, *anchor = src, *ref;
+	const uint8_t	*mflimit, *mlimit;
+	uint8_t		*op = dst, *oend = dst + cap;
+	uint32_t	 seq, h, pos, cand, ml, ret = 0;
+
+	/* the base must stay 64KB clear of the wrap */
+	if (c->base > UINT32_MAX - 2 * (COMP_MAX + 1)) {
+		memset(c->tbl, 0, sizeof(c->tbl));
+		c->base = 0;
+	}
+
+	if (len > COMP_MFLIMIT) {
+		mflimit = src + len - COMP_MFLIMIT;
+		mlimit = src + len - COMP_LASTLIT;
+
+		while (ip < mflimit) {
+			seq = comp_rd32(ip);
+			h = (seq * 2654435761U) >> (32 - COMP_HASHLOG);
+			pos = c->base + (ip - src);
+			cand = c->tbl[h];
+			c->tbl[h] = pos;
+
+			if (cand < c->base || cand == pos || pos - cand > 65535 ||
+			    comp_rd32(src + (cand - c->base)) != seq) {
+				/* skip faster through what doesn't match */
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+			ref = src + (cand - c->base);
+
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			for (ml = COMP_MINMATCH; ip + ml < mlimit &&
+			    ip[ml] == ref[ml]; ml++)
+				;
+
+			if (comp_seq(&op, oend, anchor, ip - anchor, ip - ref,
+			    ml) < 0)
+				goto out;
+			ip += ml;
+			anchor = ip;
+		}
+	}
+
+	if (comp_seq(&op, oend, anchor, src + len - anchor, 0, 0) < 0)
+		goto out;
+	ret = op - dst;
+
+out:
+	c->base += len + 1;
+	return (ret);
+}
+
+/*
+ * Decodes a LZ4 block of `len' bytes into at most `cap' bytes. Every
+ * length and offset is checked against the buffers. Returns the decoded
+ * length, or -1 if the block is corrupted.
+ */
+int32_t
+comp_unlz4(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+	const uint8_t	*ip = src, *iend = src + len;
+	uint8_t		*op = dst, *oend = dst + cap;
+	const uint8_t	*ref;
+	uint32_t	 nlit, ml, off, i;
+	uint8_t		 token, b;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		nlit = token >> 4;
+		if (nlit == 15)
+			do {
+				if (ip >= iend)
+					return (-1);
+				b = *ip++;
+				nlit += b;
+			} while (b == 255);
+		if ((uint32_t)(iend - ip) < nlit || (uint32_t)(oend - op) < nlit)
+			return (-1);
+		memcpy(op, ip, nlit);
+		ip += nlit;
+		op += nlit;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return (-1);
+		off = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (off == 0 || off > (uint32_t)(op - dst))
+			return (-1);
+
+		ml = token & 15;
+		if (ml == 15)
+			do {
+				if (ip >= iend)
+					return (-1);
+				b = *ip++;
+				ml += b;
+			} while (b == 255);
+		ml += COMP_MINMATCH;
+		if ((uint32_t)(oend - op) < ml)
+			return (-1);
+
+		/* matches may overlap their own output */
+		ref = op - off;
+		if (off >= ml)
+			memcpy(op, ref, ml);
+		else
+			for (i = 0; i < ml; i++)
+				op[i] = ref[i];
+		op += ml;
+	}
+
+	return (op - dst);
+}
+
+struct comp_flow *
+comp_flow(comp *c, const struct fbuf *fb)
+{
+	struct inet_frame	 f;
+	struct comp_flow	*fl;
+	uint32_t		 hash;
+
+	inet_parse(&f, fb->data, fb->len);
+	hash = inet_flow_hash(&f);
+	fl = &c->flow[hash & (COMP_FLOWS - 1)];
+	if (fl->hash != hash || fl->backoff == 0) {
+		fl->hash = hash;
+		fl->ratio = 0;
+		fl->skip = 0;
+		fl->backoff = COMP_SKIP_MIN;
+	}
+
+	return (fl);
+}
+
+int
+comp_raw(struct fbuf *fb)
+{
+	uint8_t	*h;
+
+	if ((h = fbuf_prepend(fb, COMP_HDRLEN)) == NULL)
+		return (-1);
+	h[0] = COMP_RAW;
+	h[1] = 0;
+	h[2] = 0;
+	h[3] = 0;
+
+	return (0);
+}
+
+/*
+ * Creates the compression context of a peer, compressed frames are taken
+ * from `pool', or the heap if it is NULL. If an error occurs, NULL is
+ * returned.
+ */
+comp *
+comp_new(struct fbuf_pool *pool)
+{
+	comp	*c;
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return (NULL);
+	c->pool = pool;
+
+	return (c);
+}
+
+void
+comp_free(comp *c)
+{
+	free(c);
+}
+
+/*
+ * Compresses a frame, replacing it with a new buffer holding the header
+ * and the LZ4 block, unless the frame is too small or too large, its flow
+ * is being bypassed, or it doesn't shrink. Those frames are sent as they
+ * are, behind a raw header prepended in the headroom. If the headroom is
+ * too small, -1 is returned and the frame is left untouched.
+ */
+int32_t
+comp_frame(comp *c, struct fbuf **fbp)
+{
+	struct fbuf		*fb = *fbp, *cfb;
+	struct comp_flow	*fl;
+	uint8_t			*h;
+	uint32_t		 clen, cap, ratio;
+
+	c->stats.frames++;
+	if (fb->len < COMP_MIN || fb->len > COMP_MAX)
+		return (comp_raw(fb));
+
+	fl = comp_flow(c, fb);
+	if (fl->skip) {
+		fl->skip--;
+		c->stats.bypassed++;
+		return (comp_raw(fb));
+	}
+
+	if ((cfb = fbuf_alloc(c->pool)) == NULL)
+		return (comp_raw(fb));
+
+	if (fbuf_tailroom(cfb) < COMP_HDRLEN + COMP_MIN) {
+		fbuf_unref(cfb);
+		return (comp_raw(fb));
+	}
+
+	/* anything short of a gain is a failure */
+	cap = fb->len - 1;
+	if (fbuf_tailroom(cfb) < COMP_HDRLEN + cap)
+		cap = fbuf_tailroom(cfb) - COMP_HDRLEN;
+	h = cfb->data;
+	clen = comp_lz4(c, fb->data, fb->len, h + COMP_HDRLEN, cap);
+
+	ratio = clen ? (uint64_t)clen * 1024 / fb->len : 1024;
+	fl->ratio = (fl->ratio * 3 + ratio) / 4;
+	if (ratio < COMP_THRESH)
+		fl->backoff = COMP_SKIP_MIN;
+	else if (fl->ratio >= COMP_THRESH) {
+		fl->skip = fl->backoff;
+		if (fl->backoff < COMP_SKIP_MAX)
+			fl->backoff *= 2;
+	}
+
+	if (clen == 0) {
+		fbuf_unref(cfb);
+		return (comp_raw(fb));
+	}
+
+	h[0] = COMP_LZ4;
+	h[1] = 0;
+	h[2] = fb->len >> 8;
+	h[3] = fb->len;
+	fbuf_append(cfb, COMP_HDRLEN + clen);
+
+	c->stats.compressed++;
+	c->stats.bytes_in += fb->len;
+	c->stats.bytes_out += COMP_HDRLEN + clen;
+
+	fbuf_unref(fb);
+	*fbp = cfb;
+
+	return (0);
+}
+
+/*
+ * Runs a burst of frames going to the same peer through the compression
+ * stage. Returns the number of frames processed, the others lacked
+ * headroom and are left untouched.
+ */
+uint32_t
+comp_burst(comp *c, struct fbuf **fb, const uint32_t n)
+{
+	uint32_t	i, ok = 0;
+
+	for (i = 0; i < n; i++)
+		if (comp_frame(c, &fb[i]) == 0)
+			ok++;
+
+	return (ok);
+}
+
+/*
+ * Restores a frame out of the compression stage, replacing it with a new
+ * buffer from `pool', or the heap if it is NULL, when it was compressed.
+ * If the frame is corrupted or an error occurs, -1 is returned and the
+ * frame is left untouched.
+ */
+int32_t
+decomp(struct fbuf **fbp, struct fbuf_pool *pool)
+{
+	struct fbuf	*fb = *fbp, *dfb;
+	const uint8_t	*h = fb->data;
+	uint32_t	 len;
+
+	if (fb->len < COMP_HDRLEN)
+		return (-1);
+
+	switch (h[0]) {
+	case COMP_RAW:
+		fbuf_pull(fb, COMP_HDRLEN);
+		return (0);
+	case COMP_LZ4:
+		break;
+	default:
+		return (-1);
+	}
+
+	len = (uint32_t)h[2] << 8 | h[3];
+	if ((dfb = fbuf_alloc(pool)) == NULL)
+		return (-1);
+	if (fbuf_tailroom(dfb) < len ||
+	    comp_unlz4(h + COMP_HDRLEN, fb->len - COMP_HDRLEN, dfb->data,
+	    len) != (int32_t)len) {
+		fbuf_unref(dfb);
+		return (-1);
+	}
+	fbuf_append(dfb, len);
+
+	fbuf_unref(fb);
+	*fbp = dfb;
+
+	return (0);
+}
+
+void
+comp_stats(const comp *c, struct comp_stats *stats)
+{
+	*stats = c->stats;
+}
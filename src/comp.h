@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef COMP_H
+#define COMP_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+
+/*
+ * Every frame out of the compression stage starts with a 4 bytes header:
+ * the encoding, a reserved byte and the length of the original frame, in
+ * network order.
+ */
+#define COMP_HDRLEN	4
+#define COMP_RAW	0
+#define COMP_LZ4	1
+
+typedef struct comp comp;
+
+struct comp_stats {
+	uint64_t	frames;
+	uint64_t	compressed;
+	uint64_t	bypassed;	/* skipped, their flow doesn't compress */
+	uint64_t	bytes_in;	/* of the frames compressed */
+	uint64_t	bytes_out;
+};
+
+comp		*comp_new(struct fbuf_pool *);
+void		 comp_free(comp *);
+int32_t		 comp_frame(comp *, struct fbuf **);
+uint32_t	 comp_burst(comp *, struct fbuf **, const uint32_t);
+int32_t		 decomp(struct fbuf **, struct fbuf_pool *);
+void		 comp_stats(const comp *, struct comp_stats *);
+
+#endif
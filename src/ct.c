@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ct.h"
+#include "inet.h"
+
+/*
+ * A table belongs to one worker, the frames being spread across workers
+ * with the symmetric flow hash so both directions of a flow meet in the
+ * same table. Lookups and updates take no lock.
+ *
+ * The entries are allocated once. Each one sits in a hash bucket, on the
+ * LRU list and in a slot of a timer wheel ticking every second. Refreshing
+ * a flow only moves its deadline, the wheel is corrected lazily when the
+ * slot comes up, so the per-frame cost stays constant.
+ */
+#define CT_WHEEL	1024	/* slots, seconds */
+
+#define TH_FIN		0x01
+#define TH_SYN		0x02
+#define TH_RST		0x04
+#define TH_ACK		0x10
+
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE	CLOCK_MONOTONIC
+#endif
+
+/* both endpoints, the lowest first so both directions share the key */
+struct ct_key {
+	uint8_t		addr[2][16];
+	uint16_t	port[2];
+	uint8_t		ip_proto;
+	uint8_t		ip_ver;
+};
+
+struct ct_entry {
+	struct ct_key		 key;
+	uint32_t		 hash;
+	uint32_t		 expire;
+	uint16_t		 slot;		/* in the timer wheel */
+	uint8_t			 orig;		/* endpoint of the originator */
+	struct ct_flow		 flow;
+	LIST_ENTRY(ct_entry)	 hash_next;
+	TAILQ_ENTRY(ct_entry)	 lru;
+	TAILQ_ENTRY(ct_entry)	 timer;
+};
+
+LIST_HEAD(ct_bucket, ct_entry);
+TAILQ_HEAD(ct_list, ct_entry);
+
+struct ct {
+	struct ct_entry		*entry;
+	struct ct_bucket	*bucket;
+	uint32_t		 mask;
+	struct ct_list		 free;
+	struct ct_list		 lru;		/* least recently seen first */
+	struct ct_list		 wheel[CT_WHEEL];
+	uint32_t		 now;
+	struct ct_stats		 stats;
+};
+
+static const uint32_t ct_timeout[CT_STATE_MAX] = {
+	[CT_TCP_SYN_SENT] = 30,
+	[CT_TCP_SYN_RECV] = 60,
+	[CT_TCP_ESTABLISHED] = 3600,
+	[CT_TCP_FIN_WAIT] = 120,
+	[CT_TCP_LAST_ACK] = 30,
+	[CT_TCP_TIME_WAIT] = 120,
+	[CT_TCP_CLOSE] = 10,
+	[CT_UNREPLIED] = 30,
+	[CT_REPLIED] = 180,
+};
+
+static uint32_t		 ct_clock(void);
+static int		 ct_key(struct ct_key *, const struct inet_frame *);
+static struct ct_entry	*ct_find(const ct *, const struct ct_key *, uint32_t);
+static void		 ct_schedule(ct *, struct ct_entry *);
+static void		 ct_release(ct *, struct ct_entry *);
+static uint8_t		 ct_tcp(struct ct_flow *, int, uint8_t);
+
+uint32_t
+ct_clock(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ((uint32_t)ts.tv_sec);
+}
+
+/*
+ * Builds the key of a frame. Returns the endpoint the sender is in the
+ * key, or -1 if the frame isn't IP.
+ */
+int
+ct_key(struct ct_key *k, const struct inet_frame *f)
+{
+	uint8_t		src[16], dst[16];
+	uint16_t	sport = f->sport, dport = f->dport;
+	const uint8_t	*l4;
+	int		cmp;
+
+	memset(k, 0, sizeof(*k));
+	memset(src, 0, sizeof(src));
+	memset(dst, 0, sizeof(dst));
+
+	switch (f->ip_ver) {
+	case 4:
+		src[0] = f->src.v4 >> 24;
+		src[1] = f->src.v4 >> 16;
+		src[2] = f->src.v4 >> 8;
+		src[3] = f->src.v4;
+		dst[0] = f->dst.v4 >> 24;
+		dst[1] = f->dst.v4 >> 16;
+		dst[2] = f->dst.v4 >> 8;
+		dst[3] = f->dst.v4;
+		break;
+	case 6:
+		memcpy(src, f->src.v6, 16);
+		memcpy(dst, f->dst.v6, 16);
+		break;
+	default:
+		return (-1);
+	}
+
+	/* echo requests and replies are told apart by their identifier */
+	if ((f->ip_proto == IPPROTO_ICMP || f->ip_proto == IPPROTO_ICMPV6) &&
+	    f->l4_off && f->len >= (uint32_t)f->l4_off + 8) {
+		l4 = f->data + f->l4_off;
+		if (l4[0] == 8 || l4[0] == 0 || l4[0] == 128 || l4[0] == 129)
+			sport = dport = (uint16_t)l4[4] << 8 | l4[5];
+	}
+
+	k->ip_proto = f->ip_proto;
+	k->ip_ver = f->ip_ver;
+
+	cmp = memcmp(src, dst, 16);
+	if (cmp < 0 || (cmp == 0 && sport <= dport)) {
+		memcpy(k->addr[0], src, 16);
+		memcpy(k->addr[1], dst, 16);
+		k->port[0] = sport;
+		k->port[1] = dport;
+		return (0);
+	}
+	memcpy(k->addr[0], dst, 16);
+	memcpy(k->addr[1], src, 16);
+	k->port[0] = dport;
+	k->port[1] = sport;
+
+	return (1);
+}
+
+struct ct_entry *
+ct_find(const ct *c, const struct ct_key *k, uint32_t hash)
+{
+	struct ct_entry	*e;
+
+	LIST_FOREACH(e, &c->bucket[hash & c->mask], hash_next)
+		if (e->hash == hash && memcmp(&e->key, k, sizeof(*k)) == 0)
+			return (e);
+
+	return (NULL);
+}
+
+/*
+ * Puts the entry in the slot of its deadline, or in the last slot of the
+ * wheel if the deadline is further away than a turn.
+ */
+void
+ct_schedule(ct *c, struct ct_entry *e)
+{
+	uint32_t	when;
+
+	when = e->expire - c->now < CT_WHEEL ? e->expire : c->now + CT_WHEEL - 1;
+	e->slot = when % CT_WHEEL;
+	TAILQ_INSERT_TAIL(&c->wheel[e->slot], e, timer);
+}
+
+void
+ct_release(ct *c, struct ct_entry *e)
+{
+	LIST_REMOVE(e, hash_next);
+	TAILQ_REMOVE(&c->lru, e, lru);
+	TAILQ_INSERT_HEAD(&c->free, e, lru);
+	c->stats.flows--;
+}
+
+/*
+ * Moves a TCP flow along its state machine. A flow picked up in the
+ * middle is taken as established, a SYN reopens a closed flow.
+ */
+uint8_t
+ct_tcp(struct ct_flow *fl, int dir, uint8_t flags)
+{
+	if (flags & TH_RST)
+		return (CT_TCP_CLOSE);
+
+	switch (fl->state) {
+	case 0:
+		if ((flags & (TH_SYN | TH_ACK)) == TH_SYN)
+			return (CT_TCP_SYN_SENT);
+		return (CT_TCP_ESTABLISHED);
+	case CT_TCP_SYN_SENT:
+		if (dir == CT_REPLY && (flags & (TH_SYN | TH_ACK)) ==
+		    (TH_SYN | TH_ACK))
+			return (CT_TCP_SYN_RECV);
+		break;
+	case CT_TCP_SYN_RECV:
+		if (dir == CT_ORIG && (flags & (TH_SYN | TH_ACK)) == TH_ACK)
+			return (CT_TCP_ESTABLISHED);
+		break;
+	case CT_TCP_TIME_WAIT:
+	case CT_TCP_CLOSE:
+		if (dir == CT_ORIG && (flags & (TH_SYN | TH_ACK)) == TH_SYN) {
+			fl->fin = 0;
+			return (CT_TCP_SYN_SENT);
+		}
+		return (fl->state);
+	case CT_TCP_LAST_ACK:
+		if ((flags & (TH_FIN | TH_ACK)) == TH_ACK)
+			return (CT_TCP_TIME_WAIT);
+		break;
+	}
+
+	if (flags & TH_FIN) {
+		fl->fin |= 1 << dir;
+		return (fl->fin == 3 ? CT_TCP_LAST_ACK : CT_TCP_FIN_WAIT);
+	}
+
+	return (fl->state);
+}
+
+/*
+ * Creates a connection tracking table of `max' flows. When it is full,
+ * the least recently seen flow is recycled. If an error occurs, NULL is
+ * returned.
+ */
+ct *
+ct_new(const uint32_t max)
+{
+	ct		*c;
+	uint32_t	 i, n;
+
+	if (max == 0)
+		return (NULL);
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return (NULL);
+
+	for (n = 1; n < max; n <<= 1)
+		;
+	if ((c->entry = calloc(max, sizeof(*c->entry))) == NULL ||
+	    (c->bucket = calloc(n, sizeof(*c->bucket))) == NULL) {
+		ct_free(c);
+		return (NULL);
+	}
+	c->mask = n - 1;
+
+	TAILQ_INIT(&c->free);
+	TAILQ_INIT(&c->lru);
+	for (i = 0; i < CT_WHEEL; i++)
+		TAILQ_INIT(&c->wheel[i]);
+	for (i = 0; i < max; i++)
+		TAILQ_INSERT_TAIL(&c->free, &c->entry[i], lru);
+
+	c->now = ct_clock();
+
+	return (c);
+}
+
+void
+ct_free(ct *c)
+{
+	if (c == NULL)
+		return;
+
+	free(c->entry);
+	free(c->bucket);
+	free(c);
+}
+
+/*
+ * Accounts a parsed frame to its flow, creating the flow if needed, and
+ * returns it with the direction of the frame in `dir'. The clock is the
+ * one of the last ct_expire() call. If the frame isn't IP, NULL is
+ * returned.
+ */
+struct ct_flow *
+ct_track(ct *c, const struct inet_frame *f, int *dir)
+{
+	struct ct_entry	*e;
+	struct ct_key	 k;
+	uint32_t	 hash, expire;
+	uint8_t		 state;
+	int		 side, created = 0, scheduled = 1;
+
+	if ((side = ct_key(&k, f)) < 0)
+		return (NULL);
+
+	hash = inet_flow_hash(f);
+	if ((e = ct_find(c, &k, hash)) == NULL) {
+		if ((e = TAILQ_FIRST(&c->free)) != NULL)
+			TAILQ_REMOVE(&c->free, e, lru);
+		else {
+			e = TAILQ_FIRST(&c->lru);
+			LIST_REMOVE(e, hash_next);
+			TAILQ_REMOVE(&c->lru, e, lru);
+			TAILQ_REMOVE(&c->wheel[e->slot], e, timer);
+			c->stats.flows--;
+			c->stats.evicted++;
+		}
+		e->key = k;
+		e->hash = hash;
+		e->orig = side;
+		LIST_INSERT_HEAD(&c->bucket[hash & c->mask], e, hash_next);
+		TAILQ_INSERT_TAIL(&c->lru, e, lru);
+		c->stats.flows++;
+		created = 1;
+		scheduled = 0;
+	} else {
+		TAILQ_REMOVE(&c->lru, e, lru);
+		TAILQ_INSERT_TAIL(&c->lru, e, lru);
+		/* past its deadline, but its slot didn't come up yet */
+		if ((int32_t)(e->expire - c->now) < 0) {
+			e->orig = side;
+			created = 1;
+		}
+	}
+
+	if (created) {
+		memset(&e->flow, 0, sizeof(e->flow));
+		e->flow.ip_proto = f->ip_proto;
+		e->flow.created = c->now;
+		c->stats.created++;
+	}
+
+	*dir = side == e->orig ? CT_ORIG : CT_REPLY;
+	e->flow.pkts[*dir]++;
+	e->flow.bytes[*dir] += f->len;
+
+	if (f->ip_proto == IPPROTO_TCP)
+		state = ct_tcp(&e->flow, *dir, f->tcp_flags);
+	else if (*dir == CT_REPLY || e->flow.state == CT_REPLIED)
+		state = CT_REPLIED;
+	else
+		state = CT_UNREPLIED;
+
+	expire = c->now + ct_timeout[state];
+	if (!scheduled) {
+		e->expire = expire;
+		ct_schedule(c, e);
+	} else if (state != e->flow.state &&
+	    (int32_t)(expire - e->expire) < 0) {
+		/* a shorter deadline can't wait for the current slot */
+		TAILQ_REMOVE(&c->wheel[e->slot], e, timer);
+		e->expire = expire;
+		ct_schedule(c, e);
+	} else
+		e->expire = expire;
+	e->flow.state = state;
+
+	return (&e->flow);
+}
+
+/*
+ * Returns the flow of a parsed frame, with the direction of the frame in
+ * `dir', without accounting the frame. If there is none, NULL is returned.
+ */
+struct ct_flow *
+ct_lookup(const ct *c, const struct inet_frame *f, int *dir)
+{
+	struct ct_entry	*e;
+	struct ct_key	 k;
+	int		 side;
+
+	if ((side = ct_key(&k, f)) < 0 ||
+	    (e = ct_find(c, &k, inet_flow_hash(f))) == NULL ||
+	    (int32_t)(e->expire - c->now) < 0)
+		return (NULL);
+
+	*dir = side == e->orig ? CT_ORIG : CT_REPLY;
+	return (&e->flow);
+}
+
+/*
+ * Advances the clock and the timer wheel, releasing the flows whose
+ * deadline passed. It must be called at least every second by the worker
+ * owning the table. Returns the number of flows released.
+ */
+uint32_t
+ct_expire(ct *c)
+{
+	struct ct_list	 slot;
+	struct ct_entry	*e;
+	uint32_t	 now, t, n = 0;
+
+	now = ct_clock();
+	if (now - c->now > CT_WHEEL)
+		c->now = now - CT_WHEEL;
+
+	for (t = c->now + 1; (int32_t)(now - t) >= 0; t++) {
+		c->now = t;
+		TAILQ_INIT(&slot);
+		TAILQ_CONCAT(&slot, &c->wheel[t % CT_WHEEL], timer);
+		while ((e = TAILQ_FIRST(&slot)) != NULL) {
+			TAILQ_REMOVE(&slot, e, timer);
+			if ((int32_t)(e->expire - t) > 0) {
+				ct_schedule(c, e);
+				continue;
+			}
+			ct_release(c, e);
+			c->stats.expired++;
+			n++;
+		}
+	}
+	c->now = now;
+
+	return (n);
+}
+
+void
+ct_stats(const ct *c, struct ct_stats *stats)
+{
+	*stats = c->stats;
+}
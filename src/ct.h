@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CT_H
+#define CT_H
+
+#include <stdint.h>
+
+#include "inet.h"
+
+/* direction of a frame within its flow */
+#define CT_ORIG		0
+#define CT_REPLY	1
+
+/* flow states */
+#define CT_TCP_SYN_SENT		1
+#define CT_TCP_SYN_RECV		2
+#define CT_TCP_ESTABLISHED	3
+#define CT_TCP_FIN_WAIT		4	/* one side sent FIN */
+#define CT_TCP_LAST_ACK		5	/* both sides sent FIN */
+#define CT_TCP_TIME_WAIT	6
+#define CT_TCP_CLOSE		7
+#define CT_UNREPLIED		8	/* UDP, ICMP and others */
+#define CT_REPLIED		9
+#define CT_STATE_MAX		10
+
+typedef struct ct ct;
+
+struct ct_flow {
+	uint8_t		state;
+	uint8_t		ip_proto;
+	uint8_t		fin;		/* FIN seen, bit per direction */
+	uint32_t	created;	/* seconds */
+	uint64_t	pkts[2];	/* per direction */
+	uint64_t	bytes[2];
+};
+
+struct ct_stats {
+	uint32_t	flows;
+	uint64_t	created;
+	uint64_t	expired;
+	uint64_t	evicted;	/* recycled from a full table */
+};
+
+ct		*ct_new(const uint32_t);
+void		 ct_free(ct *);
+struct ct_flow	*ct_track(ct *, const struct inet_frame *, int *);
+struct ct_flow	*ct_lookup(const ct *, const struct inet_frame *, int *);
+uint32_t	 ct_expire(ct *);
+void		 ct_stats(const ct *, struct ct_stats *);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "encap.h"
+#include "fbuf.h"
+#include "inet.h"
+
+/* offsets in the outer header */
+#define ENCAP_ETH	0
+#define ENCAP_IP	14
+#define ENCAP_UDP	34
+#define ENCAP_VXLAN	42
+
+#define ENCAP_VXLAN_I	0x08	/* the VNI is valid */
+
+static uint32_t	encap_sum(const uint8_t *, uint32_t);
+static uint16_t	encap_fold(uint32_t);
+static void	encap_wr16(uint8_t *, uint16_t);
+
+void
+encap_wr16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+uint32_t
+encap_sum(const uint8_t *p, uint32_t len)
+{
+	uint32_t	sum = 0;
+	uint32_t	i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (uint32_t)p[i] << 8 | p[i + 1];
+
+	return (sum);
+}
+
+uint16_t
+encap_fold(uint32_t sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return (~sum & 0xffff);
+}
+
+/*
+ * Builds the outer header a peer's frames are tunnelled with. Addresses
+ * and ports are in host order, `vni' identifies the network. If the VNI
+ * doesn't fit in 24 bits, -1 is returned.
+ */
+int32_t
+encap_tmpl_init(struct encap_tmpl *t, const uint8_t *src_mac, const uint8_t *dst_mac,
+    const uint32_t src_ip, const uint32_t dst_ip, const uint16_t port, const uint32_t vni)
+{
+	uint8_t	*h = t->hdr;
+
+	if (vni > 0xffffff)
+		return (-1);
+
+	memset(t, 0, sizeof(*t));
+
+	memcpy(h + ENCAP_ETH, dst_mac, ETHER_ADDR_LEN);
+	memcpy(h + ENCAP_ETH + ETHER_ADDR_LEN, src_mac, ETHER_ADDR_LEN);
+	encap_wr16(h + ENCAP_ETH + 12, 0x0800);
+
+	h[ENCAP_IP] = 0x45;
+	encap_wr16(h + ENCAP_IP + 6, 0x4000);	/* don't fragment */
+	h[ENCAP_IP + 8] = 64;			/* ttl */
+	h[ENCAP_IP + 9] = 17;			/* udp */
+	encap_wr16(h + ENCAP_IP + 12, src_ip >> 16);
+	encap_wr16(h + ENCAP_IP + 14, src_ip);
+	encap_wr16(h + ENCAP_IP + 16, dst_ip >> 16);
+	encap_wr16(h + ENCAP_IP + 18, dst_ip);
+
+	/* the source port is patched per frame, the UDP checksum is 0 */
+	encap_wr16(h + ENCAP_UDP + 2, port);
+
+	h[ENCAP_VXLAN] = ENCAP_VXLAN_I;
+	h[ENCAP_VXLAN + 4] = vni >> 16;
+	h[ENCAP_VXLAN + 5] = vni >> 8;
+	h[ENCAP_VXLAN + 6] = vni;
+
+	t->csum = encap_sum(h + ENCAP_IP, 20);
+
+	return (0);
+}
+
+/*
+ * Writes the peer's outer header at `h' for a payload of `len' bytes
+ * tunnelling the frame `inner'. The UDP source port is derived from the
+ * inner MAC addresses so that ECMP and RSS on the underlay spread the
+ * tunnel while the frames of a conversation stay in order. `flags' are
+ * added to the VXLAN flags.
+ */
+void
+encap_hdr(const struct encap_tmpl *t, uint8_t *h, const uint8_t *inner,
+    const uint32_t len, const uint8_t flags)
+{
+	uint32_t	ip_len, entropy;
+
+	entropy = inet_macaddr_hash(inet_macaddr_u64(inner) ^
+	    inet_macaddr_u64(inner + ETHER_ADDR_LEN));
+
+	memcpy(h, t->hdr, ENCAP_HDRLEN);
+
+	ip_len = ENCAP_HDRLEN - ENCAP_IP + len;
+	encap_wr16(h + ENCAP_IP + 2, ip_len);
+	encap_wr16(h + ENCAP_IP + 10, encap_fold(t->csum + ip_len));
+
+	encap_wr16(h + ENCAP_UDP, 0xc000 | (entropy & 0x3fff));
+	encap_wr16(h + ENCAP_UDP + 4, ip_len - 20);
+
+	h[ENCAP_VXLAN] |= flags;
+}
+
+/*
+ * Prepends the peer's outer header in the headroom of the frame. If the
+ * frame is shorter than the MAC addresses, longer than ENCAP_LEN_MAX or
+ * the headroom is too small, -1 is returned. The super-frames built by
+ * gro_burst() are segmented by gso() or fragmented by frag_split() first.
+ */
+int32_t
+encap(const struct encap_tmpl *t, struct fbuf *fb)
+{
+	uint8_t	*h;
+
+	if (fb->len < 2 * ETHER_ADDR_LEN || fb->len > ENCAP_LEN_MAX)
+		return (-1);
+
+	if ((h = fbuf_prepend(fb, ENCAP_HDRLEN)) == NULL)
+		return (-1);
+
+	encap_hdr(t, h, h + ENCAP_HDRLEN, fb->len - ENCAP_HDRLEN, 0);
+
+	return (0);
+}
+
+/*
+ * Encapsulates a burst of frames going to the same peer. Returns the
+ * number of frames encapsulated, the others were runts, too long or lacked
+ * headroom and are left untouched.
+ */
+uint32_t
+encap_burst(const struct encap_tmpl *t, struct fbuf **fb, const uint32_t n)
+{
+	uint32_t	i, ok = 0;
+
+	for (i = 0; i < n; i++)
+		if (encap(t, fb[i]) == 0)
+			ok++;
+
+	return (ok);
+}
+
+/*
+ * Validates the outer header of a tunnelled frame and strips it in place.
+ * The frame must be an untagged IPv4 datagram without options, sent to
+ * UDP `port', with a valid IPv4 checksum and consistent lengths. The VNI is
+ * returned in `vni'. Returns ENCAP_FRAG if the payload is a fragment, 0
+ * otherwise. If the frame isn't valid, -1 is returned and the frame is
+ * left untouched.
+ */
+int32_t
+decap(struct fbuf *fb, const uint16_t port, uint32_t *vni)
+{
+	const uint8_t	*h = fb->data;
+	uint32_t	 ip_len;
+	uint8_t		 flags;
+
+	if (fb->len < ENCAP_HDRLEN + ETHER_HDR_LEN)
+		return (-1);
+
+	if (h[ENCAP_ETH + 12] != 0x08 || h[ENCAP_ETH + 13] != 0x00 ||
+	    h[ENCAP_IP] != 0x45 || h[ENCAP_IP + 9] != 17)
+		return (-1);
+
+	/* fragments are reassembled before getting here */
+	if ((h[ENCAP_IP + 6] & 0x3f) != 0 || h[ENCAP_IP + 7] != 0)
+		return (-1);
+
+	ip_len = (uint32_t)h[ENCAP_IP + 2] << 8 | h[ENCAP_IP + 3];
+	if (ip_len + ENCAP_IP > fb->len || ip_len < ENCAP_HDRLEN - ENCAP_IP)
+		return (-1);
+
+	if (encap_fold(encap_sum(h + ENCAP_IP, 20)) != 0)
+		return (-1);
+
+	if (((uint32_t)h[ENCAP_UDP + 2] << 8 | h[ENCAP_UDP + 3]) != port ||
+	    ((uint32_t)h[ENCAP_UDP + 4] << 8 | h[ENCAP_UDP + 5]) != ip_len - 20)
+		return (-1);
+
+	if ((h[ENCAP_VXLAN] & ENCAP_VXLAN_I) == 0)
+		return (-1);
+
+	flags = h[ENCAP_VXLAN] & ENCAP_FRAG;
+	*vni = (uint32_t)h[ENCAP_VXLAN + 4] << 16 |
+	    (uint32_t)h[ENCAP_VXLAN + 5] << 8 | h[ENCAP_VXLAN + 6];
+
+	/* drop the underlay padding along with the outer header */
+	fb->len = ip_len + ENCAP_IP;
+	fbuf_pull(fb, ENCAP_HDRLEN);
+
+	return (flags);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ENCAP_H
+#define ENCAP_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+
+#define ENCAP_UDP_PORT	4789	/* IANA VXLAN */
+#define ENCAP_HDRLEN	50	/* ethernet + IPv4 + UDP + VXLAN */
+#define ENCAP_FRAG	0x01	/* reserved VXLAN flag, the payload is a fragment */
+
+/*
+ * The longest frame an outer header carries, the outer IPv4 length counts
+ * it with the headers past ethernet in 16 bits.
+ */
+#define ENCAP_LEN_MAX	(UINT16_MAX - (ENCAP_HDRLEN - 14))
+
+/*
+ * Outer header of a peer, built once. The IPv4 checksum is precomputed
+ * with a zero total length, only the lengths are patched per frame.
+ */
+struct encap_tmpl {
+	uint8_t		hdr[ENCAP_HDRLEN];
+	uint32_t	csum;
+};
+
+int32_t		encap_tmpl_init(struct encap_tmpl *, const uint8_t *, const uint8_t *,
+		    const uint32_t, const uint32_t, const uint16_t, const uint32_t);
+void		encap_hdr(const struct encap_tmpl *, uint8_t *, const uint8_t *,
+		    const uint32_t, const uint8_t);
+int32_t		encap(const struct encap_tmpl *, struct fbuf *);
+uint32_t	encap_burst(const struct encap_tmpl *, struct fbuf **, const uint32_t);
+int32_t		decap(struct fbuf *, const uint16_t, uint32_t *);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fbuf.h"
+
+/*
+ * The pool is one contiguous allocation of `count' buffers. Free buffers
+ * are kept on a lock-free stack, the head packs the index of the top buffer
+ * (plus one, zero means empty) with a generation tag to defeat ABA.
+ */
+struct fbuf_pool {
+	uint64_t	 head;
+	uint32_t	 count;
+	uint32_t	 size;
+	size_t		 stride;
+	uint8_t		*mem;
+};
+
+#define FBUF_ALIGN	64
+
+static struct fbuf	*fbuf_pool_get(struct fbuf_pool *, uint32_t);
+static void		 fbuf_pool_put(struct fbuf_pool *, struct fbuf *);
+static void		 fbuf_reset(struct fbuf *);
+
+struct fbuf *
+fbuf_pool_get(struct fbuf_pool *p, uint32_t idx)
+{
+	return ((struct fbuf *)(p->mem + (size_t)idx * p->stride));
+}
+
+void
+fbuf_pool_put(struct fbuf_pool *p, struct fbuf *fb)
+{
+	uint64_t	old, new;
+	uint32_t	idx;
+
+	idx = ((uint8_t *)fb - p->mem) / p->stride;
+
+	old = __atomic_load_n(&p->head, __ATOMIC_RELAXED);
+	do {
+		fb->next_free = (uint32_t)old;
+		new = ((old >> 32) + 1) << 32 | (idx + 1);
+	} while (!__atomic_compare_exchange_n(&p->head, &old, new, 1,
+	    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void
+fbuf_reset(struct fbuf *fb)
+{
+	fb->data = fb->buf + (fb->size < FBUF_HEADROOM ? 0 : FBUF_HEADROOM);
+	fb->next = NULL;
+	fb->len = 0;
+	fb->refcnt = 1;
+	fb->gso_size = 0;
+}
+
+/*
+ * Creates a pool of `count' buffers of `size' bytes each, headroom
+ * included. If an error occurs, NULL is returned.
+ */
+struct fbuf_pool *
+fbuf_pool_new(const uint32_t count, const uint32_t size)
+{
+	struct fbuf_pool	*p;
+	struct fbuf		*fb;
+	uint32_t		 i;
+
+	if (count == 0 || size == 0)
+		return (NULL);
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		return (NULL);
+
+	p->count = count;
+	p->size = size;
+	p->stride = (sizeof(struct fbuf) + size + FBUF_ALIGN - 1) &
+	    ~(size_t)(FBUF_ALIGN - 1);
+
+	if (posix_memalign((void **)&p->mem, FBUF_ALIGN,
+	    p->stride * count) != 0) {
+		free(p);
+		return (NULL);
+	}
+
+	for (i = count; i > 0; i--) {
+		fb = fbuf_pool_get(p, i - 1);
+		fb->pool = p;
+		fb->size = size;
+		fbuf_pool_put(p, fb);
+	}
+
+	return (p);
+}
+
+/*
+ * Releases the pool memory. Every buffer must have been returned to the
+ * pool before calling this function.
+ */
+void
+fbuf_pool_free(struct fbuf_pool *p)
+{
+	if (p == NULL)
+		return;
+
+	free(p->mem);
+	free(p);
+}
+
+/*
+ * Returns a buffer holding a single reference, taken from the pool if one
+ * is given, or from the heap otherwise. If the pool is exhausted or an
+ * error occurs, NULL is returned.
+ */
+struct fbuf *
+fbuf_alloc(struct fbuf_pool *p)
+{
+	struct fbuf	*fb;
+	uint64_t	 old, new;
+	uint32_t	 idx;
+
+	if (p == NULL) {
+		if ((fb = malloc(sizeof(*fb) + FBUF_SIZE)) == NULL)
+			return (NULL);
+		fb->pool = NULL;
+		fb->size = FBUF_SIZE;
+		fbuf_reset(fb);
+		return (fb);
+	}
+
+	old = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+	do {
+		if ((idx = (uint32_t)old) == 0)
+			return (NULL);
+		fb = fbuf_pool_get(p, idx - 1);
+		new = ((old >> 32) + 1) << 32 | fb->next_free;
+	} while (!__atomic_compare_exchange_n(&p->head, &old, new, 1,
+	    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+	fbuf_reset(fb);
+	return (fb);
+}
+
+struct fbuf *
+fbuf_ref(struct fbuf *fb)
+{
+	__atomic_add_fetch(&fb->refcnt, 1, __ATOMIC_RELAXED);
+	return (fb);
+}
+
+/*
+ * Takes `n' references at once, this is how a frame handed to many
+ * consumers is accounted for with a single atomic operation.
+ */
+void
+fbuf_ref_n(struct fbuf *fb, const uint32_t n)
+{
+	if (n > 0)
+		__atomic_add_fetch(&fb->refcnt, n, __ATOMIC_RELAXED);
+}
+
+void
+fbuf_unref(struct fbuf *fb)
+{
+	fbuf_unref_n(fb, 1);
+}
+
+/*
+ * Drops `n' references, the buffer goes back to its pool, or to the heap,
+ * when the last one is released, along with a reference on the rest of
+ * its chain.
+ */
+void
+fbuf_unref_n(struct fbuf *fb, const uint32_t n)
+{
+	struct fbuf	*next;
+	uint32_t	 drop = n;
+
+	for (; fb != NULL && drop > 0; fb = next, drop = 1) {
+		if (__atomic_sub_fetch(&fb->refcnt, drop, __ATOMIC_ACQ_REL) != 0)
+			return;
+
+		next = fb->next;
+		if (fb->pool)
+			fbuf_pool_put(fb->pool, fb);
+		else
+			free(fb);
+	}
+}
+
+/*
+ * Grows the frame by `len' bytes at the front, using the headroom. Returns
+ * a pointer to the new start of the frame, or NULL if there isn't enough
+ * headroom left.
+ */
+uint8_t *
+fbuf_prepend(struct fbuf *fb, const uint32_t len)
+{
+	if (fbuf_headroom(fb) < len)
+		return (NULL);
+
+	fb->data -= len;
+	fb->len += len;
+
+	return (fb->data);
+}
+
+/*
+ * Grows the frame by `len' bytes at the end. Returns a pointer to the
+ * appended area, or NULL if there isn't enough tailroom left.
+ */
+uint8_t *
+fbuf_append(struct fbuf *fb, const uint32_t len)
+{
+	uint8_t	*p;
+
+	if (fbuf_tailroom(fb) < len)
+		return (NULL);
+
+	p = fb->data + fb->len;
+	fb->len += len;
+
+	return (p);
+}
+
+/*
+ * Strips `len' bytes from the front of the frame. If the frame is shorter
+ * than `len', -1 is returned.
+ */
+int32_t
+fbuf_pull(struct fbuf *fb, const uint32_t len)
+{
+	if (fb->len < len)
+		return (-1);
+
+	fb->data += len;
+	fb->len -= len;
+
+	return (0);
+}
+
+uint32_t
+fbuf_headroom(const struct fbuf *fb)
+{
+	return (fb->data - fb->buf);
+}
+
+uint32_t
+fbuf_tailroom(const struct fbuf *fb)
+{
+	return (fb->size - fbuf_headroom(fb) - fb->len);
+}
+
+/* Returns the length of the frame held by a chain of buffers. */
+uint32_t
+fbuf_chain_len(const struct fbuf *fb)
+{
+	uint32_t	len = 0;
+
+	for (; fb != NULL; fb = fb->next)
+		len += fb->len;
+
+	return (len);
+}
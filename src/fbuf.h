@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FBUF_H
+#define FBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FBUF_HEADROOM	128	/* room reserved in front of the frame */
+#define FBUF_SIZE	2048	/* default capacity, headroom included */
+
+struct fbuf_pool;
+
+/*
+ * A reference counted frame buffer. The frame lives at `data' for `len'
+ * bytes, somewhere inside `buf'. The space between `buf' and `data' is the
+ * headroom where outer headers can be prepended without moving the frame.
+ * A frame may continue in a chain of buffers linked by `next', owned by
+ * the head of the chain.
+ */
+struct fbuf {
+	struct fbuf_pool	*pool;
+	struct fbuf		*next;
+	uint8_t			*data;
+	uint32_t		 len;
+	uint32_t		 size;
+	uint32_t		 refcnt;
+	uint32_t		 next_free;
+	uint32_t		 gso_size;	/* MSS of a coalesced TCP frame */
+	uint8_t			 buf[];
+};
+
+struct fbuf_pool	*fbuf_pool_new(const uint32_t, const uint32_t);
+void			 fbuf_pool_free(struct fbuf_pool *);
+struct fbuf		*fbuf_alloc(struct fbuf_pool *);
+struct fbuf		*fbuf_ref(struct fbuf *);
+void			 fbuf_ref_n(struct fbuf *, const uint32_t);
+void			 fbuf_unref(struct fbuf *);
+void			 fbuf_unref_n(struct fbuf *, const uint32_t);
+uint8_t			*fbuf_prepend(struct fbuf *, const uint32_t);
+uint8_t			*fbuf_append(struct fbuf *, const uint32_t);
+int32_t			 fbuf_pull(struct fbuf *, const uint32_t);
+uint32_t		 fbuf_headroom(const struct fbuf *);
+uint32_t		 fbuf_tailroom(const struct fbuf *);
+uint32_t		 fbuf_chain_len(const struct fbuf *);
+
+#endif
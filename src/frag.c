@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "encap.h"
+#include "fbuf.h"
+#include "frag.h"
+#include "inet.h"
+
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE	CLOCK_MONOTONIC
+#endif
+
+/* the outer IPv4, UDP and VXLAN headers, counted in the path MTU */
+#define FRAG_OUTER	(ENCAP_HDRLEN - ETHER_HDR_LEN)
+
+/*
+ * A frame being reassembled. Its fragments are chained in the order of
+ * their offset and keep their fragment header until the frame is
+ * complete.
+ */
+struct frag_entry {
+	LIST_ENTRY(frag_entry)	 hash_next;
+	TAILQ_ENTRY(frag_entry)	 age;		/* or on the free list */
+	uint32_t		 peer;
+	uint32_t		 id;
+	uint32_t		 total;
+	uint32_t		 got;
+	uint32_t		 bytes;
+	uint32_t		 deadline;	/* ms */
+	struct fbuf		*head;
+};
+
+LIST_HEAD(frag_bucket, frag_entry);
+TAILQ_HEAD(frag_list, frag_entry);
+
+/*
+ * The frames of every peer being reassembled, oldest first. Both the
+ * number of frames and the bytes held are bounded, the oldest frame is
+ * dropped to make room.
+ */
+struct frag_table {
+	struct frag_entry	*entry;
+	struct frag_bucket	*bucket;
+	uint32_t		 mask;
+	struct frag_list	 age;
+	struct frag_list	 free;
+	uint32_t		 bytes;
+	uint32_t		 max_bytes;
+	uint32_t		 timeout;
+	struct frag_stats	 stats;
+};
+
+static uint32_t		 frag_clock(void);
+static uint32_t		 frag_rd32(const uint8_t *);
+static uint16_t		 frag_rd16(const uint8_t *);
+static uint32_t		 frag_hash(uint32_t, uint32_t);
+static void		 frag_drop(frag_table *, struct frag_entry *);
+
+uint32_t
+frag_clock(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ((uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000));
+}
+
+uint32_t
+frag_rd32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | p[3]);
+}
+
+uint16_t
+frag_rd16(const uint8_t *p)
+{
+	return ((uint16_t)p[0] << 8 | p[1]);
+}
+
+uint32_t
+frag_hash(uint32_t peer, uint32_t id)
+{
+	return (inet_macaddr_hash((uint64_t)peer << 32 | id));
+}
+
+/* Releases a frame being reassembled along with its fragments. */
+void
+frag_drop(frag_table *t, struct frag_entry *e)
+{
+	LIST_REMOVE(e, hash_next);
+	TAILQ_REMOVE(&t->age, e, age);
+	TAILQ_INSERT_HEAD(&t->free, e, age);
+	t->bytes -= e->bytes;
+	fbuf_unref(e->head);
+	e->head = NULL;
+}
+
+/*
+ * Splits a frame tunnelled to a peer into segments that fit the path
+ * `mtu', each carrying its outer header and a slice of the frame, which
+ * isn't copied. A frame that fits makes a single segment without a
+ * fragment header. The fragments are identified by `id', which must
+ * change from one frame to the next. The reference on `fb' is handed to
+ * the segments and their number is returned. If the MTU is too small,
+ * more than `max' segments are needed or the frame is over 64KB, -1 is
+ * returned.
+ */
+int32_t
+frag_split(const struct encap_tmpl *t, struct fbuf *fb, const uint32_t mtu,
+    const uint32_t id, struct frag_seg *seg, const uint32_t max)
+{
+	uint8_t		*h;
+	uint32_t	 n, k, chunk, off;
+
+	if (max == 0 || fb->len < 2 * ETHER_ADDR_LEN ||
+	    mtu <= FRAG_OUTER + FRAG_HDRLEN)
+		return (-1);
+
+	if (fb->len <= mtu - FRAG_OUTER && fb->len <= ENCAP_LEN_MAX) {
+		encap_hdr(t, seg[0].hdr, fb->data, fb->len, 0);
+		seg[0].hlen = ENCAP_HDRLEN;
+		seg[0].data = fb->data;
+		seg[0].len = fb->len;
+		seg[0].fb = fb;
+		return (1);
+	}
+
+	if (fb->len > UINT16_MAX)
+		return (-1);
+
+	/* even slices, the last one isn't left with a few bytes */
+	chunk = mtu - FRAG_OUTER - FRAG_HDRLEN;
+	n = (fb->len + chunk - 1) / chunk;
+	if (n > max)
+		return (-1);
+	chunk = (fb->len + n - 1) / n;
+
+	for (k = 0, off = 0; k < n; k++, off += chunk) {
+		seg[k].data = fb->data + off;
+		seg[k].len = fb->len - off < chunk ? fb->len - off : chunk;
+		seg[k].hlen = ENCAP_HDRLEN + FRAG_HDRLEN;
+		seg[k].fb = fb;
+
+		encap_hdr(t, seg[k].hdr, fb->data, FRAG_HDRLEN + seg[k].len,
+		    ENCAP_FRAG);
+		h = seg[k].hdr + ENCAP_HDRLEN;
+		h[0] = id >> 24;
+		h[1] = id >> 16;
+		h[2] = id >> 8;
+		h[3] = id;
+		h[4] = off >> 8;
+		h[5] = off;
+		h[6] = fb->len >> 8;
+		h[7] = fb->len;
+	}
+	fbuf_ref_n(fb, n - 1);
+
+	return (n);
+}
+
+/* Releases the references held by `n' segments once they are written. */
+void
+frag_seg_release(struct frag_seg *seg, const uint32_t n)
+{
+	uint32_t	i;
+
+	for (i = 0; i < n; i++)
+		fbuf_unref(seg[i].fb);
+}
+
+/*
+ * Creates a reassembly table of at most `max' frames holding at most
+ * `max_bytes' bytes of fragments, a frame not completed within `timeout'
+ * milliseconds is dropped. If an error occurs, NULL is returned.
+ */
+frag_table *
+frag_table_new(const uint32_t max, const uint32_t max_bytes,
+    const uint32_t timeout)
+{
+	frag_table	*t;
+	uint32_t	 i, n;
+
+	if (max == 0 || max_bytes == 0)
+		return (NULL);
+
+	if ((t = calloc(1, sizeof(*t))) == NULL)
+		return (NULL);
+
+	for (n = 1; n < max; n <<= 1)
+		;
+	if ((t->entry = calloc(max, sizeof(*t->entry))) == NULL ||
+	    (t->bucket = calloc(n, sizeof(*t->bucket))) == NULL) {
+		frag_table_free(t);
+		return (NULL);
+	}
+	t->mask = n - 1;
+	t->max_bytes = max_bytes;
+	t->timeout = timeout;
+
+	TAILQ_INIT(&t->age);
+	TAILQ_INIT(&t->free);
+	for (i = 0; i < max; i++)
+		TAILQ_INSERT_TAIL(&t->free, &t->entry[i], age);
+
+	return (t);
+}
+
+void
+frag_table_free(frag_table *t)
+{
+	struct frag_entry	*e;
+
+	if (t == NULL)
+		return;
+
+	if (t->entry != NULL)
+		while ((e = TAILQ_FIRST(&t->age)) != NULL)
+			frag_drop(t, e);
+
+	free(t->entry);
+	free(t->bucket);
+	free(t);
+}
+
+/*
+ * Adds a fragment from `peer', as left by decap(), to the table. When it
+ * completes its frame, the frame is returned as a chain of the fragment
+ * buffers, stripped of their fragment header. Otherwise the fragment is
+ * kept, or dropped if it's invalid, and NULL is returned. The reference
+ * on `fb' is consumed either way.
+ */
+struct fbuf *
+frag_reass(frag_table *t, struct fbuf *fb, const uint32_t peer)
+{
+	struct frag_entry	*e = NULL, *old;
+	struct fbuf		**pp, *prev, *f;
+	uint32_t		  id, off, total, len, hash;
+
+	if (fb->len <= FRAG_HDRLEN || fb->next != NULL)
+		goto invalid;
+
+	id = frag_rd32(fb->data);
+	off = frag_rd16(fb->data + 4);
+	total = frag_rd16(fb->data + 6);
+	len = fb->len - FRAG_HDRLEN;
+	if (off + len > total || fb->len > t->max_bytes)
+		goto invalid;
+
+	hash = frag_hash(peer, id);
+	LIST_FOREACH(e, &t->bucket[hash & t->mask], hash_next)
+		if (e->peer == peer && e->id == id)
+			break;
+
+	if (e == NULL) {
+		if ((e = TAILQ_FIRST(&t->free)) == NULL) {
+			frag_drop(t, TAILQ_FIRST(&t->age));
+			t->stats.evictions++;
+			e = TAILQ_FIRST(&t->free);
+		}
+		TAILQ_REMOVE(&t->free, e, age);
+		e->peer = peer;
+		e->id = id;
+		e->total = total;
+		e->got = 0;
+		e->bytes = 0;
+		e->deadline = frag_clock() + t->timeout;
+		LIST_INSERT_HEAD(&t->bucket[hash & t->mask], e, hash_next);
+		TAILQ_INSERT_TAIL(&t->age, e, age);
+	} else if (e->total != total)
+		goto invalid;
+
+	/* make room from the frames older than this one */
+	while (t->bytes + fb->len > t->max_bytes &&
+	    (old = TAILQ_FIRST(&t->age)) != e) {
+		frag_drop(t, old);
+		t->stats.evictions++;
+	}
+	if (t->bytes + fb->len > t->max_bytes)
+		goto invalid;
+
+	/* the fragments are kept sorted, overlaps are refused */
+	prev = NULL;
+	for (pp = &e->head; *pp != NULL &&
+	    frag_rd16((*pp)->data + 4) < off; pp = &(*pp)->next)
+		prev = *pp;
+	if ((prev != NULL && frag_rd16(prev->data + 4) + prev->len -
+	    FRAG_HDRLEN > off) ||
+	    (*pp != NULL && off + len > frag_rd16((*pp)->data + 4)))
+		goto invalid;
+
+	fb->next = *pp;
+	*pp = fb;
+	e->got += len;
+	e->bytes += fb->len;
+	t->bytes += fb->len;
+
+	if (e->got < e->total)
+		return (NULL);
+
+	fb = e->head;
+	e->head = NULL;
+	frag_drop(t, e);
+	for (f = fb; f != NULL; f = f->next)
+		fbuf_pull(f, FRAG_HDRLEN);
+	t->stats.reassembled++;
+
+	return (fb);
+
+invalid:
+	/* an entry created for this fragment is left empty */
+	if (e != NULL && e->head == NULL)
+		frag_drop(t, e);
+	t->stats.invalid++;
+	fbuf_unref(fb);
+	return (NULL);
+}
+
+/*
+ * Drops the frames whose fragments didn't all arrive in time. Returns the
+ * number of frames dropped.
+ */
+uint32_t
+frag_expire(frag_table *t)
+{
+	struct frag_entry	*e;
+	uint32_t		 now, n = 0;
+
+	now = frag_clock();
+	while ((e = TAILQ_FIRST(&t->age)) != NULL &&
+	    (int32_t)(now - e->deadline) >= 0) {
+		frag_drop(t, e);
+		t->stats.timeouts++;
+		n++;
+	}
+
+	return (n);
+}
+
+void
+frag_stats(const frag_table *t, struct frag_stats *stats)
+{
+	*stats = t->stats;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FRAG_H
+#define FRAG_H
+
+#include <stdint.h>
+
+#include "encap.h"
+#include "fbuf.h"
+
+/*
+ * A fragment is tunnelled with the ENCAP_FRAG flag, its payload starts
+ * with the identifier of the frame, the offset of the fragment and the
+ * length of the frame, all in network order.
+ */
+#define FRAG_HDRLEN	8
+#define FRAG_SEG_MAX	64
+
+/*
+ * A segment ready to be written with a gather I/O: the headers, then
+ * `len' bytes of the frame at `data'. The segment holds a reference on
+ * the frame buffer.
+ */
+struct frag_seg {
+	uint8_t		 hdr[ENCAP_HDRLEN + FRAG_HDRLEN];
+	uint32_t	 hlen;
+	const uint8_t	*data;
+	uint32_t	 len;
+	struct fbuf	*fb;
+};
+
+typedef struct frag_table frag_table;
+
+struct frag_stats {
+	uint64_t	reassembled;
+	uint64_t	timeouts;
+	uint64_t	evictions;	/* dropped to stay within bounds */
+	uint64_t	invalid;	/* overlapping or out of bounds */
+};
+
+int32_t		 frag_split(const struct encap_tmpl *, struct fbuf *, const uint32_t,
+		    const uint32_t, struct frag_seg *, const uint32_t);
+void		 frag_seg_release(struct frag_seg *, const uint32_t);
+frag_table	*frag_table_new(const uint32_t, const uint32_t, const uint32_t);
+void		 frag_table_free(frag_table *);
+struct fbuf	*frag_reass(frag_table *, struct fbuf *, const uint32_t);
+uint32_t	 frag_expire(frag_table *);
+void		 frag_stats(const frag_table *, struct frag_stats *);
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fbuf.h"
+#include "inet.h"
+#include "fsched.h"
+
+#define FSCHED_CACHELINE	64
+#define FSCHED_NONE	UINT32_MAX
+#define FSCHED_IDLE_NS	1000000
+
+/*
+ * The frames of a set of flows, in arrival order. A shard is owned by at
+ * most one worker at a time: from the moment it has frames it's either on
+ * the ready list of a worker or being run by one, so the frames of a flow
+ * are never processed concurrently nor reordered.
+ */
+struct fsched_shard {
+	pthread_mutex_t	 lock;
+	uint32_t	 head;
+	uint32_t	 tail;
+	uint32_t	 mask;
+	uint32_t	 home;		/* worker it's queued to */
+	int		 queued;	/* on a ready list or running */
+	uint64_t	 drops;
+	struct fbuf	**ring;
+} __attribute__((aligned(FSCHED_CACHELINE)));
+
+/*
+ * A worker runs the shards of its ready list from the head. Idle workers
+ * steal shards from the tail of the others.
+ */
+struct fsched_worker {
+	pthread_mutex_t	 lock;
+	pthread_cond_t	 cond;
+	uint32_t	*ready;
+	uint32_t	 head;
+	uint32_t	 tail;
+	int		 idle;
+	uint32_t	 id;
+	pthread_t	 thread;
+	struct fsched	*s;
+	uint64_t	 frames;
+	uint64_t	 bursts;
+	uint64_t	 steals;
+} __attribute__((aligned(FSCHED_CACHELINE)));
+
+struct fsched_stage {
+	fsched_stage_fn	 fn;
+	void		*arg;
+};
+
+struct fsched {
+	struct fsched_worker	*worker;
+	uint32_t		 n_worker;
+	struct fsched_shard	*shard;
+	uint32_t		 n_shard;	/* power of two */
+	uint32_t		 ready_mask;
+	struct fsched_stage	 stage[FSCHED_STAGES_MAX];
+	uint32_t		 n_stage;
+	uint32_t		 started;
+	int			 stop;
+};
+
+static void		 fsched_ready(fsched *, struct fsched_worker *,
+			    uint32_t);
+static uint32_t		 fsched_pop(struct fsched_worker *);
+static uint32_t		 fsched_steal(struct fsched_worker *);
+static void		 fsched_run(struct fsched_worker *, uint32_t);
+static void		*fsched_loop(void *);
+
+/*
+ * Creates a scheduler of `n_worker' threads. The flows are spread over
+ * `n_shard' shards, rounded up to a power of two, each queueing up to
+ * `depth' frames. There should be a few shards per worker so that the load
+ * can be balanced. If an error occurs, NULL is returned.
+ */
+fsched *
+fsched_new(const uint32_t n_worker, const uint32_t n_shard,
+    const uint32_t depth)
+{
+	fsched		*s;
+	uint32_t	 i, ns, nd;
+
+	if (n_worker == 0 || n_shard == 0 || depth == 0)
+		return (NULL);
+
+	for (ns = 1; ns < n_shard; ns <<= 1)
+		;
+	for (nd = 1; nd < depth; nd <<= 1)
+		;
+
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return (NULL);
+
+	if (posix_memalign((void **)&s->shard, FSCHED_CACHELINE,
+	    ns * sizeof(*s->shard)) != 0)
+		goto error;
+	memset(s->shard, 0, ns * sizeof(*s->shard));
+	for (i = 0; i < ns; i++) {
+		s->shard[i].mask = nd - 1;
+		s->shard[i].home = i % n_worker;
+		pthread_mutex_init(&s->shard[i].lock, NULL);
+		s->n_shard++;
+		if ((s->shard[i].ring = calloc(nd,
+		    sizeof(struct fbuf *))) == NULL)
+			goto error;
+	}
+	s->ready_mask = ns - 1;
+
+	if (posix_memalign((void **)&s->worker, FSCHED_CACHELINE,
+	    n_worker * sizeof(*s->worker)) != 0)
+		goto error;
+	memset(s->worker, 0, n_worker * sizeof(*s->worker));
+	for (i = 0; i < n_worker; i++) {
+		s->worker[i].id = i;
+		s->worker[i].s = s;
+		pthread_mutex_init(&s->worker[i].lock, NULL);
+		pthread_cond_init(&s->worker[i].cond, NULL);
+		s->n_worker++;
+		if ((s->worker[i].ready = calloc(ns, sizeof(uint32_t))) == NULL)
+			goto error;
+	}
+
+	return (s);
+
+error:
+	fsched_free(s);
+	return (NULL);
+}
+
+/*
+ * Stops the workers and releases the scheduler along with the frames still
+ * queued.
+ */
+void
+fsched_free(fsched *s)
+{
+	struct fsched_shard	*sh;
+	uint32_t		 i;
+
+	if (s == NULL)
+		return;
+
+	fsched_stop(s);
+
+	for (i = 0; i < s->n_shard; i++) {
+		sh = &s->shard[i];
+		if (sh->ring != NULL)
+			for (; sh->head != sh->tail; sh->head++)
+				fbuf_unref(sh->ring[sh->head & sh->mask]);
+		free(sh->ring);
+		pthread_mutex_destroy(&sh->lock);
+	}
+	free(s->shard);
+
+	for (i = 0; i < s->n_worker; i++) {
+		free(s->worker[i].ready);
+		pthread_mutex_destroy(&s->worker[i].lock);
+		pthread_cond_destroy(&s->worker[i].cond);
+	}
+	free(s->worker);
+
+	free(s);
+}
+
+/*
+ * Appends a stage to the pipeline run over every burst, before the
+ * scheduler is started. The frames left after the last stage are
+ * released. If there are too many stages or the workers are running, -1
+ * is returned.
+ */
+int32_t
+fsched_stage_add(fsched *s, fsched_stage_fn fn, void *arg)
+{
+	if (s->started || s->n_stage == FSCHED_STAGES_MAX)
+		return (-1);
+
+	s->stage[s->n_stage].fn = fn;
+	s->stage[s->n_stage].arg = arg;
+	s->n_stage++;
+
+	return (0);
+}
+
+/*
+ * Starts the workers. If a thread can't be created, the ones already
+ * started are stopped and -1 is returned.
+ */
+int32_t
+fsched_start(fsched *s)
+{
+	uint32_t	i;
+
+	if (s->started)
+		return (-1);
+
+	s->stop = 0;
+	for (i = 0; i < s->n_worker; i++) {
+		if (pthread_create(&s->worker[i].thread, NULL, fsched_loop,
+		    &s->worker[i]) != 0) {
+			fsched_stop(s);
+			return (-1);
+		}
+		s->started++;
+	}
+
+	return (0);
+}
+
+/*
+ * Waits for the workers to run the frames already submitted, then stops
+ * them. No frame may be submitted meanwhile.
+ */
+void
+fsched_stop(fsched *s)
+{
+	uint32_t	i;
+
+	if (s->started == 0)
+		return;
+
+	__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < s->started; i++) {
+		pthread_mutex_lock(&s->worker[i].lock);
+		pthread_cond_signal(&s->worker[i].cond);
+		pthread_mutex_unlock(&s->worker[i].lock);
+	}
+	for (i = 0; i < s->started; i++)
+		pthread_join(s->worker[i].thread, NULL);
+	s->started = 0;
+}
+
+/*
+ * Queues a burst of frames to the shards of their flows, the frames of a
+ * flow stay in order. The references travel with the frames. Returns the
+ * number of frames queued, the others found their shard full and are
+ * released.
+ */
+uint32_t
+fsched_submit(fsched *s, struct fbuf **fb, const uint32_t n)
+{
+	struct inet_frame	 f;
+	struct fsched_shard	*sh;
+	uint32_t		 shard[FSCHED_BURST];
+	uint32_t		 i, j, k, off, home, queued = 0;
+	int			 wake;
+
+	for (off = 0; off < n; off += k) {
+		k = n - off < FSCHED_BURST ? n - off : FSCHED_BURST;
+
+		for (i = 0; i < k; i++)
+			shard[i] = inet_parse(&f, fb[off + i]->data,
+			    fb[off + i]->len) == -1 ? 0 :
+			    inet_flow_hash(&f) & s->ready_mask;
+
+		/* one lock per shard present in the burst */
+		for (i = 0; i < k; i++) {
+			if (shard[i] == FSCHED_NONE)
+				continue;
+			sh = &s->shard[shard[i]];
+
+			pthread_mutex_lock(&sh->lock);
+			for (j = i; j < k; j++) {
+				if (shard[j] != shard[i])
+					continue;
+				if (sh->tail - sh->head > sh->mask) {
+					fbuf_unref(fb[off + j]);
+					__atomic_add_fetch(&sh->drops, 1,
+					    __ATOMIC_RELAXED);
+				} else {
+					sh->ring[sh->tail++ & sh->mask] =
+					    fb[off + j];
+					queued++;
+				}
+				if (j > i)
+					shard[j] = FSCHED_NONE;
+			}
+			wake = sh->head != sh->tail && !sh->queued;
+			if (wake)
+				sh->queued = 1;
+			home = sh->home;
+			pthread_mutex_unlock(&sh->lock);
+
+			if (wake)
+				fsched_ready(s, &s->worker[home], shard[i]);
+			shard[i] = FSCHED_NONE;
+		}
+	}
+
+	return (queued);
+}
+
+void
+fsched_stats(fsched *s, struct fsched_stats *stats)
+{
+	struct fsched_worker	*w;
+	uint32_t		 i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < s->n_worker; i++) {
+		w = &s->worker[i];
+		stats->frames += __atomic_load_n(&w->frames, __ATOMIC_RELAXED);
+		stats->bursts += __atomic_load_n(&w->bursts, __ATOMIC_RELAXED);
+		stats->steals += __atomic_load_n(&w->steals, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < s->n_shard; i++)
+		stats->drops += __atomic_load_n(&s->shard[i].drops,
+		    __ATOMIC_RELAXED);
+}
+
+/*
+ * Puts a shard on the ready list of a worker and wakes it up. When the
+ * worker is already busy, an idle one is woken up to steal it.
+ */
+void
+fsched_ready(fsched *s, struct fsched_worker *w, uint32_t shard)
+{
+	struct fsched_worker	*o;
+	uint32_t		 i;
+	int			 idle, backlog;
+
+	pthread_mutex_lock(&w->lock);
+	w->ready[w->tail & s->ready_mask] = shard;
+	__atomic_store_n(&w->tail, w->tail + 1, __ATOMIC_RELAXED);
+	idle = w->idle;
+	backlog = w->tail - w->head > 1;
+	if (idle)
+		pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	if (idle || !backlog)
+		return;
+
+	for (i = 1; i < s->n_worker; i++) {
+		o = &s->worker[(w->id + i) % s->n_worker];
+		if (__atomic_load_n(&o->idle, __ATOMIC_RELAXED)) {
+			pthread_mutex_lock(&o->lock);
+			pthread_cond_signal(&o->cond);
+			pthread_mutex_unlock(&o->lock);
+			return;
+		}
+	}
+}
+
+uint32_t
+fsched_pop(struct fsched_worker *w)
+{
+	uint32_t	shard = FSCHED_NONE;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->head != w->tail) {
+		shard = w->ready[w->head & w->s->ready_mask];
+		__atomic_store_n(&w->head, w->head + 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return (shard);
+}
+
+/* Takes the most recently queued shard of the first busy worker found. */
+uint32_t
+fsched_steal(struct fsched_worker *w)
+{
+	fsched			*s = w->s;
+	struct fsched_worker	*o;
+	uint32_t		 i, shard = FSCHED_NONE;
+
+	for (i = 1; i < s->n_worker && shard == FSCHED_NONE; i++) {
+		o = &s->worker[(w->id + i) % s->n_worker];
+		if (__atomic_load_n(&o->tail, __ATOMIC_RELAXED) ==
+		    __atomic_load_n(&o->head, __ATOMIC_RELAXED))
+			continue;
+
+		pthread_mutex_lock(&o->lock);
+		if (o->head != o->tail) {
+			__atomic_store_n(&o->tail, o->tail - 1,
+			    __ATOMIC_RELAXED);
+			shard = o->ready[o->tail & s->ready_mask];
+		}
+		pthread_mutex_unlock(&o->lock);
+	}
+
+	if (shard != FSCHED_NONE)
+		__atomic_add_fetch(&w->steals, 1, __ATOMIC_RELAXED);
+
+	return (shard);
+}
+
+/*
+ * Runs a burst of a shard through the stages. A shard with frames left is
+ * queued back to the end of the worker's list, so that the other shards
+ * get their turn.
+ */
+void
+fsched_run(struct fsched_worker *w, uint32_t shard)
+{
+	fsched			*s = w->s;
+	struct fsched_shard	*sh = &s->shard[shard];
+	struct fbuf		*fb[FSCHED_BURST];
+	uint32_t		 i, n, k;
+	int			 more;
+
+	pthread_mutex_lock(&sh->lock);
+	for (n = 0; n < FSCHED_BURST && sh->head != sh->tail; n++)
+		fb[n] = sh->ring[sh->head++ & sh->mask];
+	pthread_mutex_unlock(&sh->lock);
+
+	__atomic_add_fetch(&w->frames, n, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&w->bursts, 1, __ATOMIC_RELAXED);
+
+	for (i = 0, k = n; i < s->n_stage && k > 0; i++)
+		k = s->stage[i].fn(s->stage[i].arg, w->id, shard, fb, k);
+	for (i = 0; i < k; i++)
+		fbuf_unref(fb[i]);
+
+	pthread_mutex_lock(&sh->lock);
+	more = sh->head != sh->tail;
+	if (more)
+		sh->home = w->id;
+	else
+		sh->queued = 0;
+	pthread_mutex_unlock(&sh->lock);
+
+	if (more) {
+		pthread_mutex_lock(&w->lock);
+		w->ready[w->tail & s->ready_mask] = shard;
+		__atomic_store_n(&w->tail, w->tail + 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&w->lock);
+	}
+}
+
+void *
+fsched_loop(void *arg)
+{
+	struct fsched_worker	*w = arg;
+	fsched			*s = w->s;
+	struct timespec		 ts;
+	uint32_t		 shard;
+
+	for (;;) {
+		if ((shard = fsched_pop(w)) != FSCHED_NONE ||
+		    (shard = fsched_steal(w)) != FSCHED_NONE) {
+			fsched_run(w, shard);
+			continue;
+		}
+
+		pthread_mutex_lock(&w->lock);
+		if (w->head == w->tail) {
+			if (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+				pthread_mutex_unlock(&w->lock);
+				break;
+			}
+			/* a steal opportunity may come without a wake up */
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += FSCHED_IDLE_NS;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			__atomic_store_n(&w->idle, 1, __ATOMIC_RELAXED);
+			pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+			__atomic_store_n(&w->idle, 0, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	return (NULL);
+}
+
+#endif
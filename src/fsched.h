@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FSCHED_H
+#define FSCHED_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+
+#define FSCHED_BURST		32
+#define FSCHED_STAGES_MAX	8
+
+typedef struct fsched fsched;
+
+/*
+ * A stage is called with its argument, the worker and the shard running a
+ * burst of `n' frames. It keeps the frames to pass on at the start of the
+ * array, in order, and returns their number. The frames it drops or keeps
+ * for itself are its own to release. Shards move between workers, the
+ * state of a flow belongs to its shard.
+ */
+typedef uint32_t	(*fsched_stage_fn)(void *, const uint32_t,
+			    const uint32_t, struct fbuf **, const uint32_t);
+
+struct fsched_stats {
+	uint64_t	frames;
+	uint64_t	bursts;
+	uint64_t	steals;		/* shards run away from their worker */
+	uint64_t	drops;		/* shard queue full */
+};
+
+fsched		*fsched_new(const uint32_t, const uint32_t, const uint32_t);
+void		 fsched_free(fsched *);
+int32_t		 fsched_stage_add(fsched *, fsched_stage_fn, void *);
+int32_t		 fsched_start(fsched *);
+void		 fsched_stop(fsched *);
+uint32_t	 fsched_submit(fsched *, struct fbuf **, const uint32_t);
+void		 fsched_stats(fsched *, struct fsched_stats *);
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fbuf.h"
+#include "gro.h"
+#include "inet.h"
+
+#define TH_FIN		0x01
+#define TH_SYN		0x02
+#define TH_RST		0x04
+#define TH_PUSH		0x08
+#define TH_ACK		0x10
+#define TH_CWR		0x80
+
+#define GRO_IP_MAX	65535
+
+/* the headers of a segment that can be coalesced */
+struct gro_seg {
+	uint8_t		*h;
+	uint16_t	 l3_off;
+	uint16_t	 l4_off;
+	uint16_t	 hlen;		/* up to the TCP payload */
+	uint16_t	 plen;		/* TCP payload */
+	uint32_t	 psum;		/* checksum of the payload, if verified */
+	uint32_t	 hash;
+};
+
+/*
+ * A flow being coalesced. The first segment stays in its slot of the
+ * burst, it's copied into a pool buffer when a second one is merged.
+ */
+struct gro_flow {
+	struct fbuf	*fb;
+	uint32_t	 slot;
+	uint32_t	 hash;
+	uint32_t	 next_seq;
+	uint32_t	 sum;		/* checksum of the merged payload */
+	uint32_t	 len;		/* frame length without padding */
+	uint16_t	 l3_off;
+	uint16_t	 l4_off;
+	uint16_t	 hlen;
+	uint16_t	 mss;
+	uint8_t		 merged;
+	uint8_t		 open;		/* more segments may follow */
+};
+
+struct gro {
+	struct fbuf_pool	*pool;
+	struct gro_flow		 flow[GRO_FLOWS];
+	uint32_t		 n_flow;
+};
+
+static uint16_t		 gro_rd16(const uint8_t *);
+static uint32_t		 gro_rd32(const uint8_t *);
+static void		 gro_wr16(uint8_t *, uint16_t);
+static void		 gro_wr32(uint8_t *, uint32_t);
+static uint32_t		 gro_sum(const uint8_t *, uint32_t);
+static uint32_t		 gro_add(uint32_t, uint32_t);
+static void		 gro_csum(uint8_t *, uint16_t, uint16_t, uint32_t, uint32_t);
+static int		 gro_seg(struct gro_seg *, struct fbuf *, uint8_t *, int);
+static struct gro_flow	*gro_find(gro *, const uint8_t *, uint16_t, uint16_t,
+			    uint32_t);
+static int		 gro_merge(gro *, struct gro_flow *, struct gro_seg *,
+			    struct fbuf **);
+static void		 gro_flush(gro *, struct gro_flow *);
+
+uint16_t
+gro_rd16(const uint8_t *p)
+{
+	return ((uint16_t)p[0] << 8 | p[1]);
+}
+
+uint32_t
+gro_rd32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | p[3]);
+}
+
+void
+gro_wr16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+void
+gro_wr32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/* Returns the unfolded one's complement sum of `len' bytes, at most 64KB. */
+uint32_t
+gro_sum(const uint8_t *p, uint32_t len)
+{
+	uint32_t	sum = 0, i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (uint32_t)p[i] << 8 | p[i + 1];
+	if (len & 1)
+		sum += (uint32_t)p[len - 1] << 8;
+
+	return (sum);
+}
+
+/* Adds two partial sums, keeping the result folded to 16 bits. */
+uint32_t
+gro_add(uint32_t a, uint32_t b)
+{
+	a += b;
+	if (a < b)
+		a++;
+	a = (a & 0xffff) + (a >> 16);
+	return ((a & 0xffff) + (a >> 16));
+}
+
+/*
+ * Sets the IPv4 and TCP checksums of the segment whose headers start at
+ * `h', the TCP payload summing to `psum'.
+ */
+void
+gro_csum(uint8_t *h, uint16_t l3_off, uint16_t l4_off, uint32_t tcp_len,
+    uint32_t psum)
+{
+	uint8_t		*ip = h + l3_off, *th = h + l4_off;
+	uint32_t	 sum;
+
+	gro_wr16(ip + 10, 0);
+	gro_wr16(ip + 10, ~gro_add(gro_sum(ip, l4_off - l3_off), 0) & 0xffff);
+
+	gro_wr16(th + 16, 0);
+	sum = gro_sum(ip + 12, 8) + IPPROTO_TCP + tcp_len;
+	sum = gro_add(sum, gro_sum(th, (th[12] >> 4) * 4));
+	sum = gro_add(sum, psum);
+	gro_wr16(th + 16, ~sum & 0xffff);
+}
+
+/*
+ * Checks whether a frame is a TCP segment over IPv4 that can be
+ * coalesced: no IP options or fragmentation, a payload, no flag but ACK
+ * and PSH, and with `csum', valid IPv4 and TCP checksums. Returns 1 if
+ * so, 0 for any other TCP segment over IPv4, and -1 for other frames.
+ */
+int
+gro_seg(struct gro_seg *s, struct fbuf *fb, uint8_t *flags, int csum)
+{
+	struct inet_frame	 f;
+	uint8_t			*ip;
+	uint32_t		 ip_len, thlen, sum;
+
+	if (inet_parse(&f, fb->data, fb->len) < 0 || f.ip_ver != 4 ||
+	    f.ip_proto != IPPROTO_TCP || f.l4_off == 0)
+		return (-1);
+
+	s->h = fb->data;
+	s->l3_off = f.l3_off;
+	s->l4_off = f.l4_off;
+	s->hash = inet_flow_hash(&f);
+	*flags = f.tcp_flags;
+
+	ip = fb->data + f.l3_off;
+	ip_len = gro_rd16(ip + 2);
+	thlen = (fb->data[f.l4_off + 12] >> 4) * 4;
+	if (f.l4_off - f.l3_off != 20 || gro_rd16(ip + 6) & 0x3fff ||
+	    ip_len > fb->len - f.l3_off || thlen < 20 ||
+	    ip_len <= 20 + thlen)
+		return (0);
+
+	if ((f.tcp_flags & ~TH_PUSH) != TH_ACK)
+		return (0);
+
+	s->hlen = f.l4_off + thlen;
+	s->plen = ip_len - 20 - thlen;
+	if (!csum)
+		return (1);
+
+	/* a corrupted segment must not get a valid checksum once merged */
+	if (gro_add(gro_sum(ip, 20), 0) != 0xffff)
+		return (0);
+	s->psum = gro_add(gro_sum(s->h + s->hlen, s->plen), 0);
+	sum = gro_sum(ip + 12, 8) + IPPROTO_TCP + ip_len - 20;
+	sum = gro_add(sum, gro_sum(s->h + f.l4_off, thlen));
+	if (gro_add(sum, s->psum) != 0xffff)
+		return (0);
+
+	return (1);
+}
+
+/* Looks for the flow of a segment, same L2 header and same TCP 4-tuple. */
+struct gro_flow *
+gro_find(gro *g, const uint8_t *h, uint16_t l3_off, uint16_t l4_off,
+    uint32_t hash)
+{
+	struct gro_flow	*fl;
+	const uint8_t	*fh;
+	uint32_t	 i;
+
+	for (i = 0; i < g->n_flow; i++) {
+		fl = &g->flow[i];
+		if (fl->hash != hash || fl->l3_off != l3_off ||
+		    fl->l4_off != l4_off)
+			continue;
+		fh = fl->fb->data;
+		if (memcmp(fh, h, l3_off) == 0 &&
+		    memcmp(fh + l3_off + 12, h + l3_off + 12, 8) == 0 &&
+		    memcmp(fh + l4_off, h + l4_off, 4) == 0)
+			return (fl);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Appends the payload of a segment to its flow. The segment must be the
+ * next in sequence and carry the same IP and TCP header fields, but the
+ * window and PSH. If it can't be merged, -1 is returned.
+ */
+int
+gro_merge(gro *g, struct gro_flow *fl, struct gro_seg *s, struct fbuf **fb)
+{
+	struct fbuf	*sfb;
+	uint8_t		*fh, *p;
+	uint32_t	 psum, off;
+
+	fh = fl->fb->data;
+	if (!fl->open || s->hlen != fl->hlen || s->plen > fl->mss ||
+	    gro_rd32(s->h + s->l4_off + 4) != fl->next_seq ||
+	    fl->len + s->plen > (uint32_t)fl->l3_off + GRO_IP_MAX)
+		return (-1);
+
+	/* TOS and TTL, DF, ACK and the options must not change */
+	if (fh[fl->l3_off + 1] != s->h[s->l3_off + 1] ||
+	    fh[fl->l3_off + 8] != s->h[s->l3_off + 8] ||
+	    (fh[fl->l3_off + 6] ^ s->h[s->l3_off + 6]) & 0x40 ||
+	    memcmp(fh + fl->l4_off + 8, s->h + s->l4_off + 8, 4) != 0 ||
+	    memcmp(fh + fl->l4_off + 20, s->h + s->l4_off + 20,
+	    fl->hlen - fl->l4_off - 20) != 0)
+		return (-1);
+
+	if (!fl->merged) {
+		if ((sfb = fbuf_alloc(g->pool)) == NULL)
+			return (-1);
+		if ((p = fbuf_append(sfb, fl->len)) == NULL) {
+			fbuf_unref(sfb);
+			return (-1);
+		}
+		memcpy(p, fh, fl->len);
+		fbuf_unref(fl->fb);
+		fl->fb = fb[fl->slot] = sfb;
+		fl->merged = 1;
+		fh = sfb->data;
+	}
+
+	if ((p = fbuf_append(fl->fb, s->plen)) == NULL)
+		return (-1);
+	memcpy(p, s->h + s->hlen, s->plen);
+
+	/* a payload appended at an odd offset sums byte swapped */
+	psum = s->psum;
+	off = fl->len - fl->hlen;
+	if (off & 1)
+		psum = (psum >> 8 | psum << 8) & 0xffff;
+	fl->sum = gro_add(fl->sum, psum);
+
+	fl->len += s->plen;
+	fl->next_seq += s->plen;
+	memcpy(fh + fl->l4_off + 14, s->h + s->l4_off + 14, 2);
+	if (s->h[s->l4_off + 13] & TH_PUSH) {
+		fh[fl->l4_off + 13] |= TH_PUSH;
+		fl->open = 0;
+	}
+	if (s->plen < fl->mss)
+		fl->open = 0;
+
+	return (0);
+}
+
+/* Fixes the headers of a super-frame and forgets the flow. */
+void
+gro_flush(gro *g, struct gro_flow *fl)
+{
+	uint8_t	*h;
+
+	if (fl->merged) {
+		h = fl->fb->data;
+		gro_wr16(h + fl->l3_off + 2, fl->len - fl->l3_off);
+		gro_csum(h, fl->l3_off, fl->l4_off, fl->len - fl->l4_off,
+		    fl->sum);
+		fl->fb->gso_size = fl->mss;
+	}
+
+	*fl = g->flow[--g->n_flow];
+}
+
+/*
+ * Creates a coalescing context. Super-frames are built in buffers of
+ * `pool', which should be GRO_SIZE bytes for them to reach 64KB. If an
+ * error occurs, NULL is returned.
+ */
+gro *
+gro_new(struct fbuf_pool *pool)
+{
+	gro	*g;
+
+	if (pool == NULL)
+		return (NULL);
+
+	if ((g = calloc(1, sizeof(*g))) == NULL)
+		return (NULL);
+	g->pool = pool;
+
+	return (g);
+}
+
+void
+gro_free(gro *g)
+{
+	free(g);
+}
+
+/*
+ * Coalesces the consecutive TCP segments of the same flows found in a
+ * burst of frames. Each flow becomes one super-frame, holding its first
+ * segment's headers and its MSS in `gso_size', and taking the slot of the
+ * first segment, so the order of the flows is kept. The frames left are
+ * compacted at the front of the array and their count is returned, the
+ * merged segments are released. Nothing is held across bursts.
+ */
+uint32_t
+gro_burst(gro *g, struct fbuf **fb, const uint32_t n)
+{
+	struct gro_flow	*fl;
+	struct gro_seg	 s;
+	uint32_t	 i, kept = 0;
+	uint8_t		 flags;
+	int		 ret;
+
+	g->n_flow = 0;
+
+	for (i = 0; i < n; i++) {
+		ret = gro_seg(&s, fb[i], &flags, 1);
+		fl = ret < 0 ? NULL :
+		    gro_find(g, s.h, s.l3_off, s.l4_off, s.hash);
+
+		if (fl && ret == 1 && gro_merge(g, fl, &s, fb) == 0) {
+			fbuf_unref(fb[i]);
+			continue;
+		}
+
+		/* anything else of the flow goes after what was merged */
+		if (fl)
+			gro_flush(g, fl);
+
+		fb[kept] = fb[i];
+		if (ret == 1) {
+			if (g->n_flow == GRO_FLOWS)
+				gro_flush(g, &g->flow[0]);
+			fl = &g->flow[g->n_flow++];
+			fl->fb = fb[kept];
+			fl->slot = kept;
+			fl->hash = s.hash;
+			fl->l3_off = s.l3_off;
+			fl->l4_off = s.l4_off;
+			fl->hlen = s.hlen;
+			fl->mss = s.plen;
+			fl->len = s.hlen + s.plen;
+			fl->next_seq = gro_rd32(s.h + s.l4_off + 4) + s.plen;
+			fl->sum = s.psum;
+			fl->merged = 0;
+			fl->open = !(flags & TH_PUSH);
+		}
+		kept++;
+	}
+
+	while (g->n_flow)
+		gro_flush(g, &g->flow[0]);
+
+	return (kept);
+}
+
+/*
+ * Splits a super-frame back into segments of `gso_size' bytes of payload,
+ * taken from `pool', or the heap if it is NULL. The IP identifiers,
+ * sequence numbers and checksums are rewritten, FIN and PSH are only kept
+ * on the last segment and CWR on the first. Frames that aren't
+ * super-frames are passed as is. The reference on `fb' is consumed and
+ * the number of segments is returned. If more than `max' segments are
+ * needed or an error occurs, -1 is returned and `fb' is left untouched.
+ */
+int32_t
+gso(struct fbuf *fb, struct fbuf_pool *pool, struct fbuf **seg,
+    const uint32_t max)
+{
+	struct gro_seg	 s;
+	struct fbuf	*sfb;
+	uint8_t		*p, *ip, *th, flags;
+	uint32_t	 n, k, off, len, seq, id, psum;
+
+	if (max == 0)
+		return (-1);
+
+	if (fb->gso_size == 0 || gro_seg(&s, fb, &flags, 0) != 1 ||
+	    s.plen <= fb->gso_size) {
+		fb->gso_size = 0;
+		seg[0] = fb;
+		return (1);
+	}
+
+	n = (s.plen + fb->gso_size - 1) / fb->gso_size;
+	if (n > max)
+		return (-1);
+
+	seq = gro_rd32(s.h + s.l4_off + 4);
+	id = gro_rd16(s.h + s.l3_off + 4);
+
+	for (k = 0, off = 0; k < n; k++, off += len) {
+		len = s.plen - off < fb->gso_size ? s.plen - off : fb->gso_size;
+		if ((seg[k] = sfb = fbuf_alloc(pool)) == NULL ||
+		    (p = fbuf_append(sfb, s.hlen + len)) == NULL)
+			goto error;
+
+		memcpy(p, s.h, s.hlen);
+		memcpy(p + s.hlen, s.h + s.hlen + off, len);
+		ip = p + s.l3_off;
+		th = p + s.l4_off;
+
+		gro_wr16(ip + 2, s.hlen - s.l3_off + len);
+		gro_wr16(ip + 4, id + k);
+		gro_wr32(th + 4, seq + off);
+		if (k + 1 < n)
+			th[13] &= ~(TH_FIN | TH_PUSH);
+		if (k > 0)
+			th[13] &= ~TH_CWR;
+
+		psum = gro_add(gro_sum(p + s.hlen, len), 0);
+		gro_csum(p, s.l3_off, s.l4_off, s.hlen - s.l4_off + len, psum);
+	}
+
+	fbuf_unref(fb);
+	return (n);
+
+error:
+	fbuf_unref(seg[k]);
+	while (k-- > 0)
+		fbuf_unref(seg[k]);
+	return (-1);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef GRO_H
+#define GRO_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+#include "inet.h"
+
+#define GRO_FLOWS	16	/* flows coalesced at once within a burst */
+
+/* size of the pool buffers super-frames are built in */
+#define GRO_SIZE	(FBUF_HEADROOM + ETHER_HDR_LEN + 8 + 65535)
+
+typedef struct gro gro;
+
+gro		*gro_new(struct fbuf_pool *);
+void		 gro_free(gro *);
+uint32_t	 gro_burst(gro *, struct fbuf **, const uint32_t);
+int32_t		 gso(struct fbuf *, struct fbuf_pool *, struct fbuf **, const uint32_t);
+
+#endif
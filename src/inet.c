@@ -29,11 +29,13 @@
 #endif
 #include <netinet/if_ether.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #if defined(OPENBSD)
 #include <ifaddrs.h>
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -84,32 +86,713 @@ inet_macaddr_src(void *frame, uint8_t *macaddr)
 	memcpy(macaddr, eth_hdr->ether_shost, ETHER_ADDR_LEN);
 }
 
+/*
+ * Packs a MAC address in the low 48 bits of an integer, in network order,
+ * so that it can be compared and hashed in a single operation.
+ */
+uint64_t
+inet_macaddr_u64(const uint8_t *macaddr)
+{
+	return ((uint64_t)macaddr[0] << 40 | (uint64_t)macaddr[1] << 32 |
+	    (uint64_t)macaddr[2] << 24 | (uint64_t)macaddr[3] << 16 |
+	    (uint64_t)macaddr[4] << 8 | (uint64_t)macaddr[5]);
+}
+
+/*
+ * Hashes a packed MAC address. The vendor prefix is often shared by every
+ * host of a network, so all the bits are mixed in.
+ */
+uint32_t
+inet_macaddr_hash(uint64_t macaddr)
+{
+	macaddr ^= macaddr >> 33;
+	macaddr *= 0xff51afd7ed558ccdULL;
+	macaddr ^= macaddr >> 33;
+
+	return ((uint32_t)macaddr);
+}
+
+static uint16_t
+inet_rd16(const uint8_t *p)
+{
+	return ((uint16_t)p[0] << 8 | p[1]);
+}
+
+/*
+ * Parses the L2, L3 and L4 headers of a frame into a descriptor. Up to two
+ * VLAN tags are skipped, IPv6 extension headers are followed up to the
+ * transport header, and the ports of non-first fragments are left to zero.
+ * A truncated L3 or L4 header stops the parsing without error. If the
+ * frame doesn't hold an ethernet header, -1 is returned.
+ */
+int
+inet_parse(struct inet_frame *f, const void *frame, uint32_t len)
+{
+	const uint8_t	*p = frame;
+	uint32_t	 off, hlen;
+	uint8_t		 nxt;
+	int		 i;
+
+	memset(f, 0, sizeof(*f));
+	f->data = p;
+	f->len = len;
+
+	if (len < ETHER_HDR_LEN)
+		return (-1);
+
+	f->addr_type = inet_macaddr_type((uint8_t *)p);
+	f->ethertype = inet_rd16(p + 12);
+	off = ETHER_HDR_LEN;
+
+	for (i = 0; i < 2 && (f->ethertype == 0x8100 ||
+	    f->ethertype == 0x88a8); i++) {
+		if (len < off + 4)
+			return (0);
+		if (i == 0)
+			f->vlan = inet_rd16(p + off) & 0x0fff;
+		f->ethertype = inet_rd16(p + off + 2);
+		off += 4;
+	}
+	f->l3_off = off;
+
+	switch (f->ethertype) {
+	case ETHERTYPE_IP:
+		if (len < off + 20 || (p[off] >> 4) != 4)
+			return (0);
+		hlen = (p[off] & 0x0f) * 4;
+		if (hlen < 20 || len < off + hlen)
+			return (0);
+		f->ip_ver = 4;
+		f->ip_proto = p[off + 9];
+		f->src.v4 = (uint32_t)inet_rd16(p + off + 12) << 16 |
+		    inet_rd16(p + off + 14);
+		f->dst.v4 = (uint32_t)inet_rd16(p + off + 16) << 16 |
+		    inet_rd16(p + off + 18);
+		/* only the first fragment carries the transport header */
+		if (inet_rd16(p + off + 6) & 0x1fff)
+			return (0);
+		off += hlen;
+		break;
+	case ETHERTYPE_IPV6:
+		if (len < off + 40 || (p[off] >> 4) != 6)
+			return (0);
+		f->ip_ver = 6;
+		memcpy(f->src.v6, p + off + 8, 16);
+		memcpy(f->dst.v6, p + off + 24, 16);
+		nxt = p[off + 6];
+		off += 40;
+		for (;;) {
+			if (nxt == IPPROTO_HOPOPTS || nxt == IPPROTO_ROUTING ||
+			    nxt == IPPROTO_DSTOPTS) {
+				if (len < off + 8)
+					return (0);
+				nxt = p[off];
+				off += (p[off + 1] + 1) * 8;
+			} else if (nxt == IPPROTO_FRAGMENT) {
+				if (len < off + 8)
+					return (0);
+				f->ip_proto = p[off];
+				if (inet_rd16(p + off + 2) & 0xfff8)
+					return (0);
+				nxt = p[off];
+				off += 8;
+			} else
+				break;
+		}
+		f->ip_proto = nxt;
+		break;
+	default:
+		return (0);
+	}
+
+	switch (f->ip_proto) {
+	case IPPROTO_TCP:
+		if (len < off + 20)
+			return (0);
+		f->tcp_flags = p[off + 13];
+		/* FALLTHROUGH */
+	case IPPROTO_UDP:
+		if (len < off + 8)
+			return (0);
+		f->sport = inet_rd16(p + off);
+		f->dport = inet_rd16(p + off + 2);
+		f->l4_off = off;
+		break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		if (len < off + 4)
+			return (0);
+		f->l4_off = off;
+		break;
+	}
+
+	return (0);
+}
+
+/*
+ * Hashes the flow a parsed frame belongs to. The hash is symmetric, both
+ * directions of a conversation land on the same value. Non-IP frames are
+ * hashed on their MAC addresses and ethertype.
+ */
+uint32_t
+inet_flow_hash(const struct inet_frame *f)
+{
+	uint64_t	a, b, h, w[4];
+
+	switch (f->ip_ver) {
+	case 4:
+		a = f->src.v4;
+		b = f->dst.v4;
+		break;
+	case 6:
+		memcpy(&w[0], f->src.v6, 16);
+		memcpy(&w[2], f->dst.v6, 16);
+		a = w[0] ^ w[1];
+		b = w[2] ^ w[3];
+		break;
+	default:
+		a = inet_macaddr_u64(f->data + ETHER_ADDR_LEN);
+		b = inet_macaddr_u64(f->data);
+		break;
+	}
+
+	a = a << 16 | f->sport;
+	b = b << 16 | f->dport;
+	h = (a ^ b) + (a < b ? a : b) * 0x9e3779b97f4a7c15ULL;
+	h ^= (uint64_t)f->ip_proto << 56 | (uint64_t)f->ethertype << 32 | f->vlan;
+
+	return (inet_macaddr_hash(h));
+}
+
+/*
+ * Cuckoo filter of MAC addresses. Each bucket holds 4 fingerprints of 16
+ * bits in a single word, 0 marks a free slot. An address lives in one of
+ * two buckets, the second one is derived from the first and the
+ * fingerprint, so that a fingerprint can be moved without knowing its
+ * address. A fingerprint that can't be placed after MACF_KICKS moves is
+ * kept aside as the victim, and the filter is full until it's placed.
+ */
+#define MACF_SLOTS	4
+#define MACF_LOAD	96	/* percent of the slots */
+#define MACF_SPARE	64	/* slots */
+#define MACF_KICKS	2000
+#define MACF_LO		0x0001000100010001ULL
+#define MACF_HI		0x8000800080008000ULL
+
+struct inet_macaddr_filter {
+	uint64_t	*bucket;
+	uint32_t	 mask;
+	uint32_t	 count;
+	uint32_t	 kick;
+	uint32_t	 victim_idx;
+	uint16_t	 victim_fp;	/* 0 if none */
+};
+
+static uint64_t
+inet_macf_mix(uint64_t macaddr)
+{
+	macaddr ^= macaddr >> 33;
+	macaddr *= 0xff51afd7ed558ccdULL;
+	macaddr ^= macaddr >> 33;
+	macaddr *= 0xc4ceb9fe1a85ec53ULL;
+	macaddr ^= macaddr >> 33;
+
+	return (macaddr);
+}
+
+static uint16_t
+inet_macf_fp(uint64_t h)
+{
+	return ((h >> 48) != 0 ? h >> 48 : 1);
+}
+
+static uint32_t
+inet_macf_alt(const inet_macaddr_filter *f, uint32_t idx, uint16_t fp)
+{
+	return ((idx ^ (fp * 0x5bd1e995U)) & f->mask);
+}
+
+/* Tells whether one of the 4 fingerprints of a bucket is `fp'. */
+static int
+inet_macf_match(uint64_t bucket, uint16_t fp)
+{
+	uint64_t	x = bucket ^ (fp * MACF_LO);
+
+	return (((x - MACF_LO) & ~x & MACF_HI) != 0);
+}
+
+static int
+inet_macf_put(inet_macaddr_filter *f, uint32_t idx, uint16_t fp)
+{
+	uint64_t	b = f->bucket[idx];
+	int		i;
+
+	for (i = 0; i < MACF_SLOTS; i++)
+		if (((b >> (i * 16)) & 0xffff) == 0) {
+			f->bucket[idx] = b | (uint64_t)fp << (i * 16);
+			return (0);
+		}
+
+	return (-1);
+}
+
+/*
+ * Creates a filter for up to `max' addresses. The buckets are loaded up to
+ * MACF_LOAD percent, a few spare slots aside for the small filters, and
+ * their number is rounded up to a power of two, which costs 2 to 4 bytes
+ * per address: a million addresses take 2MB. If an error occurs, NULL is
+ * returned.
+ */
+inet_macaddr_filter *
+inet_macaddr_filter_new(const uint32_t max)
+{
+	inet_macaddr_filter	*f;
+	uint32_t		 n;
+
+	for (n = 2; (uint64_t)n * MACF_SLOTS * MACF_LOAD / 100 <
+	    (uint64_t)max + MACF_SPARE; n <<= 1)
+		;
+
+	if ((f = calloc(1, sizeof(*f))) == NULL)
+		return (NULL);
+	if ((f->bucket = calloc(n, sizeof(*f->bucket))) == NULL) {
+		free(f);
+		return (NULL);
+	}
+	f->mask = n - 1;
+
+	return (f);
+}
+
 void
-inet_print_addr(void *frame)
+inet_macaddr_filter_free(inet_macaddr_filter *f)
 {
-	struct ether_header	*eth_hdr = frame;
+	if (f == NULL)
+		return;
+
+	free(f->bucket);
+	free(f);
+}
+
+/*
+ * Adds a packed MAC address to the filter. An address must be added only
+ * once. If the filter is full, -1 is returned.
+ */
+int
+inet_macaddr_filter_add(inet_macaddr_filter *f, uint64_t macaddr)
+{
+	uint64_t	h, b;
+	uint32_t	idx, k, slot;
+	uint16_t	fp, out;
+
+	if (f->victim_fp != 0)
+		return (-1);
+
+	h = inet_macf_mix(macaddr);
+	fp = inet_macf_fp(h);
+	idx = (uint32_t)h & f->mask;
 
-	printf("maddr_dst: %02x:%02x:%02x:%02x:%02x:%02x\n", eth_hdr->ether_dhost[0],
-		eth_hdr->ether_dhost[1], eth_hdr->ether_dhost[2], eth_hdr->ether_dhost[3],
-		eth_hdr->ether_dhost[4], eth_hdr->ether_dhost[5]);
+	if (inet_macf_put(f, idx, fp) == 0 ||
+	    inet_macf_put(f, (idx = inet_macf_alt(f, idx, fp)), fp) == 0) {
+		f->count++;
+		return (0);
+	}
 
-	printf("macaddr_src: %02x:%02x:%02x:%02x:%02x:%02x\n", eth_hdr->ether_shost[0],
-		eth_hdr->ether_shost[1], eth_hdr->ether_shost[2], eth_hdr->ether_shost[3],
-		eth_hdr->ether_shost[4], eth_hdr->ether_shost[5]);
+	/* move a fingerprint to its other bucket to make room */
+	for (k = 0; k < MACF_KICKS; k++) {
+		slot = (f->kick++ % MACF_SLOTS) * 16;
+		b = f->bucket[idx];
+		out = b >> slot;
+		f->bucket[idx] = (b & ~(0xffffULL << slot)) | (uint64_t)fp << slot;
+		fp = out;
+		idx = inet_macf_alt(f, idx, fp);
+		if (inet_macf_put(f, idx, fp) == 0) {
+			f->count++;
+			return (0);
+		}
+	}
 
-	printf("type: %x\n", htons(eth_hdr->ether_type));
+	f->victim_idx = idx;
+	f->victim_fp = fp;
+	f->count++;
+
+	return (0);
+}
+
+/*
+ * Removes a packed MAC address that was added to the filter. If it isn't
+ * found, -1 is returned.
+ */
+int
+inet_macaddr_filter_del(inet_macaddr_filter *f, uint64_t macaddr)
+{
+	uint64_t	h;
+	uint32_t	idx[2];
+	uint16_t	fp, vfp;
+	int		i, j;
+
+	h = inet_macf_mix(macaddr);
+	fp = inet_macf_fp(h);
+	idx[0] = (uint32_t)h & f->mask;
+	idx[1] = inet_macf_alt(f, idx[0], fp);
+
+	if (f->victim_fp == fp &&
+	    (f->victim_idx == idx[0] || f->victim_idx == idx[1])) {
+		f->victim_fp = 0;
+		f->count--;
+		return (0);
+	}
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < MACF_SLOTS; j++)
+			if (((f->bucket[idx[i]] >> (j * 16)) & 0xffff) == fp)
+				goto found;
+
+	return (-1);
+
+found:
+	f->bucket[idx[i]] &= ~(0xffffULL << (j * 16));
+	f->count--;
+
+	/* the victim may fit now */
+	if ((vfp = f->victim_fp) != 0 &&
+	    (inet_macf_put(f, f->victim_idx, vfp) == 0 ||
+	    inet_macf_put(f, inet_macf_alt(f, f->victim_idx, vfp), vfp) == 0))
+		f->victim_fp = 0;
+
+	return (0);
+}
+
+/*
+ * Tells whether a packed MAC address may be in the filter. An address that
+ * was added is always found, one that wasn't is found with a probability
+ * of about 1 in 8000.
+ */
+int
+inet_macaddr_filter_has(const inet_macaddr_filter *f, uint64_t macaddr)
+{
+	uint64_t	h;
+	uint32_t	idx, alt;
+	uint16_t	fp;
+
+	h = inet_macf_mix(macaddr);
+	fp = inet_macf_fp(h);
+	idx = (uint32_t)h & f->mask;
+	alt = inet_macf_alt(f, idx, fp);
+
+	return (inet_macf_match(f->bucket[idx], fp) ||
+	    inet_macf_match(f->bucket[alt], fp) ||
+	    (f->victim_fp == fp && (f->victim_idx == idx ||
+	    f->victim_idx == alt)));
+}
+
+/*
+ * Tests `n' packed MAC addresses at once, `hit' is set for the addresses
+ * that may be in the filter. The buckets of a group of addresses are
+ * prefetched before any of them is tested so that their cache misses
+ * overlap. Returns the number of hits.
+ */
+uint32_t
+inet_macaddr_filter_burst(const inet_macaddr_filter *f,
+    const uint64_t *macaddr, uint8_t *hit, const uint32_t n)
+{
+	uint64_t	h;
+	uint32_t	i, j, k, hits = 0;
+	uint32_t	idx[16], alt[16];
+	uint16_t	fp[16];
+
+	for (i = 0; i < n; i += k) {
+		k = n - i < 16 ? n - i : 16;
+
+		for (j = 0; j < k; j++) {
+			h = inet_macf_mix(macaddr[i + j]);
+			fp[j] = inet_macf_fp(h);
+			idx[j] = (uint32_t)h & f->mask;
+			alt[j] = inet_macf_alt(f, idx[j], fp[j]);
+			__builtin_prefetch(&f->bucket[idx[j]]);
+			__builtin_prefetch(&f->bucket[alt[j]]);
+		}
+
+		for (j = 0; j < k; j++) {
+			hit[i + j] = inet_macf_match(f->bucket[idx[j]], fp[j]) |
+			    inet_macf_match(f->bucket[alt[j]], fp[j]) |
+			    (f->victim_fp == fp[j] &&
+			    (f->victim_idx == idx[j] || f->victim_idx == alt[j]));
+			hits += hit[i + j];
+		}
+	}
+
+	return (hits);
+}
+
+/* Returns the number of addresses in the filter. */
+uint32_t
+inet_macaddr_filter_count(const inet_macaddr_filter *f)
+{
+	return (f->count);
+}
+
+/* two hex digits per byte value */
+static const char	inet_hex[] =
+	"000102030405060708090a0b0c0d0e0f"
+	"101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f"
+	"303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f"
+	"505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f"
+	"707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f"
+	"909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+	"b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+	"d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+	"f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static char *
+inet_fmt_hex8(char *p, uint8_t v)
+{
+	memcpy(p, inet_hex + v * 2, 2);
+	return (p + 2);
+}
+
+static char *
+inet_fmt_u32(char *p, uint32_t v)
+{
+	char	tmp[10];
+	int	n = 0;
+
+	do
+		tmp[n++] = '0' + v % 10;
+	while ((v /= 10) != 0);
+	while (n > 0)
+		*p++ = tmp[--n];
+
+	return (p);
+}
+
+static char *
+inet_fmt_str(char *p, const char *s)
+{
+	size_t	len = strlen(s);
+
+	memcpy(p, s, len);
+	return (p + len);
+}
+
+static char *
+inet_fmt_v4(char *p, uint32_t ip)
+{
+	p = inet_fmt_u32(p, ip >> 24);
+	*p++ = '.';
+	p = inet_fmt_u32(p, (ip >> 16) & 0xff);
+	*p++ = '.';
+	p = inet_fmt_u32(p, (ip >> 8) & 0xff);
+	*p++ = '.';
+	return (inet_fmt_u32(p, ip & 0xff));
+}
+
+/* The longest run of zero groups is shortened to "::", as in RFC 5952. */
+static char *
+inet_fmt_v6(char *p, const uint8_t *ip)
+{
+	uint16_t	g[8];
+	int		i, run, best = -1, best_len = 1;
+
+	for (i = 0; i < 8; i++)
+		g[i] = inet_rd16(ip + i * 2);
+
+	for (i = 0; i < 8; i += run ? run : 1) {
+		for (run = 0; i + run < 8 && g[i + run] == 0; run++)
+			;
+		if (run > best_len) {
+			best = i;
+			best_len = run;
+		}
+	}
+
+	for (i = 0; i < 8; i++) {
+		if (i == best) {
+			*p++ = ':';
+			if (i == 0)
+				*p++ = ':';
+			i += best_len - 1;
+			continue;
+		}
+		if (g[i] >= 0x1000)
+			*p++ = inet_hex[(g[i] >> 12) * 2 + 1];
+		if (g[i] >= 0x100)
+			*p++ = inet_hex[((g[i] >> 8) & 0xf) * 2 + 1];
+		if (g[i] >= 0x10)
+			*p++ = inet_hex[((g[i] >> 4) & 0xf) * 2 + 1];
+		*p++ = inet_hex[(g[i] & 0xf) * 2 + 1];
+		if (i < 7)
+			*p++ = ':';
+	}
+
+	return (p);
+}
+
+static int
+inet_hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+
+	return (-1);
+}
+
+/*
+ * Formats a MAC address as "xx:xx:xx:xx:xx:xx" in `buf', which holds at
+ * least INET_MACADDR_STRLEN bytes. Returns `buf'.
+ */
+char *
+inet_macaddr_fmt(const uint8_t *macaddr, char *buf)
+{
+	char	*p = buf;
+	int	 i;
+
+	for (i = 0; i < ETHER_ADDR_LEN; i++) {
+		p = inet_fmt_hex8(p, macaddr[i]);
+		*p++ = ':';
+	}
+	p[-1] = '\0';
+
+	return (buf);
+}
+
+/*
+ * Parses a MAC address written as 6 pairs of hex digits separated by ':'
+ * or '-'. If the string isn't a MAC address, -1 is returned.
+ */
+int
+inet_macaddr_parse(const char *str, uint8_t *macaddr)
+{
+	uint8_t	tmp[ETHER_ADDR_LEN];
+	int	i, hi, lo;
+	char	sep;
+
+	for (i = 0; i < ETHER_ADDR_LEN; i++, str += 3) {
+		if ((hi = inet_hexval(str[0])) == -1 ||
+		    (lo = inet_hexval(str[1])) == -1)
+			return (-1);
+		tmp[i] = hi << 4 | lo;
+
+		if (i == 0 && (sep = str[2]) != ':' && sep != '-')
+			return (-1);
+		if (str[2] != (i < ETHER_ADDR_LEN - 1 ? sep : '\0'))
+			return (-1);
+	}
+	memcpy(macaddr, tmp, ETHER_ADDR_LEN);
+
+	return (0);
+}
+
+/*
+ * Formats a one line summary of a parsed frame in `buf', which holds at
+ * least INET_FRAME_STRLEN bytes, without allocating nor calling stdio:
+ *
+ *	02:00:00:00:00:01 > 02:00:00:00:00:02 vlan 10 ipv4
+ *	    10.0.0.1.40000 > 10.0.0.2.80 tcp [S.] len 74
+ *
+ * Returns `buf'.
+ */
+char *
+inet_frame_fmt(const struct inet_frame *f, char *buf)
+{
+	static const char	 tcp_flags[] = "FSRP.UEW";
+	char			*p = buf;
+	int			 i, ports;
+
+	inet_macaddr_fmt(f->data + ETHER_ADDR_LEN, p);
+	p = inet_fmt_str(p + 17, " > ");
+	inet_macaddr_fmt(f->data, p);
+	p += 17;
+
+	if (f->vlan != 0) {
+		p = inet_fmt_str(p, " vlan ");
+		p = inet_fmt_u32(p, f->vlan);
+	}
+
+	if (f->ip_ver == 0) {
+		p = inet_fmt_str(p, " ethertype 0x");
+		p = inet_fmt_hex8(p, f->ethertype >> 8);
+		p = inet_fmt_hex8(p, f->ethertype & 0xff);
+		goto len;
+	}
+
+	ports = f->l4_off != 0 &&
+	    (f->ip_proto == IPPROTO_TCP || f->ip_proto == IPPROTO_UDP);
+	p = inet_fmt_str(p, f->ip_ver == 4 ? " ipv4 " : " ipv6 ");
+	p = f->ip_ver == 4 ? inet_fmt_v4(p, f->src.v4) : inet_fmt_v6(p, f->src.v6);
+	if (ports) {
+		*p++ = '.';
+		p = inet_fmt_u32(p, f->sport);
+	}
+	p = inet_fmt_str(p, " > ");
+	p = f->ip_ver == 4 ? inet_fmt_v4(p, f->dst.v4) : inet_fmt_v6(p, f->dst.v6);
+	if (ports) {
+		*p++ = '.';
+		p = inet_fmt_u32(p, f->dport);
+	}
+
+	switch (f->ip_proto) {
+	case IPPROTO_TCP:
+		p = inet_fmt_str(p, " tcp");
+		if (f->l4_off == 0)
+			break;
+		p = inet_fmt_str(p, " [");
+		for (i = 0; i < 8; i++)
+			if (f->tcp_flags & 1 << i)
+				*p++ = tcp_flags[i];
+		*p++ = ']';
+		break;
+	case IPPROTO_UDP:
+		p = inet_fmt_str(p, " udp");
+		break;
+	case IPPROTO_ICMP:
+		p = inet_fmt_str(p, " icmp");
+		break;
+	case IPPROTO_ICMPV6:
+		p = inet_fmt_str(p, " icmp6");
+		break;
+	default:
+		p = inet_fmt_str(p, " proto ");
+		p = inet_fmt_u32(p, f->ip_proto);
+		break;
+	}
+
+len:
+	p = inet_fmt_str(p, " len ");
+	p = inet_fmt_u32(p, f->len);
+	*p = '\0';
+
+	return (buf);
+}
+
+void
+inet_print_addr(void *frame)
+{
+	char	dst[INET_MACADDR_STRLEN], src[INET_MACADDR_STRLEN];
+
+	printf("maddr_dst: %s\nmacaddr_src: %s\ntype: %x\n",
+	    inet_macaddr_fmt(frame, dst),
+	    inet_macaddr_fmt((uint8_t *)frame + ETHER_ADDR_LEN, src),
+	    inet_ethertype(frame));
 }
 
 void
 inet_print_macaddr(uint8_t *macaddr)
 {
-	printf("maddr: %02x:%02x:%02x:%02x:%02x:%02x\n",
-	macaddr[0],
-	macaddr[1],
-	macaddr[2],
-	macaddr[3],
-	macaddr[4],
-	macaddr[5]);
+	char	str[INET_MACADDR_STRLEN];
+
+	printf("maddr: %s\n", inet_macaddr_fmt(macaddr, str));
 }
 
 #endif
@@ -16,19 +16,72 @@
 #ifndef INET_H
 #define INET_H
 
+#include <stdint.h>
+
 #ifndef ETHER_ADDR_LEN
 #define ETHER_ADDR_LEN 6
 #endif
 
+#ifndef ETHER_HDR_LEN
+#define ETHER_HDR_LEN 14
+#endif
+
 #define ADDR_UNICAST	0x1
 #define ADDR_BROADCAST	0x2
 #define ADDR_MULTICAST	0x4
 #define ETHERTYPE_PING	0x9000
 
+#define INET_MACADDR_STRLEN	18
+#define INET_FRAME_STRLEN	192
+
+/*
+ * Descriptor of a parsed frame. Offsets are relative to the start of the
+ * frame, IPv4 addresses and ports are in host order, IPv6 addresses are
+ * kept as they are on the wire. Fields of a layer that isn't present are
+ * left to zero.
+ */
+struct inet_frame {
+	const uint8_t	*data;
+	uint32_t	 len;
+	uint16_t	 ethertype;	/* after the VLAN tags */
+	uint16_t	 vlan;		/* outer VLAN id, 0 if untagged */
+	uint8_t		 addr_type;	/* ADDR_* of the destination */
+	uint8_t		 ip_ver;	/* 4, 6 or 0 */
+	uint8_t		 ip_proto;
+	uint8_t		 tcp_flags;
+	uint16_t	 l3_off;
+	uint16_t	 l4_off;	/* 0 if no transport header */
+	uint16_t	 sport;
+	uint16_t	 dport;
+	union {
+		uint32_t	v4;
+		uint8_t		v6[16];
+	}		 src, dst;
+};
+
 uint16_t	inet_ethertype(void *);
 int		inet_macaddr_type(uint8_t *);
 void		inet_macaddr_dst(void *, uint8_t *);
 void		inet_macaddr_src(void *, uint8_t *);
 void		inet_print_addr(void *);
+void		inet_print_macaddr(uint8_t *);
+char		*inet_macaddr_fmt(const uint8_t *, char *);
+int		inet_macaddr_parse(const char *, uint8_t *);
+uint64_t	inet_macaddr_u64(const uint8_t *);
+uint32_t	inet_macaddr_hash(uint64_t);
+int		inet_parse(struct inet_frame *, const void *, uint32_t);
+uint32_t	inet_flow_hash(const struct inet_frame *);
+char		*inet_frame_fmt(const struct inet_frame *, char *);
+
+typedef struct inet_macaddr_filter inet_macaddr_filter;
+
+inet_macaddr_filter	*inet_macaddr_filter_new(const uint32_t);
+void			 inet_macaddr_filter_free(inet_macaddr_filter *);
+int			 inet_macaddr_filter_add(inet_macaddr_filter *, uint64_t);
+int			 inet_macaddr_filter_del(inet_macaddr_filter *, uint64_t);
+int			 inet_macaddr_filter_has(const inet_macaddr_filter *, uint64_t);
+uint32_t		 inet_macaddr_filter_burst(const inet_macaddr_filter *,
+			    const uint64_t *, uint8_t *, const uint32_t);
+uint32_t		 inet_macaddr_filter_count(const inet_macaddr_filter *);
 
 #endif
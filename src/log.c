@@ -1,17 +1,302 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "log.h"
+#include "logrec.h"
+
+#undef log_debug
+#undef log_info
+#undef log_warnx
+#undef log_warn
+
+#define LOG_LINE_MAX	512
+#define LOG_BATCH	64
+#define LOG_IDLE_NS	1000000		/* writer polling period */
+#define LOG_IDLE_POLLS	10		/* before it sleeps until woken up */
+#define LOG_CACHELINE	64
+#define LOG_TIME_LEN	32
+#define LOG_SINK_IOV	64		/* records buffered per stream */
+#define LOG_SINK_SIZE	(LOG_SINK_IOV * 128)
+#define LOG_FR_MAGIC	"NVLOGFR1"
+#define LOG_FR_ENTRY	256		/* bytes per flight recorder entry */
+
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE	CLOCK_REALTIME
+#endif
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE	CLOCK_MONOTONIC
+#endif
+
+/*
+ * A record of the asynchronous ring. The slot of position `p' is free for
+ * the producer when `seq' is p, and ready for the consumer when it's
+ * p + 1.
+ */
+struct log_slot {
+	uint32_t	seq;
+	uint8_t		lvl;
+	uint8_t		deferred;	/* `line' holds a log_rec */
+	uint8_t		kv;		/* of log_kv(), never coalesced */
+	char		line[LOG_LINE_MAX] __attribute__((aligned(8)));
+};
+
+/*
+ * A record whose formatting is left to the writer thread: the format, the
+ * context of the call and the arguments recorded by logrec_encode().
+ */
+struct log_rec {
+	const char	*format;
+	struct timespec	 ts;
+	uint32_t	 tid;
+	int		 err;
+	uint32_t	 len;
+	uint8_t		 args[];
+};
+
+/*
+ * Bounded queue of records from any thread to the writer thread. Slots
+ * are claimed with a CAS on `tail', and released with a CAS on `head' by
+ * the writer, or by a producer dropping the oldest record.
+ */
+struct log_ring {
+	uint32_t	 tail __attribute__((aligned(LOG_CACHELINE)));
+	uint32_t	 head __attribute__((aligned(LOG_CACHELINE)));
+	uint32_t	 mask __attribute__((aligned(LOG_CACHELINE)));
+	int		 policy;
+	int		 stop;
+	int		 sleeping;
+	pthread_t	 thread;
+	pthread_mutex_t	 lock;
+	pthread_cond_t	 cond;
+	uint32_t	 done;		/* head of the written records */
+	struct log_slot	*slot;
+};
+
+/*
+ * The records buffered for stdout or stderr, written with a single
+ * writev() according to the flush policy.
+ */
+struct log_sink {
+	pthread_mutex_t	 lock;
+	int		 fd;
+	FILE		*stdio;		/* flushed before the first write */
+	int		 iovcnt;
+	size_t		 len;
+	uint64_t	 first;		/* when the oldest record came, in ns */
+	struct iovec	 iov[LOG_SINK_IOV];
+	char		 buf[LOG_SINK_SIZE];
+};
 
 static void	(*cb_log)(const char *) = NULL;
 
-static uint8_t	log_lvl_debug;
-static uint8_t	log_lvl_info;
-static uint8_t	log_lvl_warn;
+static uint8_t	log_time_flags;
+static uint8_t	log_deferred;
+static uint8_t	log_kv_fmt;
+
+static const char	*log_lvl_names[] = { NULL, "debug", "info", "warn" };
+
+static struct log_ring	*log_ring;
+static struct log_stats	 log_counters;
+
+/*
+ * The callers holding the ring, which log_async_stop() waits for before
+ * freeing it.
+ */
+static uint32_t		 log_ring_users __attribute__((aligned(LOG_CACHELINE)));
+
+static struct log_sink	 log_sink_out = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = STDOUT_FILENO
+};
+static struct log_sink	 log_sink_err = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = STDERR_FILENO
+};
+static pthread_once_t	 log_sink_once = PTHREAD_ONCE_INIT;
+
+/*
+ * The flight recorder is a file mapped in memory, which outlives a crash of
+ * the process: a header of LOG_FR_ENTRY bytes followed by `count' entries.
+ * An entry holds the format of its record and its arguments encoded by
+ * logrec_encode(), or its text when they can't be.
+ */
+struct log_fr_hdr {
+	char		magic[8];
+	uint32_t	size;		/* of an entry */
+	uint32_t	count;		/* of entries, a power of two */
+	uint64_t	pos __attribute__((aligned(LOG_CACHELINE)));
+};
+
+struct log_fr_entry {
+	uint64_t	seq;		/* position + 1 once written */
+	uint64_t	ns;		/* realtime */
+	uint32_t	tid;
+	int32_t		err;
+	uint8_t		lvl;
+	uint8_t		text;
+	uint16_t	flen;		/* of the format, with its '\0' */
+	uint16_t	alen;		/* of the arguments or the text */
+	uint8_t		data[];
+};
+
+#define LOG_FR_DATA	(LOG_FR_ENTRY - sizeof(struct log_fr_entry))
+
+static struct log_fr_hdr *log_fr;
+static uint8_t		 log_recording;
+
+/* the callers recording, which log_recorder_close() waits for */
+static uint32_t		 log_fr_users __attribute__((aligned(LOG_CACHELINE)));
+
+/* flush policy, without any the records are written right away */
+static uint32_t		 log_flush_records;
+static uint32_t		 log_flush_msec;
+static uint8_t		 log_flush_warn;
+
+/* the thread writing the sinks on time when the logging is synchronous */
+static pthread_mutex_t	 log_flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t		 log_flusher_on;
+
+/* the enabled levels of each category, one bit per level */
+static uint8_t		 log_cat_levels[LOG_CAT_MAX];
+static const char	*log_cat_names[LOG_CAT_MAX] = {
+	"default", "pki", "pm", "inet", "bitv"
+};
+static pthread_mutex_t	 log_sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The log_sites section of every module, the executable and each shared
+ * object, registered by the constructor log.h adds to them.
+ */
+struct log_sites {
+	struct log_site	*start;
+	struct log_site	*stop;
+};
+
+static struct log_sites	 log_modules[LOG_MODULES_MAX];
+static uint32_t		 log_n_modules;
+
+#ifndef __ELF__
+/* without the section, the call sites added as they are first reached */
+static struct log_site	*log_sites_list;
+#endif
+
+/*
+ * The date and time of the last second a thread logged in, so that they
+ * are only formatted again when the second changes.
+ */
+struct log_time {
+	time_t		sec;
+	uint8_t		flags;
+	uint8_t		len;
+	char		str[LOG_TIME_LEN];
+};
+
+/*
+ * The last record written by the writer thread, its repeats are only
+ * counted until another record comes or the writer goes to sleep.
+ */
+struct log_last {
+	uint8_t		lvl;
+	uint32_t	repeats;
+	int		hlen;
+	char		hdr[LOG_LINE_MAX];	/* of the last repeat */
+	char		body[LOG_LINE_MAX];
+};
+
+static struct log_last	 log_last;
+
+/*
+ * The records a thread wrote synchronously, counted without sharing a
+ * cache line with the other threads. log_stats() sums the threads alive,
+ * a thread exiting adds its count to log_counters.
+ */
+struct log_count {
+	uint64_t		 records;
+	struct log_count	*next;
+};
+
+static pthread_mutex_t	 log_counts_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t	 log_counts_once = PTHREAD_ONCE_INIT;
+static pthread_key_t	 log_counts_key;
+static uint8_t		 log_counts_keyed;
+static struct log_count	*log_counts;
+
+/* each thread formats its records on its own */
+static __thread char	 log_buff[LOG_LINE_MAX];
+static __thread struct log_time log_time;
+static __thread uint32_t log_tid;
+static __thread struct log_count log_count;
+static __thread uint8_t	 log_count_on;
+#ifndef SYS_gettid
+static uint32_t		 log_tid_next;
+#endif
+
+static char		*log_fmt_num(char *, uint32_t, int);
+static int		 log_fmt_utc(char *, time_t);
+static void		 log_clock(struct timespec *);
+static int		 log_timestamp(char *, const struct timespec *);
+static uint32_t		 log_thread_id(void);
+static int		 log_header(char *, uint8_t, uint32_t,
+			    const struct timespec *);
+static int		 log_finish(char *, int, int, int);
+static void		 log_note(uint8_t, const char *, ...);
+static void		 log_emit(uint8_t, const char *);
+static uint64_t		 log_now(void);
+static void		 log_sink_put(struct log_sink *, uint8_t, const char *);
+static void		 log_sink_write(struct log_sink *);
+static void		 log_sink_tick(int);
+static void		 log_sink_init(void);
+static void		*log_flusher(void *);
+static int		 log_coalesce(uint8_t, const char *);
+static void		 log_repeats(void);
+static int		 log_format(char *, uint8_t, int, const char *, va_list);
+static int		 log_defer_rec(struct log_slot *, int, const char *,
+			    va_list);
+static void		 log_write(uint8_t, const char *);
+static void		 log_counts_init(void);
+static void		 log_count_add(void);
+static void		 log_count_exit(void *);
+static void		 log_vlog(uint8_t, int, const char *, va_list);
+static int		 log_site_match(struct log_site *, const char *,
+			    size_t, const char *, uint32_t);
+static void		 log_sites_sync(void);
+static void		 log_sites_sync_range(struct log_site *,
+			    struct log_site *);
+static void		 log_record(uint8_t, int, const char *, va_list);
+static int		 log_fr_cmp(const void *, const void *);
+static struct log_slot	*log_ring_put(struct log_ring *);
+static struct log_slot	*log_ring_take(struct log_ring *);
+static void		 log_ring_wake(struct log_ring *);
+static void		 log_ring_publish(struct log_ring *, struct log_slot *);
+static struct log_ring	*log_ring_hold(void);
+static void		 log_users_rele(uint32_t *);
+static void		 log_users_wait(uint32_t *);
+static void		 log_put(uint8_t, const char *, int);
+static void		 log_record_line(uint8_t, const char *, ...);
+static char		*log_kv_str(char *, char *, const char *);
+static char		*log_kv_uint(char *, char *, uint64_t);
+static char		*log_kv_int(char *, char *, int64_t);
+static char		*log_kv_dbl(char *, char *, double);
+static char		*log_kv_field(char *, char *, const char *, const char *,
+			    const struct log_kv *);
+static void		*log_writer(void *);
 
 void
 log_setcb(void (*cb)(const char *))
@@ -19,148 +304,1820 @@ log_setcb(void (*cb)(const char *))
 	cb_log = cb;
 }
 
+/*
+ * Enables or disables a level in every category.
+ */
 void
 log_enable(uint8_t log_lvl, uint8_t onoff)
 {
-	switch (log_lvl) {
-	case LOG_LVL_DEBUG:
-		log_lvl_debug = onoff;
-		break;
-	case LOG_LVL_INFO:
-		log_lvl_info = onoff;
-		break;
-	case LOG_LVL_WARN:
-		log_lvl_warn = onoff;
-		break;
+	uint8_t	 cat;
+
+	if (log_lvl < LOG_LVL_DEBUG || log_lvl > LOG_LVL_WARN)
+		return;
+
+	pthread_mutex_lock(&log_sites_lock);
+	for (cat = 0; cat < LOG_CAT_MAX; cat++) {
+		if (onoff)
+			log_cat_levels[cat] |= 1 << log_lvl;
+		else
+			log_cat_levels[cat] &= ~(1 << log_lvl);
 	}
+	log_sites_sync();
+	pthread_mutex_unlock(&log_sites_lock);
 
 	return;
 }
 
+/*
+ * Names the user-defined category cat, from LOG_CAT_USER up to
+ * LOG_CAT_MAX - 1. The name must stay valid. If an error occurs, -1 is
+ * returned.
+ */
+int
+log_cat_add(uint8_t cat, const char *name)
+{
+	int	 ret = -1;
+
+	if (cat < LOG_CAT_USER || cat >= LOG_CAT_MAX || name == NULL)
+		return (-1);
+
+	pthread_mutex_lock(&log_sites_lock);
+	if (log_cat_names[cat] == NULL && log_cat_lookup(name) == -1) {
+		log_cat_names[cat] = name;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&log_sites_lock);
+
+	return (ret);
+}
+
+/*
+ * Returns the category named name, or -1 if there is none.
+ */
+int
+log_cat_lookup(const char *name)
+{
+	int	 cat;
+
+	for (cat = 0; cat < LOG_CAT_MAX; cat++)
+		if (log_cat_names[cat] != NULL &&
+		    strcmp(log_cat_names[cat], name) == 0)
+			return (cat);
+
+	return (-1);
+}
+
+/*
+ * Enables or disables a level in the category cat only. If an error
+ * occurs, -1 is returned.
+ */
+int
+log_cat_enable(uint8_t cat, uint8_t log_lvl, uint8_t onoff)
+{
+	if (cat >= LOG_CAT_MAX || log_lvl < LOG_LVL_DEBUG ||
+	    log_lvl > LOG_LVL_WARN)
+		return (-1);
+
+	pthread_mutex_lock(&log_sites_lock);
+	if (onoff)
+		log_cat_levels[cat] |= 1 << log_lvl;
+	else
+		log_cat_levels[cat] &= ~(1 << log_lvl);
+	log_sites_sync();
+	pthread_mutex_unlock(&log_sites_lock);
+
+	return (0);
+}
+
+/*
+ * Forces the call sites on (LOG_SITE_ON) or off (LOG_SITE_OFF), or makes
+ * them follow their category again (LOG_SITE_DEFAULT). A site matches when
+ * its path ends with file, it is in the function func and at the line
+ * line; a NULL file or func or a line of 0 matches any. Returns the number
+ * of matching sites. If an error occurs, -1 is returned.
+ */
+int
+log_site_set(const char *file, const char *func, uint32_t line,
+    uint8_t mode)
+{
+	struct log_site	*s;
+	size_t		 flen;
+	uint32_t	 i;
+	int		 n = 0;
+
+	if (mode > LOG_SITE_OFF)
+		return (-1);
+
+	flen = file != NULL ? strlen(file) : 0;
+
+	pthread_mutex_lock(&log_sites_lock);
+	for (i = 0; i < log_n_modules; i++)
+		for (s = log_modules[i].start; s < log_modules[i].stop; s++)
+			if (log_site_match(s, file, flen, func, line)) {
+				s->mode = mode;
+				n++;
+			}
+#ifndef __ELF__
+	for (s = log_sites_list; s != NULL; s = s->next)
+		if (log_site_match(s, file, flen, func, line)) {
+			s->mode = mode;
+			n++;
+		}
+#endif
+	log_sites_sync();
+	pthread_mutex_unlock(&log_sites_lock);
+
+	return (n);
+}
+
+static int
+log_site_match(struct log_site *s, const char *file, size_t flen,
+    const char *func, uint32_t line)
+{
+	size_t	 len;
+
+	if (file != NULL) {
+		len = strlen(s->file);
+		if (len < flen || strcmp(s->file + len - flen, file) != 0 ||
+		    (len > flen && s->file[len - flen - 1] != '/'))
+			return (0);
+	}
+	if (func != NULL && strcmp(s->func, func) != 0)
+		return (0);
+	if (line != 0 && s->line != line)
+		return (0);
+
+	return (1);
+}
+
+/*
+ * Adds the call sites of a module, from `start' to `stop', once. They are
+ * enabled according to the levels set so far. If there are too many
+ * modules, -1 is returned and the sites stay disabled.
+ */
+int
+log_sites_register(struct log_site *start, struct log_site *stop)
+{
+	uint32_t	i;
+	int		ret = 0;
+
+	if (start == NULL || start >= stop)
+		return (0);
+
+	pthread_mutex_lock(&log_sites_lock);
+	for (i = 0; i < log_n_modules; i++)
+		if (log_modules[i].start == start)
+			break;
+	if (i == log_n_modules) {
+		if (log_n_modules == LOG_MODULES_MAX)
+			ret = -1;
+		else {
+			log_modules[log_n_modules].start = start;
+			log_modules[log_n_modules].stop = stop;
+			log_n_modules++;
+			log_sites_sync_range(start, stop);
+		}
+	}
+	pthread_mutex_unlock(&log_sites_lock);
+
+	return (ret);
+}
+
+/* Removes the call sites of a module about to be unloaded. */
 void
-log_debug(const char *format, ...)
+log_sites_unregister(struct log_site *start)
 {
-	struct tm	*tm_info;
-	time_t		 timer;
-	va_list		 list;
-	int		 len;
-	static char	 buff[512];
-	char		 cur_time[20];
+	uint32_t	i;
+
+	pthread_mutex_lock(&log_sites_lock);
+	for (i = 0; i < log_n_modules; i++)
+		if (log_modules[i].start == start) {
+			log_modules[i] = log_modules[--log_n_modules];
+			break;
+		}
+	pthread_mutex_unlock(&log_sites_lock);
+}
+
+#ifndef __ELF__
+/*
+ * Adds a call site reached for the first time to the list, and returns
+ * whether it is enabled.
+ */
+int
+log_site_add(struct log_site *site)
+{
+	uint8_t	 on;
 
-	if (log_lvl_debug == 0)
+	pthread_mutex_lock(&log_sites_lock);
+	if (!site->added) {
+		site->next = log_sites_list;
+		log_sites_list = site;
+		log_sites_sync_range(site, site + 1);
+		__atomic_store_n(&site->added, 1, __ATOMIC_RELEASE);
+	}
+	on = site->on;
+	pthread_mutex_unlock(&log_sites_lock);
+
+	return (on);
+}
+
+/* Removes the call sites of a file about to be unloaded. */
+void
+log_sites_remove(const void *module)
+{
+	struct log_site	**sp;
+
+	pthread_mutex_lock(&log_sites_lock);
+	for (sp = &log_sites_list; *sp != NULL;)
+		if ((*sp)->module == module)
+			*sp = (*sp)->next;
+		else
+			sp = &(*sp)->next;
+	pthread_mutex_unlock(&log_sites_lock);
+}
+#endif
+
+/*
+ * Computes whether every call site is enabled, log_sites_lock must be
+ * held.
+ */
+static void
+log_sites_sync(void)
+{
+#ifndef __ELF__
+	struct log_site	*s;
+#endif
+	uint32_t	 i;
+
+	for (i = 0; i < log_n_modules; i++)
+		log_sites_sync_range(log_modules[i].start,
+		    log_modules[i].stop);
+#ifndef __ELF__
+	for (s = log_sites_list; s != NULL; s = s->next)
+		log_sites_sync_range(s, s + 1);
+#endif
+}
+
+static void
+log_sites_sync_range(struct log_site *start, struct log_site *stop)
+{
+	struct log_site	*s;
+	uint8_t		 out;
+
+	for (s = start; s < stop; s++) {
+		if (s->mode == LOG_SITE_DEFAULT)
+			out = s->cat < LOG_CAT_MAX &&
+			    (log_cat_levels[s->cat] & (1 << s->lvl)) != 0;
+		else
+			out = s->mode == LOG_SITE_ON;
+		__atomic_store_n(&s->out, out, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->on, out || log_recording,
+		    __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Sets how the time of the records is written: LOG_TIME_MSEC or
+ * LOG_TIME_USEC adds the milliseconds or microseconds, LOG_TIME_UTC writes
+ * it in UTC as ISO 8601, which doesn't need the timezone database.
+ */
+void
+log_set_time(uint8_t flags)
+{
+	__atomic_store_n(&log_time_flags, flags, __ATOMIC_RELAXED);
+}
+
+/* Writes `v' in decimal over `width' digits, padded with zeros. */
+char *
+log_fmt_num(char *p, uint32_t v, int width)
+{
+	int	i;
+
+	for (i = width - 1; i >= 0; i--, v /= 10)
+		p[i] = '0' + v % 10;
+
+	return (p + width);
+}
+
+/* Writes the UTC date and time of `sec' without going through gmtime(). */
+int
+log_fmt_utc(char *buf, time_t sec)
+{
+	int64_t		days, era, doe, yoe, doy, mp, y, m, d, tod;
+	char		*p = buf;
+
+	days = sec / 86400;
+	tod = sec % 86400;
+	if (tod < 0) {
+		tod += 86400;
+		days--;
+	}
+
+	/* days to civil date, from Howard Hinnant's algorithm */
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	doe = days - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = yoe + era * 400 + (m <= 2);
+
+	p = log_fmt_num(p, y, 4);
+	*p++ = '-';
+	p = log_fmt_num(p, m, 2);
+	*p++ = '-';
+	p = log_fmt_num(p, d, 2);
+	*p++ = 'T';
+	p = log_fmt_num(p, tod / 3600, 2);
+	*p++ = ':';
+	p = log_fmt_num(p, tod / 60 % 60, 2);
+	*p++ = ':';
+	p = log_fmt_num(p, tod % 60, 2);
+
+	return (p - buf);
+}
+
+/* Reads the time of a record, the coarse clock does without a fraction. */
+void
+log_clock(struct timespec *ts)
+{
+	clock_gettime(__atomic_load_n(&log_time_flags, __ATOMIC_RELAXED) &
+	    (LOG_TIME_MSEC | LOG_TIME_USEC) ? CLOCK_REALTIME :
+	    CLOCK_REALTIME_COARSE, ts);
+}
+
+/*
+ * Writes the time of a record. The date and time are reused as long as the
+ * second doesn't change, only the fraction of second is formatted for
+ * every record. Returns the length written.
+ */
+int
+log_timestamp(char *buf, const struct timespec *ts)
+{
+	struct tm	 tm_info;
+	struct log_time	*t = &log_time;
+	uint8_t		 flags;
+	char		*p;
+
+	flags = __atomic_load_n(&log_time_flags, __ATOMIC_RELAXED);
+
+	if (ts->tv_sec != t->sec || flags != t->flags || t->len == 0) {
+		if (flags & LOG_TIME_UTC)
+			t->len = log_fmt_utc(t->str, ts->tv_sec);
+		else {
+			localtime_r(&ts->tv_sec, &tm_info);
+			t->len = strftime(t->str, sizeof(t->str),
+			    "%Y-%m-%d %H:%M:%S", &tm_info);
+		}
+		t->sec = ts->tv_sec;
+		t->flags = flags;
+	}
+
+	memcpy(buf, t->str, t->len);
+	p = buf + t->len;
+
+	if (flags & LOG_TIME_USEC) {
+		*p++ = '.';
+		p = log_fmt_num(p, ts->tv_nsec / 1000, 6);
+	} else if (flags & LOG_TIME_MSEC) {
+		*p++ = '.';
+		p = log_fmt_num(p, ts->tv_nsec / 1000000, 3);
+	}
+	if (flags & LOG_TIME_UTC)
+		*p++ = 'Z';
+	*p = '\0';
+
+	return (p - buf);
+}
+
+/*
+ * Returns the id of the calling thread, the kernel's where there's one to
+ * get, a sequence number otherwise.
+ */
+uint32_t
+log_thread_id(void)
+{
+	if (log_tid == 0) {
+#ifdef SYS_gettid
+		log_tid = syscall(SYS_gettid);
+#else
+		log_tid = __atomic_add_fetch(&log_tid_next, 1, __ATOMIC_RELAXED);
+#endif
+	}
+
+	return (log_tid);
+}
+
+/* Writes the "[time] [thread] level> " start of a record. */
+int
+log_header(char *buff, uint8_t lvl, uint32_t tid, const struct timespec *ts)
+{
+	char			 cur_time[LOG_TIME_LEN];
+
+	log_timestamp(cur_time, ts);
+
+	return (snprintf(buff, LOG_LINE_MAX, "[%s] [%u] %s> ", cur_time, tid,
+	    log_lvl_names[lvl]));
+}
+
+/*
+ * Ends a record of `len' bytes followed by a message of `n' bytes, maybe
+ * truncated, with the error string of `err' if any and a new line.
+ * Returns the length of the record.
+ */
+int
+log_finish(char *buff, int len, int n, int err)
+{
+	if (n < 0)
+		n = 0;
+	len += n < LOG_LINE_MAX - len ? n : LOG_LINE_MAX - len - 1;
+
+	if (err)
+		n = snprintf(buff + len, LOG_LINE_MAX - len, ": %s\n",
+		    strerror(err));
+	else
+		n = snprintf(buff + len, LOG_LINE_MAX - len, "\n");
+	len += n < LOG_LINE_MAX - len ? n : LOG_LINE_MAX - len - 1;
+
+	/* a truncated record still ends the line */
+	if (buff[len - 1] != '\n')
+		buff[len - 1] = '\n';
+
+	return (len);
+}
+
+/*
+ * Formats a record as "[time] [thread] level> message", followed by the
+ * error string of `err' if any, into a buffer of LOG_LINE_MAX bytes. A
+ * message too long is truncated. Returns the length of the record.
+ */
+int
+log_format(char *buff, uint8_t lvl, int err, const char *format, va_list list)
+{
+	struct timespec	ts;
+	int		len;
+
+	log_clock(&ts);
+	len = log_header(buff, lvl, log_thread_id(), &ts);
+
+	return (log_finish(buff, len,
+	    vsnprintf(buff + len, LOG_LINE_MAX - len, format, list), err));
+}
+
+/*
+ * Records the format and the arguments of a record in its slot, to be
+ * formatted by the writer thread. If the arguments can't be recorded, -1
+ * is returned and `list' is left untouched.
+ */
+int
+log_defer_rec(struct log_slot *s, int err, const char *format, va_list list)
+{
+	struct log_rec	*rec = (struct log_rec *)s->line;
+	va_list		 copy;
+	int32_t		 n;
+
+	va_copy(copy, list);
+	n = logrec_encode(rec->args, LOG_LINE_MAX - sizeof(*rec), format,
+	    copy);
+	va_end(copy);
+	if (n == -1)
+		return (-1);
+
+	rec->format = format;
+	log_clock(&rec->ts);
+	rec->tid = log_thread_id();
+	rec->err = err;
+	rec->len = n;
+
+	return (0);
+}
+
+/*
+ * Defers the formatting of the records to the writer thread when the
+ * logging is asynchronous. Only the format, which must stay valid, and
+ * the raw arguments are copied by the callers. Strings arguments are
+ * copied as well.
+ */
+void
+log_defer(uint8_t onoff)
+{
+	__atomic_store_n(&log_deferred, onoff, __ATOMIC_RELAXED);
+}
+
+void
+log_counts_init(void)
+{
+	log_counts_keyed = pthread_key_create(&log_counts_key,
+	    log_count_exit) == 0;
+}
+
+/*
+ * Counts a record written by the thread, which joins log_counts first.
+ * Without the key to leave it at exit, the shared counter is used.
+ */
+void
+log_count_add(void)
+{
+	if (!log_count_on) {
+		pthread_once(&log_counts_once, log_counts_init);
+		if (!log_counts_keyed) {
+			__atomic_add_fetch(&log_counters.records, 1,
+			    __ATOMIC_RELAXED);
+			return;
+		}
+		pthread_mutex_lock(&log_counts_lock);
+		log_count.next = log_counts;
+		log_counts = &log_count;
+		pthread_mutex_unlock(&log_counts_lock);
+		pthread_setspecific(log_counts_key, &log_count);
+		log_count_on = 1;
+	}
+	__atomic_store_n(&log_count.records, log_count.records + 1,
+	    __ATOMIC_RELAXED);
+}
+
+void
+log_count_exit(void *arg)
+{
+	struct log_count	*c = arg, **cp;
+
+	pthread_mutex_lock(&log_counts_lock);
+	for (cp = &log_counts; *cp != NULL; cp = &(*cp)->next)
+		if (*cp == c) {
+			*cp = c->next;
+			break;
+		}
+	__atomic_add_fetch(&log_counters.records, c->records,
+	    __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&log_counts_lock);
+}
+
+/* Hands a record to the callback, or to stdout or stderr. */
+void
+log_write(uint8_t lvl, const char *buff)
+{
+	log_count_add();
+
+	log_emit(lvl, buff);
+	if (cb_log == NULL)
+		log_sink_tick(0);
+}
+
+void
+log_vlog(uint8_t lvl, int err, const char *format, va_list list)
+{
+	struct log_ring	*r;
+	struct log_slot	*s;
+
+	if ((r = log_ring_hold()) == NULL) {
+		log_format(log_buff, lvl, err, format, list);
+		log_write(lvl, log_buff);
 		return;
+	}
 
-	time(&timer);
-	tm_info = localtime(&timer);
-	strftime(cur_time, 20, "%Y-%m-%d %H:%M:%S", tm_info);
+	if ((s = log_ring_put(r)) == NULL) {
+		__atomic_add_fetch(&log_counters.dropped, 1, __ATOMIC_RELAXED);
+		log_users_rele(&log_ring_users);
+		return;
+	}
 
-	len = snprintf(buff, sizeof(buff), "[%s] debug> ", cur_time);
+	s->lvl = lvl;
+	s->kv = 0;
+	s->deferred = __atomic_load_n(&log_deferred, __ATOMIC_RELAXED) &&
+	    log_defer_rec(s, err, format, list) == 0;
+	if (!s->deferred)
+		log_format(s->line, lvl, err, format, list);
+	log_ring_publish(r, s);
+	log_users_rele(&log_ring_users);
+}
 
-	va_start(list, format);
-	len += vsnprintf(buff + len, sizeof(buff) - len, format, list);
-	snprintf(buff + len, sizeof(buff) - len, "\n");
-	va_end(list);
+/* Writes a structured record already formatted, of `len' bytes. */
+void
+log_put(uint8_t lvl, const char *line, int len)
+{
+	struct log_ring	*r;
+	struct log_slot	*s;
+
+	if ((r = log_ring_hold()) == NULL) {
+		log_write(lvl, line);
+		return;
+	}
+
+	if ((s = log_ring_put(r)) == NULL) {
+		__atomic_add_fetch(&log_counters.dropped, 1, __ATOMIC_RELAXED);
+		log_users_rele(&log_ring_users);
+		return;
+	}
+
+	s->lvl = lvl;
+	s->kv = 1;
+	s->deferred = 0;
+	memcpy(s->line, line, len + 1);
+	log_ring_publish(r, s);
+	log_users_rele(&log_ring_users);
+}
+
+/*
+ * Returns the ring, which isn't freed until log_users_rele() is called, or
+ * NULL if the logging isn't asynchronous. The caller is counted before
+ * the ring is loaded, so that log_async_stop(), which clears it first,
+ * either sees the caller or makes it miss the ring.
+ */
+static struct log_ring *
+log_ring_hold(void)
+{
+	struct log_ring	*r;
+
+	__atomic_add_fetch(&log_ring_users, 1, __ATOMIC_SEQ_CST);
+	if ((r = __atomic_load_n(&log_ring, __ATOMIC_SEQ_CST)) == NULL)
+		log_users_rele(&log_ring_users);
+
+	return (r);
+}
+
+static void
+log_users_rele(uint32_t *users)
+{
+	__atomic_sub_fetch(users, 1, __ATOMIC_RELEASE);
+}
+
+/* Waits for the callers still holding what was just cleared. */
+static void
+log_users_wait(uint32_t *users)
+{
+	struct timespec	 ts = { 0, LOG_IDLE_NS };
+
+	while (__atomic_load_n(users, __ATOMIC_SEQ_CST) != 0)
+		nanosleep(&ts, NULL);
+}
+
+/* Hands a slot claimed by log_ring_put() to the writer. */
+void
+log_ring_publish(struct log_ring *r, struct log_slot *s)
+{
+	__atomic_store_n(&s->seq, __atomic_load_n(&s->seq, __ATOMIC_RELAXED) + 1,
+	    __ATOMIC_SEQ_CST);
+
+	/* only the first record since the writer went to sleep wakes it */
+	if (__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&r->sleeping, 0, __ATOMIC_SEQ_CST))
+		log_ring_wake(r);
+}
+
+/*
+ * Claims the next slot of the ring, to be published by incrementing its
+ * `seq'. When the ring is full, the policy decides whether to wait for the
+ * writer, to drop the record, in which case NULL is returned, or to drop
+ * the oldest record.
+ */
+struct log_slot *
+log_ring_put(struct log_ring *r)
+{
+	struct log_slot	*s;
+	uint32_t	 pos, seq;
 
+	pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		s = &r->slot[pos & r->mask];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1,
+			    1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return (s);
+			continue;
+		}
+
+		if ((int32_t)(seq - pos) > 0) {
+			/* another producer got it first */
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		switch (r->policy) {
+		case LOG_ASYNC_DROP:
+			return (NULL);
+		case LOG_ASYNC_DROP_OLDEST:
+			if ((s = log_ring_take(r)) != NULL) {
+				__atomic_store_n(&s->seq, s->seq + r->mask,
+				    __ATOMIC_RELEASE);
+				__atomic_add_fetch(&log_counters.overwritten, 1,
+				    __ATOMIC_RELAXED);
+			}
+			break;
+		default:
+			log_ring_wake(r);
+			sched_yield();
+			break;
+		}
+		pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Takes the oldest record of the ring, or returns NULL if there's none
+ * ready. The slot is given back by adding the size of the ring, minus one,
+ * to its `seq'.
+ */
+struct log_slot *
+log_ring_take(struct log_ring *r)
+{
+	struct log_slot	*s;
+	uint32_t	 pos, seq;
+
+	pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	for (;;) {
+		s = &r->slot[pos & r->mask];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos + 1) {
+			if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1,
+			    1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return (s);
+			continue;
+		}
+
+		if ((int32_t)(seq - (pos + 1)) < 0)
+			return (NULL);
+
+		pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	}
+}
+
+void
+log_ring_wake(struct log_ring *r)
+{
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void
+log_emit(uint8_t lvl, const char *line)
+{
 	if (cb_log)
-		cb_log(buff);
-	else {
-		fprintf(stdout, "%s", buff);
-		fflush(stdout);
+		cb_log(line);
+	else
+		log_sink_put(lvl == LOG_LVL_WARN ? &log_sink_err :
+		    &log_sink_out, lvl, line);
+}
+
+static uint64_t
+log_now(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Buffers a record, writing the sink first when it's full, and after when
+ * the flush policy asks for it by the number of records or for warnings.
+ */
+static void
+log_sink_put(struct log_sink *sink, uint8_t lvl, const char *line)
+{
+	size_t	 len;
+
+	if ((len = strlen(line)) > LOG_SINK_SIZE)
+		len = LOG_SINK_SIZE;
+
+	pthread_once(&log_sink_once, log_sink_init);
+	pthread_mutex_lock(&sink->lock);
+	if (sink->iovcnt == LOG_SINK_IOV || sink->len + len > LOG_SINK_SIZE)
+		log_sink_write(sink);
+
+	if (sink->iovcnt == 0)
+		sink->first = log_now();
+	memcpy(sink->buf + sink->len, line, len);
+	sink->iov[sink->iovcnt].iov_base = sink->buf + sink->len;
+	sink->iov[sink->iovcnt].iov_len = len;
+	sink->iovcnt++;
+	sink->len += len;
+
+	if ((log_flush_records != 0 &&
+	    (uint32_t)sink->iovcnt >= log_flush_records) ||
+	    (log_flush_warn && lvl == LOG_LVL_WARN))
+		log_sink_write(sink);
+	pthread_mutex_unlock(&sink->lock);
+}
+
+/*
+ * Writes the buffered records, the sink's lock must be held. They are
+ * dropped if the stream fails.
+ */
+static void
+log_sink_write(struct log_sink *sink)
+{
+	struct iovec	*iov = sink->iov;
+	ssize_t		 n;
+	int		 cnt = sink->iovcnt, err = errno;
+
+	/* what the program wrote with stdio before comes first */
+	if (sink->stdio != NULL) {
+		fflush(sink->stdio);
+		sink->stdio = NULL;
+	}
+
+	while (cnt > 0) {
+		if ((n = writev(sink->fd, iov, cnt)) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (; cnt > 0 && (size_t)n >= iov->iov_len; iov++, cnt--)
+			n -= iov->iov_len;
+		if (cnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	sink->iovcnt = 0;
+	sink->len = 0;
+	errno = err;
+}
+
+/*
+ * Writes the sinks when the flush policy asks for it by time, or right
+ * away without a policy. `all' writes them regardless.
+ */
+static void
+log_sink_tick(int all)
+{
+	struct log_sink	*sink[] = { &log_sink_out, &log_sink_err };
+	uint64_t	 now = 0;
+	size_t		 i;
+
+	if (!all && log_flush_msec != 0)
+		now = log_now();
+
+	for (i = 0; i < sizeof(sink) / sizeof(sink[0]); i++) {
+		pthread_mutex_lock(&sink[i]->lock);
+		if (sink[i]->iovcnt != 0 && (all ||
+		    (log_flush_records == 0 && log_flush_msec == 0) ||
+		    (log_flush_msec != 0 && now - sink[i]->first >=
+		    (uint64_t)log_flush_msec * 1000000)))
+			log_sink_write(sink[i]);
+		pthread_mutex_unlock(&sink[i]->lock);
 	}
 }
 
+/*
+ * Returns 1 when the record repeats the last one, which the writer then
+ * only counts, and 0 when it must be written.
+ */
+static int
+log_coalesce(uint8_t lvl, const char *line)
+{
+	const char	*body;
+	size_t		 len;
+
+	if ((body = strstr(line, "> ")) != NULL)
+		body += 2;
+	else
+		body = line;
+
+	if (lvl == log_last.lvl && strcmp(body, log_last.body) == 0) {
+		log_last.hlen = body - line;
+		memcpy(log_last.hdr, line, log_last.hlen);
+		log_last.repeats++;
+		__atomic_add_fetch(&log_counters.repeated, 1, __ATOMIC_RELAXED);
+		return (1);
+	}
+
+	log_repeats();
+	if ((len = strlen(body)) >= sizeof(log_last.body))
+		len = sizeof(log_last.body) - 1;
+	memcpy(log_last.body, body, len);
+	log_last.body[len] = '\0';
+	log_last.lvl = lvl;
+
+	return (0);
+}
+
+/*
+ * Writes how many times the last record was repeated, if it was.
+ */
+static void
+log_repeats(void)
+{
+	if (log_last.repeats == 0)
+		return;
+
+	snprintf(log_last.hdr + log_last.hlen, LOG_LINE_MAX - log_last.hlen,
+	    "last message repeated %u times\n", log_last.repeats);
+	log_emit(log_last.lvl, log_last.hdr);
+	log_last.repeats = 0;
+}
+
+/*
+ * Writes the records of the ring in batches, the sinks are written at the
+ * end of each batch without a flush policy and before sleeping when there's
+ * nothing left.
+ */
+void *
+log_writer(void *arg)
+{
+	struct log_ring	*r = arg;
+	struct log_slot	*s;
+	struct log_rec	*rec;
+	struct timespec	 ts;
+	const char	*line;
+	uint32_t	 pos;
+	int		 n, len, idle = 0;
+
+	for (;;) {
+		for (n = 0; n < LOG_BATCH && (s = log_ring_take(r)) != NULL;
+		    n++) {
+			line = s->line;
+			if (s->deferred) {
+				rec = (struct log_rec *)s->line;
+				len = log_header(log_buff, s->lvl, rec->tid,
+				    &rec->ts);
+				log_finish(log_buff, len, logrec_decode(
+				    log_buff + len, LOG_LINE_MAX - len,
+				    rec->format, rec->args, rec->len),
+				    rec->err);
+				line = log_buff;
+			}
+
+			/*
+			 * A structured record is written as it is, the count
+			 * of repeats would break its format.
+			 */
+			if (s->kv) {
+				log_repeats();
+				log_last.lvl = 0;
+				log_emit(s->lvl, line);
+			} else if (!log_coalesce(s->lvl, line))
+				log_emit(s->lvl, line);
+			__atomic_store_n(&s->seq, s->seq + r->mask,
+			    __ATOMIC_RELEASE);
+		}
+
+		if (n > 0) {
+			idle = 0;
+			__atomic_add_fetch(&log_counters.records, n,
+			    __ATOMIC_RELAXED);
+			log_sink_tick(0);
+			__atomic_store_n(&r->done, __atomic_load_n(&r->head,
+			    __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+			continue;
+		}
+
+		if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+			log_repeats();
+			log_sink_tick(1);
+			break;
+		}
+
+		/*
+		 * Poll for a while before sleeping, a steady flow of records
+		 * then never costs the callers a wake up.
+		 */
+		if (idle++ < LOG_IDLE_POLLS) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = LOG_IDLE_NS;
+			nanosleep(&ts, NULL);
+			log_sink_tick(0);
+			continue;
+		}
+		idle = 0;
+		log_repeats();
+		log_sink_tick(1);
+
+		pthread_mutex_lock(&r->lock);
+		__atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+		pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		s = &r->slot[pos & r->mask];
+		if (__atomic_load_n(&s->seq, __ATOMIC_SEQ_CST) != pos + 1 &&
+		    !__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec++;
+			pthread_cond_timedwait(&r->cond, &r->lock, &ts);
+		}
+		__atomic_store_n(&r->sleeping, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Moves the writing of the records to a thread of their own. The callers
+ * only format their records into a ring of `slots' records, rounded up to
+ * a power of two. When the ring is full, `policy' tells whether the caller
+ * waits (LOG_ASYNC_BLOCK), its record is dropped (LOG_ASYNC_DROP) or the
+ * oldest record is dropped (LOG_ASYNC_DROP_OLDEST). The callback, if any,
+ * is called from the writer thread. If an error occurs, -1 is returned.
+ */
+int
+log_async_start(uint32_t slots, int policy)
+{
+	struct log_ring	*r;
+	uint32_t	 i, n;
+
+	if (log_ring != NULL || slots == 0 || policy < LOG_ASYNC_BLOCK ||
+	    policy > LOG_ASYNC_DROP_OLDEST)
+		return (-1);
+
+	/* the records left in the ring are written at exit */
+	pthread_once(&log_sink_once, log_sink_init);
+
+	for (n = 2; n < slots; n <<= 1)
+		;
+
+	if (posix_memalign((void **)&r, LOG_CACHELINE, sizeof(*r)) != 0)
+		return (-1);
+	memset(r, 0, sizeof(*r));
+
+	if ((r->slot = calloc(n, sizeof(*r->slot))) == NULL) {
+		free(r);
+		return (-1);
+	}
+	for (i = 0; i < n; i++)
+		r->slot[i].seq = i;
+	r->mask = n - 1;
+	r->policy = policy;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	if (pthread_create(&r->thread, NULL, log_writer, r) != 0) {
+		pthread_mutex_destroy(&r->lock);
+		pthread_cond_destroy(&r->cond);
+		free(r->slot);
+		free(r);
+		return (-1);
+	}
+
+	__atomic_store_n(&log_ring, r, __ATOMIC_RELEASE);
+
+	return (0);
+}
+
+/*
+ * Writes the records left in the ring and goes back to writing them from
+ * the callers. The records being put in the ring meanwhile are written
+ * before it's freed.
+ */
 void
-log_info(const char *format, ...)
+log_async_stop(void)
 {
-	struct tm	*tm_info;
-	time_t		 timer;
-	va_list		 list;
-	int		 len;
-	static char	 buff[512];
-	char		 cur_time[20];
+	struct log_ring	*r;
 
-	if (log_lvl_info == 0)
+	if ((r = log_ring) == NULL)
 		return;
 
-	time(&timer);
-	tm_info = localtime(&timer);
-	strftime(cur_time, 20, "%Y-%m-%d %H:%M:%S", tm_info);
+	/* the writer keeps running for the callers blocked on a full ring */
+	__atomic_store_n(&log_ring, NULL, __ATOMIC_SEQ_CST);
+	log_users_wait(&log_ring_users);
 
-	len = snprintf(buff, sizeof(buff), "[%s] info> ", cur_time);
+	__atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+	log_ring_wake(r);
+	pthread_join(r->thread, NULL);
 
-	va_start(list, format);
-	len += vsnprintf(buff + len, sizeof(buff) - len, format, list);
-	snprintf(buff + len, sizeof(buff) - len, "\n");
-	va_end(list);
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->cond);
+	free(r->slot);
+	free(r);
+}
 
-	if (cb_log)
-		cb_log(buff);
-	else {
-		fprintf(stdout, "%s", buff);
-		fflush(stdout);
+/*
+ * Records every record from now on, of any level and whether it's written
+ * or not, into the last `entries' entries (rounded up to a power of two)
+ * of a flight recorder at `path', which log_recorder_read() decodes, even
+ * after a crash. If an error occurs, -1 is returned.
+ */
+int
+log_recorder_open(const char *path, uint32_t entries)
+{
+	struct log_fr_hdr	*fr;
+	size_t			 size;
+	uint32_t		 n;
+	int			 fd;
+
+	if (log_fr != NULL || entries == 0 || entries > (1U << 24))
+		return (-1);
+
+	for (n = 2; n < entries; n <<= 1)
+		;
+	size = (size_t)(n + 1) * LOG_FR_ENTRY;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+		log_warn("%s: open", __func__);
+		return (-1);
 	}
+	if (ftruncate(fd, size) < 0) {
+		log_warn("%s: ftruncate", __func__);
+		close(fd);
+		return (-1);
+	}
+	if ((fr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	    0)) == MAP_FAILED) {
+		log_warn("%s: mmap", __func__);
+		close(fd);
+		return (-1);
+	}
+	close(fd);
+
+	memcpy(fr->magic, LOG_FR_MAGIC, sizeof(fr->magic));
+	fr->size = LOG_FR_ENTRY;
+	fr->count = n;
+	fr->pos = 0;
+
+	__atomic_store_n(&log_fr, fr, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&log_sites_lock);
+	log_recording = 1;
+	log_sites_sync();
+	pthread_mutex_unlock(&log_sites_lock);
+
+	return (0);
 }
 
+/*
+ * Stops recording, the file is left as it is. The records being recorded
+ * meanwhile are completed before it's unmapped.
+ */
 void
-log_warnx(const char *format, ...)
+log_recorder_close(void)
 {
-	struct tm	*tm_info;
-	time_t		 timer;
-	va_list		 list;
-	int		 len;
-	static char	 buff[512];
-	char		 cur_time[20];
+	struct log_fr_hdr	*fr;
 
-	if (log_lvl_warn == 0)
+	if ((fr = log_fr) == NULL)
 		return;
 
-	time(&timer);
-	tm_info = localtime(&timer);
-	strftime(cur_time, 20, "%Y-%m-%d %H:%M:%S", tm_info);
+	pthread_mutex_lock(&log_sites_lock);
+	log_recording = 0;
+	log_sites_sync();
+	pthread_mutex_unlock(&log_sites_lock);
+
+	__atomic_store_n(&log_fr, NULL, __ATOMIC_SEQ_CST);
+	log_users_wait(&log_fr_users);
+	munmap(fr, (size_t)(fr->count + 1) * LOG_FR_ENTRY);
+}
+
+/*
+ * Copies a record into the next entry of the flight recorder, with its
+ * format inline since the process may be gone when it's decoded.
+ */
+static void
+log_record(uint8_t lvl, int err, const char *format, va_list list)
+{
+	struct log_fr_hdr	*fr;
+	struct log_fr_entry	*e;
+	struct timespec		 ts;
+	va_list			 copy;
+	uint64_t		 pos;
+	size_t			 flen;
+	int32_t			 alen = -1;
+
+	/* counted first, as log_ring_hold() does */
+	__atomic_add_fetch(&log_fr_users, 1, __ATOMIC_SEQ_CST);
+	if ((fr = __atomic_load_n(&log_fr, __ATOMIC_SEQ_CST)) == NULL) {
+		log_users_rele(&log_fr_users);
+		return;
+	}
+
+	pos = __atomic_fetch_add(&fr->pos, 1, __ATOMIC_RELAXED);
+	e = (struct log_fr_entry *)((uint8_t *)fr +
+	    ((pos & (fr->count - 1)) + 1) * LOG_FR_ENTRY);
+	/*
+	 * The entry is invalidated before its payload is written, so that a
+	 * crash while writing it doesn't leave it with its old position.
+	 */
+	__atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
 
-	len = snprintf(buff, sizeof(buff), "[%s] warn> ", cur_time);
+	if ((flen = strlen(format) + 1) < LOG_FR_DATA) {
+		memcpy(e->data, format, flen);
+		va_copy(copy, list);
+		alen = logrec_encode(e->data + flen, LOG_FR_DATA - flen, format,
+		    copy);
+		va_end(copy);
+	}
+	if (alen >= 0) {
+		e->text = 0;
+		e->flen = flen;
+		e->alen = alen;
+	} else {
+		va_copy(copy, list);
+		alen = vsnprintf((char *)e->data, LOG_FR_DATA, format, copy);
+		va_end(copy);
+		e->text = 1;
+		e->flen = 0;
+		if (alen < 0)
+			alen = 0;
+		else if (alen >= (int32_t)LOG_FR_DATA)
+			alen = LOG_FR_DATA - 1;
+		e->alen = alen;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	e->ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	e->tid = log_thread_id();
+	e->err = err;
+	e->lvl = lvl;
+
+	__atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+	log_users_rele(&log_fr_users);
+}
+
+static int
+log_fr_cmp(const void *a, const void *b)
+{
+	const struct log_fr_entry	*ea = *(struct log_fr_entry * const *)a;
+	const struct log_fr_entry	*eb = *(struct log_fr_entry * const *)b;
+
+	return (ea->seq < eb->seq ? -1 : ea->seq > eb->seq);
+}
+
+/*
+ * Decodes the flight recorder at `path' and hands its records, oldest
+ * first, to `cb' as they would have been written. The entries being
+ * written when the process stopped are skipped. Returns the number of
+ * records. If an error occurs, -1 is returned.
+ */
+int
+log_recorder_read(const char *path, void (*cb)(const char *))
+{
+	struct log_fr_hdr	*fr;
+	struct log_fr_entry	*e, **sorted = NULL;
+	struct stat		 st;
+	struct timespec		 ts;
+	char			 buff[LOG_LINE_MAX];
+	uint32_t		 i, n = 0;
+	int			 fd, len, ret = -1;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		log_warn("%s: open", __func__);
+		return (-1);
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < LOG_FR_ENTRY) {
+		log_warnx("%s: invalid file", __func__);
+		close(fd);
+		return (-1);
+	}
+	if ((fr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+	    MAP_FAILED) {
+		log_warn("%s: mmap", __func__);
+		close(fd);
+		return (-1);
+	}
+	close(fd);
+
+	if (memcmp(fr->magic, LOG_FR_MAGIC, sizeof(fr->magic)) != 0 ||
+	    fr->size != LOG_FR_ENTRY || fr->count == 0 ||
+	    (fr->count & (fr->count - 1)) != 0 ||
+	    (uint64_t)st.st_size < ((uint64_t)fr->count + 1) * LOG_FR_ENTRY) {
+		log_warnx("%s: invalid file", __func__);
+		goto out;
+	}
+
+	if ((sorted = calloc(fr->count, sizeof(*sorted))) == NULL) {
+		log_warn("%s: calloc", __func__);
+		goto out;
+	}
+	for (i = 0; i < fr->count; i++) {
+		e = (struct log_fr_entry *)((uint8_t *)fr +
+		    (i + 1) * LOG_FR_ENTRY);
+		if (e->seq == 0 || ((e->seq - 1) & (fr->count - 1)) != i ||
+		    e->lvl < LOG_LVL_DEBUG || e->lvl > LOG_LVL_WARN ||
+		    e->flen + e->alen > LOG_FR_DATA ||
+		    (e->text == 0 && (e->flen == 0 ||
+		    e->data[e->flen - 1] != '\0')))
+			continue;
+		sorted[n++] = e;
+	}
+	qsort(sorted, n, sizeof(*sorted), log_fr_cmp);
+
+	for (i = 0; i < n; i++) {
+		e = sorted[i];
+		ts.tv_sec = e->ns / 1000000000;
+		ts.tv_nsec = e->ns % 1000000000;
+		len = log_header(buff, e->lvl, e->tid, &ts);
+		if (e->text) {
+			memcpy(buff + len, e->data, e->alen < LOG_LINE_MAX -
+			    len ? e->alen : LOG_LINE_MAX - len - 1);
+			log_finish(buff, len, e->alen, e->err);
+		} else
+			log_finish(buff, len, logrec_decode(buff + len,
+			    LOG_LINE_MAX - len, (const char *)e->data,
+			    e->data + e->flen, e->alen), e->err);
+		cb(buff);
+	}
+	ret = n;
+
+out:
+	free(sorted);
+	munmap(fr, st.st_size);
+	return (ret);
+}
+
+/*
+ * Sets when the records written to stdout and stderr are flushed: once
+ * `records' records are buffered, once the oldest is `msec' milliseconds
+ * old, and for every warning when `warn' is set. With neither records nor
+ * msec, they are written right away, or once per batch by the writer
+ * thread. The age is checked by the writer thread, or by a thread of its
+ * own when the logging is synchronous. What's left is written at exit.
+ */
+void
+log_flush_policy(uint32_t records, uint32_t msec, uint8_t warn)
+{
+	pthread_t	thread;
+
+	pthread_once(&log_sink_once, log_sink_init);
+
+	log_flush_records = records;
+	log_flush_warn = warn;
+	__atomic_store_n(&log_flush_msec, msec, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&log_flusher_lock);
+	if (msec != 0 && !log_flusher_on &&
+	    pthread_create(&thread, NULL, log_flusher, NULL) == 0) {
+		pthread_detach(thread);
+		log_flusher_on = 1;
+	}
+	pthread_mutex_unlock(&log_flusher_lock);
+}
+
+static void
+log_sink_init(void)
+{
+	log_sink_out.stdio = stdout;
+	log_sink_err.stdio = stderr;
+	atexit(log_flush);
+}
+
+/*
+ * Writes the sinks whose oldest record is due, checking 4 times per
+ * period, until the policy goes without one.
+ */
+static void *
+log_flusher(void *arg)
+{
+	struct timespec	 ts;
+	uint32_t	 msec;
+
+	(void)arg;
+	for (;;) {
+		pthread_mutex_lock(&log_flusher_lock);
+		if ((msec = __atomic_load_n(&log_flush_msec,
+		    __ATOMIC_RELAXED)) == 0) {
+			log_flusher_on = 0;
+			pthread_mutex_unlock(&log_flusher_lock);
+			return (NULL);
+		}
+		pthread_mutex_unlock(&log_flusher_lock);
+
+		msec = msec < 4 ? 1 : msec / 4;
+		ts.tv_sec = msec / 1000;
+		ts.tv_nsec = (long)(msec % 1000) * 1000000;
+		nanosleep(&ts, NULL);
+		log_sink_tick(0);
+	}
+}
+
+/*
+ * Writes every buffered record, including the ones left in the
+ * asynchronous ring.
+ */
+void
+log_flush(void)
+{
+	struct log_ring	*r;
+	struct timespec	 ts = { 0, LOG_IDLE_NS };
+	uint32_t	 tail;
+
+	if ((r = log_ring_hold()) != NULL) {
+		tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		while (!pthread_equal(pthread_self(), r->thread) &&
+		    (int32_t)(__atomic_load_n(&r->done, __ATOMIC_ACQUIRE) -
+		    tail) < 0) {
+			log_ring_wake(r);
+			nanosleep(&ts, NULL);
+		}
+		log_users_rele(&log_ring_users);
+	}
+
+	log_sink_tick(1);
+}
+
+void
+log_stats(struct log_stats *stats)
+{
+	struct log_count	*c;
+
+	pthread_mutex_lock(&log_counts_lock);
+	stats->records = __atomic_load_n(&log_counters.records,
+	    __ATOMIC_RELAXED);
+	for (c = log_counts; c != NULL; c = c->next)
+		stats->records += __atomic_load_n(&c->records,
+		    __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&log_counts_lock);
+	stats->dropped = __atomic_load_n(&log_counters.dropped,
+	    __ATOMIC_RELAXED);
+	stats->overwritten = __atomic_load_n(&log_counters.overwritten,
+	    __ATOMIC_RELAXED);
+	stats->repeated = __atomic_load_n(&log_counters.repeated,
+	    __ATOMIC_RELAXED);
+}
+
+/*
+ * Writes the record of an enabled call site.
+ */
+void
+log_site_log(struct log_site *site, const char *format, ...)
+{
+	va_list		 list;
+	int		 err = site->err ? errno : 0;
 
 	va_start(list, format);
-	len += vsnprintf(buff + len, sizeof(buff) - len, format, list);
-	snprintf(buff + len, sizeof(buff) - len, "\n");
+	log_record(site->lvl, err, format, list);
+	if (__atomic_load_n(&site->out, __ATOMIC_RELAXED))
+		log_vlog(site->lvl, err, format, list);
 	va_end(list);
+}
 
-	if (cb_log)
-		cb_log(buff);
-	else {
-		fprintf(stderr, "%s", buff);
-		fflush(stderr);
+/*
+ * Takes a token from the bucket of a rate-limited call site, refilled with
+ * `burst' tokens every `interval' milliseconds. Returns 1 when the record
+ * may be written, after a record telling how many were suppressed since
+ * the last one, and 0 otherwise.
+ */
+int
+log_ratelimit(struct log_site *site, struct log_ratelimit *rl,
+    uint32_t burst, uint32_t interval)
+{
+	uint64_t	 now, tat, period, n;
+
+	if (burst == 0)
+		burst = 1;
+	period = (uint64_t)interval * 1000000 / burst;
+	now = log_now();
+
+	/*
+	 * The bucket is empty when the next record is due more than
+	 * burst - 1 periods ahead, a suppressed record only counts itself.
+	 */
+	tat = __atomic_load_n(&rl->tat, __ATOMIC_RELAXED);
+	do {
+		if (tat > now + period * (burst - 1)) {
+			__atomic_add_fetch(&rl->suppressed, 1,
+			    __ATOMIC_RELAXED);
+			return (0);
+		}
+	} while (!__atomic_compare_exchange_n(&rl->tat, &tat,
+	    (tat > now ? tat : now) + period, 1, __ATOMIC_RELAXED,
+	    __ATOMIC_RELAXED));
+
+	if (__atomic_load_n(&site->out, __ATOMIC_RELAXED) &&
+	    __atomic_load_n(&rl->suppressed, __ATOMIC_RELAXED) != 0 &&
+	    (n = __atomic_exchange_n(&rl->suppressed, 0,
+	    __ATOMIC_RELAXED)) != 0)
+		log_note(site->lvl, "%s: %llu records suppressed", site->func,
+		    (unsigned long long)n);
+
+	return (1);
+}
+
+static void
+log_note(uint8_t lvl, const char *format, ...)
+{
+	va_list		 list;
+
+	va_start(list, format);
+	log_vlog(lvl, 0, format, list);
+	va_end(list);
+}
+
+/*
+ * Sets how log_kv() writes its records, as a JSON object (LOG_KV_JSON) or
+ * as logfmt key=value pairs (LOG_KV_LOGFMT).
+ */
+void
+log_kv_format(uint8_t fmt)
+{
+	__atomic_store_n(&log_kv_fmt, fmt, __ATOMIC_RELAXED);
+}
+
+/*
+ * Writes the string `s' as a value, quoted and escaped in JSON, and in
+ * logfmt only when it holds a space, a quote, a '=' or a control
+ * character. A string too long is cut. Returns the end of what was
+ * written, or NULL if nothing fits.
+ */
+static char *
+log_kv_str(char *p, char *end, const char *s)
+{
+	static const char	 hex[] = "0123456789abcdef";
+	const unsigned char	*c;
+	char			*start;
+	int			 quote = 1, n;
+
+	if (log_kv_fmt == LOG_KV_LOGFMT && *s != '\0') {
+		for (c = (const unsigned char *)s; *c != '\0'; c++)
+			if (*c <= ' ' || *c == '"' || *c == '=' ||
+			    *c == '\\' || *c == 0x7f)
+				break;
+		quote = *c != '\0';
+	}
+
+	if (end - p < 2)
+		return (NULL);
+	if (quote) {
+		*p++ = '"';
+		end--;		/* room for the closing quote */
+	}
+	start = p;
+
+	for (c = (const unsigned char *)s; *c != '\0'; c++) {
+		n = *c == '"' || *c == '\\' || *c == '\n' || *c == '\t' ||
+		    *c == '\r' ? 2 : *c < ' ' ? 6 : 1;
+		if (end - p < n) {
+			/* don't leave a partial UTF-8 sequence */
+			while (p > start && (p[-1] & 0xc0) == 0x80)
+				p--;
+			if (p > start && (p[-1] & 0xc0) == 0xc0)
+				p--;
+			break;
+		}
+		switch (n) {
+		case 1:
+			*p++ = *c;
+			break;
+		case 2:
+			*p++ = '\\';
+			*p++ = *c == '\n' ? 'n' : *c == '\t' ? 't' :
+			    *c == '\r' ? 'r' : *c;
+			break;
+		default:
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[*c >> 4];
+			p[5] = hex[*c & 0xf];
+			p += 6;
+			break;
+		}
 	}
+
+	if (quote)
+		*p++ = '"';
+
+	return (p);
+}
+
+static char *
+log_kv_uint(char *p, char *end, uint64_t v)
+{
+	char	 tmp[20];
+	int	 n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v != 0);
+
+	if (end - p < n)
+		return (NULL);
+	while (n > 0)
+		*p++ = tmp[--n];
+
+	return (p);
 }
 
+static char *
+log_kv_int(char *p, char *end, int64_t v)
+{
+	if (v >= 0)
+		return (log_kv_uint(p, end, v));
+	if (end - p < 1)
+		return (NULL);
+	*p++ = '-';
+
+	return (log_kv_uint(p, end, -(uint64_t)v));
+}
+
+/*
+ * Writes `d' with up to 6 decimals, the trailing zeros dropped, and with
+ * an exponent when it's very large or very small. NaN and infinites are
+ * null in JSON.
+ */
+static char *
+log_kv_dbl(char *p, char *end, double d)
+{
+	const char	*str;
+	uint64_t	 ip, frac;
+	int		 exp = 0, i;
+
+	if (end - p < 40)
+		return (NULL);
+
+	if (d != d || d - d != 0) {
+		str = log_kv_fmt == LOG_KV_JSON ? "null" : d != d ? "NaN" :
+		    d > 0 ? "+Inf" : "-Inf";
+		memcpy(p, str, strlen(str));
+		return (p + strlen(str));
+	}
+
+	if (d < 0) {
+		*p++ = '-';
+		d = -d;
+	}
+	if (d >= 1e15)
+		for (; d >= 10; exp++)
+			d /= 10;
+	else if (d != 0 && d < 1e-4)
+		for (; d < 1; exp--)
+			d *= 10;
+
+	ip = d;
+	frac = (d - ip) * 1000000 + 0.5;
+	if (frac >= 1000000) {
+		ip++;
+		frac -= 1000000;
+	}
+	if (exp != 0 && ip == 10) {
+		ip = 1;
+		exp++;
+	}
+
+	p = log_kv_uint(p, end, ip);
+	if (frac != 0) {
+		*p++ = '.';
+		p = log_fmt_num(p, frac, 6);
+		for (i = 0; i < 5 && p[-1] == '0'; i++)
+			p--;
+	}
+	if (exp != 0) {
+		*p++ = 'e';
+		p = log_kv_int(p, end, exp);
+	}
+
+	return (p);
+}
+
+/*
+ * Writes a field after `sep', `value' being its raw text if not NULL.
+ * Returns NULL if it doesn't fit, nothing is then written.
+ */
+static char *
+log_kv_field(char *p, char *end, const char *sep, const char *value,
+    const struct log_kv *kv)
+{
+	size_t	 len = strlen(sep);
+
+	if (kv->type == LOG_KV_T_BOOL)
+		value = kv->v.i ? "true" : "false";
+
+	if ((size_t)(end - p) < len)
+		return (NULL);
+	memcpy(p, sep, len);
+	p += len;
+
+	if (log_kv_fmt == LOG_KV_JSON) {
+		if ((p = log_kv_str(p, end, kv->key)) == NULL ||
+		    end - p < 1)
+			return (NULL);
+		*p++ = ':';
+	} else {
+		if ((size_t)(end - p) < strlen(kv->key) + 1)
+			return (NULL);
+		len = strlen(kv->key);
+		memcpy(p, kv->key, len);
+		p += len;
+		*p++ = '=';
+	}
+
+	if (value != NULL) {
+		if ((size_t)(end - p) < (len = strlen(value)))
+			return (NULL);
+		memcpy(p, value, len);
+		return (p + len);
+	}
+
+	switch (kv->type) {
+	case LOG_KV_T_STR:
+		return (log_kv_str(p, end, kv->v.s != NULL ? kv->v.s :
+		    "(null)"));
+	case LOG_KV_T_INT:
+		return (log_kv_int(p, end, kv->v.i));
+	case LOG_KV_T_UINT:
+		return (log_kv_uint(p, end, kv->v.u));
+	case LOG_KV_T_DBL:
+		return (log_kv_dbl(p, end, kv->v.d));
+	}
+
+	return (NULL);
+}
+
+/*
+ * Writes a structured record of log_kv() in the thread's buffer, without
+ * printf, as {"time":..,"level":..,"tid":..,"msg":..,fields} in JSON or
+ * time=.. level=.. tid=.. msg=.. fields in logfmt. The fields that don't
+ * fit are left out.
+ */
 void
-log_warn(const char *format, ...)
+log_kv_log(struct log_site *site, const char *msg, const struct log_kv *kv,
+    uint32_t n)
+{
+	struct timespec	 ts;
+	struct log_kv	 hdr[4];
+	char		 cur_time[LOG_TIME_LEN];
+	char		 tid[12];
+	char		*p = log_buff, *end = log_buff + LOG_LINE_MAX - 3, *q;
+	const char	*sep;
+	uint32_t	 i;
+	int		 json = log_kv_fmt == LOG_KV_JSON;
+
+	log_clock(&ts);
+	cur_time[log_timestamp(cur_time, &ts)] = '\0';
+	*log_kv_uint(tid, tid + sizeof(tid) - 1, log_thread_id()) = '\0';
+
+	hdr[0] = (struct log_kv)LOG_KV_STR("time", cur_time);
+	hdr[1] = (struct log_kv)LOG_KV_STR("level", log_lvl_names[site->lvl]);
+	hdr[2] = (struct log_kv)LOG_KV_STR("tid", NULL);
+	hdr[3] = (struct log_kv)LOG_KV_STR("msg", msg);
+
+	if (json)
+		*p++ = '{';
+	for (i = 0; i < 4 + n; i++) {
+		sep = i == 0 ? "" : json ? "," : " ";
+		q = log_kv_field(p, end, sep, i == 2 ? tid : NULL,
+		    i < 4 ? &hdr[i] : &kv[i - 4]);
+		if (q != NULL)
+			p = q;
+	}
+	if (json)
+		*p++ = '}';
+	*p++ = '\n';
+	*p = '\0';
+
+	log_record_line(site->lvl, "%.*s", (int)(p - log_buff - 1), log_buff);
+	if (__atomic_load_n(&site->out, __ATOMIC_RELAXED))
+		log_put(site->lvl, log_buff, p - log_buff);
+}
+
+static void
+log_record_line(uint8_t lvl, const char *format, ...)
 {
-	struct tm	*tm_info;
-	time_t		 timer;
 	va_list		 list;
-	int		 len;
-	static char	 buff[512];
-	char		 cur_time[20];
 
-	if (log_lvl_warn == 0)
-		return;
+	va_start(list, format);
+	log_record(lvl, 0, format, list);
+	va_end(list);
+}
+
+void
+log_debug(const char *format, ...)
+{
+	va_list		 list;
 
-	time(&timer);
-	tm_info = localtime(&timer);
-	strftime(cur_time, 20, "%Y-%m-%d %H:%M:%S", tm_info);
+	va_start(list, format);
+	log_record(LOG_LVL_DEBUG, 0, format, list);
+	if (log_cat_levels[LOG_CAT_DEFAULT] & (1 << LOG_LVL_DEBUG))
+		log_vlog(LOG_LVL_DEBUG, 0, format, list);
+	va_end(list);
+}
 
-	len = snprintf(buff, sizeof(buff), "[%s] warn> ", cur_time);
+void
+log_info(const char *format, ...)
+{
+	va_list		 list;
 
 	va_start(list, format);
-	len += vsnprintf(buff + len, sizeof(buff) - len, format, list);
-	snprintf(buff + len, sizeof(buff) - len, ": %s\n", strerror(errno));
+	log_record(LOG_LVL_INFO, 0, format, list);
+	if (log_cat_levels[LOG_CAT_DEFAULT] & (1 << LOG_LVL_INFO))
+		log_vlog(LOG_LVL_INFO, 0, format, list);
 	va_end(list);
+}
 
-	if (cb_log)
-		cb_log(buff);
-	else {
-		fprintf(stderr, "%s", buff);
-		fflush(stderr);
-	}
+void
+log_warnx(const char *format, ...)
+{
+	va_list		 list;
+
+	va_start(list, format);
+	log_record(LOG_LVL_WARN, 0, format, list);
+	if (log_cat_levels[LOG_CAT_DEFAULT] & (1 << LOG_LVL_WARN))
+		log_vlog(LOG_LVL_WARN, 0, format, list);
+	va_end(list);
+}
+
+void
+log_warn(const char *format, ...)
+{
+	va_list		 list;
+	int		 err = errno;
+
+	va_start(list, format);
+	log_record(LOG_LVL_WARN, err, format, list);
+	if (log_cat_levels[LOG_CAT_DEFAULT] & (1 << LOG_LVL_WARN))
+		log_vlog(LOG_LVL_WARN, err, format, list);
+	va_end(list);
 }
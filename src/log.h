@@ -7,11 +7,251 @@
 #define LOG_LVL_INFO	0x2
 #define LOG_LVL_WARN	0x3
 
+/* the records below this level are compiled out */
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN	LOG_LVL_DEBUG
+#endif
+
+/* categories, a file sets LOG_CAT before including log.h */
+#define LOG_CAT_DEFAULT	0
+#define LOG_CAT_PKI	1
+#define LOG_CAT_PM	2
+#define LOG_CAT_INET	3
+#define LOG_CAT_BITV	4
+#define LOG_CAT_USER	8		/* first user-defined category */
+#define LOG_CAT_MAX	32
+
+/* the executable and the shared objects holding call sites */
+#define LOG_MODULES_MAX	64
+
+#ifndef LOG_CAT
+#define LOG_CAT		LOG_CAT_DEFAULT
+#endif
+
+/* how a call site follows its category */
+#define LOG_SITE_DEFAULT	0
+#define LOG_SITE_ON		1
+#define LOG_SITE_OFF		2
+
+/* how the time of the records is written */
+#define LOG_TIME_MSEC	0x1
+#define LOG_TIME_USEC	0x2
+#define LOG_TIME_UTC	0x4
+
+/* how log_kv() writes its records */
+#define LOG_KV_JSON	0
+#define LOG_KV_LOGFMT	1
+
+/* what a full asynchronous ring does with a new record */
+#define LOG_ASYNC_BLOCK		0
+#define LOG_ASYNC_DROP		1
+#define LOG_ASYNC_DROP_OLDEST	2
+
+struct log_stats {
+	uint64_t	records;	/* written */
+	uint64_t	dropped;	/* the ring was full */
+	uint64_t	overwritten;	/* dropped to make room */
+	uint64_t	repeated;	/* coalesced by the writer thread */
+};
+
 void	log_enable(uint8_t, uint8_t);
+int	log_cat_add(uint8_t, const char *);
+int	log_cat_lookup(const char *);
+int	log_cat_enable(uint8_t, uint8_t, uint8_t);
+int	log_site_set(const char *, const char *, uint32_t, uint8_t);
 void	log_setcb(void (*cb)(const char *));
+void	log_set_time(uint8_t);
+int	log_async_start(uint32_t, int);
+void	log_async_stop(void);
+void	log_defer(uint8_t);
+void	log_flush_policy(uint32_t, uint32_t, uint8_t);
+void	log_flush(void);
+int	log_recorder_open(const char *, uint32_t);
+void	log_recorder_close(void);
+int	log_recorder_read(const char *, void (*)(const char *));
+void	log_stats(struct log_stats *);
+void	log_kv_format(uint8_t);
 void	log_debug(const char *format, ...);
 void	log_info(const char *format, ...);
 void	log_warnx(const char *format, ...);
 void	log_warn(const char *format, ...);
 
+/*
+ * Every call site holds whether it is enabled, which log_enable(),
+ * log_cat_enable(), log_site_set() and the flight recorder compute for it,
+ * so a disabled record costs a single byte load. On ELF the sites are
+ * described in the log_sites section, the type is aligned so that the
+ * linker packs them without padding between them. Elsewhere a site adds
+ * itself to a list the first time it is reached.
+ */
+struct log_site {
+	const char	*file;
+	const char	*func;
+	uint32_t	 line;
+	uint8_t		 cat;
+	uint8_t		 lvl;
+	uint8_t		 err;		/* appends strerror(errno) */
+	uint8_t		 mode;		/* LOG_SITE_* */
+	uint8_t		 out;		/* written */
+	uint8_t		 on;		/* written or recorded */
+#ifndef __ELF__
+	uint8_t		 added;		/* to the list */
+	const void	*module;	/* the file holding it */
+	struct log_site	*next;
+#endif
+} __attribute__((aligned(8)));
+
+/* per call site token bucket of log_ratelimited() */
+struct log_ratelimit {
+	uint64_t	tat;		/* theoretical arrival time, in ns */
+	uint64_t	suppressed;
+};
+
+/* a typed field of log_kv() */
+struct log_kv {
+	const char	*key;
+	uint8_t		 type;
+	union {
+		const char	*s;
+		int64_t		 i;
+		uint64_t	 u;
+		double		 d;
+	} v;
+};
+
+#define LOG_KV_T_STR	0
+#define LOG_KV_T_INT	1
+#define LOG_KV_T_UINT	2
+#define LOG_KV_T_DBL	3
+#define LOG_KV_T_BOOL	4
+
+#define LOG_KV_STR(k, x)	{ (k), LOG_KV_T_STR, { .s = (x) } }
+#define LOG_KV_INT(k, x)	{ (k), LOG_KV_T_INT, { .i = (x) } }
+#define LOG_KV_UINT(k, x)	{ (k), LOG_KV_T_UINT, { .u = (x) } }
+#define LOG_KV_DBL(k, x)	{ (k), LOG_KV_T_DBL, { .d = (x) } }
+#define LOG_KV_BOOL(k, x)	{ (k), LOG_KV_T_BOOL, { .i = !!(x) } }
+
+void	log_site_log(struct log_site *, const char *format, ...);
+void	log_kv_log(struct log_site *, const char *, const struct log_kv *,
+	    uint32_t);
+int	log_ratelimit(struct log_site *, struct log_ratelimit *, uint32_t,
+	    uint32_t);
+int	log_sites_register(struct log_site *, struct log_site *);
+void	log_sites_unregister(struct log_site *);
+
+#ifdef __ELF__
+/*
+ * The linker bounds the log_sites section of each module, the executable
+ * or a shared object, and every file logging registers its module's sites
+ * when the module is loaded.
+ */
+extern struct log_site	__start_log_sites[]
+    __attribute__((weak, visibility("hidden")));
+extern struct log_site	__stop_log_sites[]
+    __attribute__((weak, visibility("hidden")));
+
+static void	log_sites_load(void) __attribute__((constructor, used));
+static void	log_sites_unload(void) __attribute__((destructor, used));
+
+static void
+log_sites_load(void)
+{
+	log_sites_register(__start_log_sites, __stop_log_sites);
+}
+
+static void
+log_sites_unload(void)
+{
+	log_sites_unregister(__start_log_sites);
+}
+
+#define LOG_SITE_DECL(lvl, err)						\
+	static struct log_site log_site_				\
+	    __attribute__((section("log_sites"))) =			\
+	    { __FILE__, __func__, __LINE__, LOG_CAT, lvl, err, 0, 0, 0 }
+
+#define LOG_SITE_ENABLED(lvl)						\
+	((lvl) >= LOG_LEVEL_MIN &&					\
+	    __builtin_expect(__atomic_load_n(&log_site_.on,		\
+	    __ATOMIC_RELAXED), 0))
+#else
+/*
+ * Without the bounds of a section, a call site starts enabled so that it
+ * is added to the list the first time it is reached, which computes
+ * whether it really is. The sites of a file are removed from the list
+ * when the module holding it is unloaded.
+ */
+int	log_site_add(struct log_site *);
+void	log_sites_remove(const void *);
+
+static uint8_t		log_module_;
+
+static void	log_sites_unload(void) __attribute__((destructor, used));
+
+static void
+log_sites_unload(void)
+{
+	log_sites_remove(&log_module_);
+}
+
+#define LOG_SITE_DECL(lvl, err)						\
+	static struct log_site log_site_ =				\
+	    { __FILE__, __func__, __LINE__, LOG_CAT, lvl, err, 0, 0, 1,	\
+	    0, &log_module_, 0 }
+
+#define LOG_SITE_ENABLED(lvl)						\
+	((lvl) >= LOG_LEVEL_MIN &&					\
+	    __builtin_expect(__atomic_load_n(&log_site_.on,		\
+	    __ATOMIC_RELAXED), 0) &&					\
+	    (__atomic_load_n(&log_site_.added, __ATOMIC_ACQUIRE) ||	\
+	    log_site_add(&log_site_)))
+#endif
+
+#define LOG_SITE(lvl, err, ...)						\
+	do {								\
+		LOG_SITE_DECL(lvl, err);				\
+		if (LOG_SITE_ENABLED(lvl))				\
+			log_site_log(&log_site_, __VA_ARGS__);		\
+	} while (0)
+
+/*
+ * The arguments of a record are only evaluated when its call site is
+ * enabled, (log_debug)(...) calls the function, which only follows the
+ * levels of LOG_CAT_DEFAULT.
+ */
+#define log_debug(...)	LOG_SITE(LOG_LVL_DEBUG, 0, __VA_ARGS__)
+#define log_info(...)	LOG_SITE(LOG_LVL_INFO, 0, __VA_ARGS__)
+#define log_warnx(...)	LOG_SITE(LOG_LVL_WARN, 0, __VA_ARGS__)
+#define log_warn(...)	LOG_SITE(LOG_LVL_WARN, 1, __VA_ARGS__)
+
+/*
+ * Writes at most `burst' records of the level lvl per `interval'
+ * milliseconds from this call site, the next record written tells how
+ * many were suppressed meanwhile.
+ */
+#define log_ratelimited(lvl, burst, interval, ...)			\
+	do {								\
+		static struct log_ratelimit log_rl_;			\
+		LOG_SITE_DECL(lvl, 0);					\
+		if (LOG_SITE_ENABLED(lvl) &&				\
+		    log_ratelimit(&log_site_, &log_rl_, burst, interval)) \
+			log_site_log(&log_site_, __VA_ARGS__);		\
+	} while (0)
+
+/*
+ * Writes a structured record, a message followed by typed fields:
+ * log_kv(LOG_LVL_INFO, "peer up", LOG_KV_STR("addr", addr),
+ * LOG_KV_UINT("port", port)).
+ */
+#define log_kv(lvl, msg, ...)						\
+	do {								\
+		LOG_SITE_DECL(lvl, 0);					\
+		if (LOG_SITE_ENABLED(lvl)) {				\
+			const struct log_kv log_kv_[] =			\
+			    { { NULL, 0, { NULL } }, __VA_ARGS__ };	\
+			log_kv_log(&log_site_, msg, log_kv_ + 1,	\
+			    sizeof(log_kv_) / sizeof(log_kv_[0]) - 1);	\
+		}							\
+	} while (0)
+
 #endif
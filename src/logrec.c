@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "logrec.h"
+
+/*
+ * The arguments of a printf format are recorded as raw bytes, in the
+ * order of the format: integers widened to 64 bits after being cast to
+ * their own type, doubles and long doubles as they are, pointers, and
+ * strings as a 16-bit length followed by their bytes. The format itself
+ * isn't recorded, it must still be around to decode the arguments.
+ */
+
+#define LOGREC_SPEC_MAX	32
+#define LOGREC_STR_MAX	1024
+
+/* length modifiers */
+#define LOGREC_LEN_NONE	0
+#define LOGREC_LEN_HH	1
+#define LOGREC_LEN_H	2
+#define LOGREC_LEN_L	3
+#define LOGREC_LEN_LL	4
+#define LOGREC_LEN_J	5
+#define LOGREC_LEN_Z	6
+#define LOGREC_LEN_T	7
+#define LOGREC_LEN_LD	8
+
+struct logrec_spec {
+	const char	*start;		/* the '%' */
+	const char	*mod;		/* the length modifier */
+	int		 star;		/* `*' in the width and precision */
+	int32_t		 prec;		/* -1 without, LOGREC_PREC_STAR */
+	int		 len;
+	char		 conv;
+};
+
+#define LOGREC_PUT(w, end, v) do {					\
+	if ((size_t)((end) - (w)) < sizeof(v))				\
+		return (-1);						\
+	memcpy((w), &(v), sizeof(v));					\
+	(w) += sizeof(v);						\
+} while (0)
+
+#define LOGREC_GET(r, end, v) do {					\
+	if ((size_t)((end) - (r)) < sizeof(v))				\
+		return (-1);						\
+	memcpy(&(v), (r), sizeof(v));					\
+	(r) += sizeof(v);						\
+} while (0)
+
+#define LOGREC_PREC_STAR	-2
+
+static const char	*logrec_parse(const char *, struct logrec_spec *);
+
+/*
+ * Parses the conversion specification starting after a '%'. Returns the
+ * position of the conversion character.
+ */
+const char *
+logrec_parse(const char *p, struct logrec_spec *sp)
+{
+	sp->start = p - 1;
+	sp->star = 0;
+	sp->prec = -1;
+
+	while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+		p++;
+	if (*p == '*') {
+		sp->star++;
+		p++;
+	} else
+		while (*p >= '0' && *p <= '9')
+			p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			sp->star++;
+			sp->prec = LOGREC_PREC_STAR;
+			p++;
+		} else
+			for (sp->prec = 0; *p >= '0' && *p <= '9'; p++)
+				if (sp->prec <= UINT16_MAX)
+					sp->prec = sp->prec * 10 + *p - '0';
+	}
+
+	sp->mod = p;
+	switch (*p) {
+	case 'h':
+		sp->len = p[1] == 'h' ? LOGREC_LEN_HH : LOGREC_LEN_H;
+		p += sp->len == LOGREC_LEN_HH ? 2 : 1;
+		break;
+	case 'l':
+		sp->len = p[1] == 'l' ? LOGREC_LEN_LL : LOGREC_LEN_L;
+		p += sp->len == LOGREC_LEN_LL ? 2 : 1;
+		break;
+	case 'q':
+		sp->len = LOGREC_LEN_LL;
+		p++;
+		break;
+	case 'j':
+		sp->len = LOGREC_LEN_J;
+		p++;
+		break;
+	case 'z':
+		sp->len = LOGREC_LEN_Z;
+		p++;
+		break;
+	case 't':
+		sp->len = LOGREC_LEN_T;
+		p++;
+		break;
+	case 'L':
+		sp->len = LOGREC_LEN_LD;
+		p++;
+		break;
+	default:
+		sp->len = LOGREC_LEN_NONE;
+		break;
+	}
+	sp->conv = *p;
+
+	return (p);
+}
+
+/*
+ * Records the arguments of `format' from `list' into `buf' of `size'
+ * bytes, without formatting them. Returns the number of bytes used. If the
+ * arguments don't fit or the format holds a conversion that can't be
+ * deferred, like %n or wide characters, -1 is returned.
+ */
+int32_t
+logrec_encode(uint8_t *buf, const uint32_t size, const char *format,
+    va_list list)
+{
+	struct logrec_spec	 sp;
+	const char		*p, *str;
+	uint8_t			*w = buf, *end = buf + size;
+	int64_t			 i;
+	uint64_t		 u;
+	int32_t			 star;
+	double			 d;
+	long double		 ld;
+	void			*ptr;
+	uint16_t		 n;
+
+	for (p = format; *p != '\0'; p++) {
+		if (*p != '%')
+			continue;
+		if (*++p == '%')
+			continue;
+
+		p = logrec_parse(p, &sp);
+		while (sp.star-- > 0) {
+			star = va_arg(list, int);
+			LOGREC_PUT(w, end, star);
+		}
+		/* the precision's star is the last, negative it's ignored */
+		if (sp.prec == LOGREC_PREC_STAR)
+			sp.prec = star < 0 ? -1 : star;
+
+		switch (sp.conv) {
+		case 'd':
+		case 'i':
+			switch (sp.len) {
+			case LOGREC_LEN_HH:
+				i = (signed char)va_arg(list, int);
+				break;
+			case LOGREC_LEN_H:
+				i = (short)va_arg(list, int);
+				break;
+			case LOGREC_LEN_L:
+				i = va_arg(list, long);
+				break;
+			case LOGREC_LEN_LL:
+				i = va_arg(list, long long);
+				break;
+			case LOGREC_LEN_J:
+				i = va_arg(list, intmax_t);
+				break;
+			case LOGREC_LEN_Z:
+				i = va_arg(list, ssize_t);
+				break;
+			case LOGREC_LEN_T:
+				i = va_arg(list, ptrdiff_t);
+				break;
+			default:
+				i = va_arg(list, int);
+				break;
+			}
+			LOGREC_PUT(w, end, i);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			switch (sp.len) {
+			case LOGREC_LEN_HH:
+				u = (unsigned char)va_arg(list, unsigned int);
+				break;
+			case LOGREC_LEN_H:
+				u = (unsigned short)va_arg(list, unsigned int);
+				break;
+			case LOGREC_LEN_L:
+				u = va_arg(list, unsigned long);
+				break;
+			case LOGREC_LEN_LL:
+				u = va_arg(list, unsigned long long);
+				break;
+			case LOGREC_LEN_J:
+				u = va_arg(list, uintmax_t);
+				break;
+			case LOGREC_LEN_Z:
+				u = va_arg(list, size_t);
+				break;
+			case LOGREC_LEN_T:
+				u = va_arg(list, ptrdiff_t);
+				break;
+			default:
+				u = va_arg(list, unsigned int);
+				break;
+			}
+			LOGREC_PUT(w, end, u);
+			break;
+		case 'c':
+			if (sp.len != LOGREC_LEN_NONE)
+				return (-1);
+			i = va_arg(list, int);
+			LOGREC_PUT(w, end, i);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (sp.len == LOGREC_LEN_LD) {
+				ld = va_arg(list, long double);
+				LOGREC_PUT(w, end, ld);
+			} else {
+				d = va_arg(list, double);
+				LOGREC_PUT(w, end, d);
+			}
+			break;
+		case 's':
+			if (sp.len != LOGREC_LEN_NONE)
+				return (-1);
+			if ((str = va_arg(list, const char *)) == NULL)
+				str = "(null)";
+			/*
+			 * A string too long is cut to what's left, it needn't
+			 * be terminated past the precision.
+			 */
+			if ((size_t)(end - w) < sizeof(n))
+				return (-1);
+			u = end - w - sizeof(n) < UINT16_MAX ?
+			    end - w - sizeof(n) : UINT16_MAX;
+			if (sp.prec >= 0 && (uint64_t)sp.prec < u)
+				u = sp.prec;
+			n = strnlen(str, u);
+			LOGREC_PUT(w, end, n);
+			memcpy(w, str, n);
+			w += n;
+			break;
+		case 'p':
+			ptr = va_arg(list, void *);
+			LOGREC_PUT(w, end, ptr);
+			break;
+		default:
+			return (-1);
+		}
+	}
+
+	return (w - buf);
+}
+
+/*
+ * Formats the arguments recorded by logrec_encode() with their `format'
+ * into `out' of `size' bytes, always terminated. Returns the length
+ * written. If the arguments don't match the format, -1 is returned.
+ */
+int32_t
+logrec_decode(char *out, const uint32_t size, const char *format,
+    const uint8_t *args, const uint32_t len)
+{
+	struct logrec_spec	 sp;
+	const uint8_t		*r = args, *end = args + len;
+	const char		*p;
+	char			 spec[LOGREC_SPEC_MAX];
+	char			 str[LOGREC_STR_MAX];
+	int32_t			 star[2];
+	int64_t			 i;
+	uint64_t		 u;
+	double			 d;
+	long double		 ld;
+	void			*ptr;
+	uint32_t		 o = 0;
+	uint16_t		 n;
+	int			 k, ns, w;
+
+	if (size == 0)
+		return (-1);
+
+#define LOGREC_PRINT(v)							\
+	(ns == 0 ? snprintf(out + o, size - o, spec, (v)) :		\
+	ns == 1 ? snprintf(out + o, size - o, spec, star[0], (v)) :	\
+	snprintf(out + o, size - o, spec, star[0], star[1], (v)))
+
+	for (p = format; *p != '\0' && o < size - 1; p++) {
+		if (*p != '%') {
+			out[o++] = *p;
+			continue;
+		}
+		if (p[1] == '%') {
+			out[o++] = *++p;
+			continue;
+		}
+
+		p = logrec_parse(p + 1, &sp);
+		for (ns = 0; ns < sp.star; ns++)
+			LOGREC_GET(r, end, star[ns]);
+
+		/* the length modifier is replaced by the recorded width */
+		k = sp.mod - sp.start;
+		if (k + 4 > LOGREC_SPEC_MAX)
+			return (-1);
+		memcpy(spec, sp.start, k);
+
+		switch (sp.conv) {
+		case 'd':
+		case 'i':
+			LOGREC_GET(r, end, i);
+			spec[k++] = 'l';
+			spec[k++] = 'l';
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			w = LOGREC_PRINT((long long)i);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			LOGREC_GET(r, end, u);
+			spec[k++] = 'l';
+			spec[k++] = 'l';
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			w = LOGREC_PRINT((unsigned long long)u);
+			break;
+		case 'c':
+			LOGREC_GET(r, end, i);
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			w = LOGREC_PRINT((int)i);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (sp.len == LOGREC_LEN_LD) {
+				LOGREC_GET(r, end, ld);
+				spec[k++] = 'L';
+				spec[k++] = sp.conv;
+				spec[k] = '\0';
+				w = LOGREC_PRINT(ld);
+			} else {
+				LOGREC_GET(r, end, d);
+				spec[k++] = sp.conv;
+				spec[k] = '\0';
+				w = LOGREC_PRINT(d);
+			}
+			break;
+		case 's':
+			LOGREC_GET(r, end, n);
+			if ((uint32_t)(end - r) < n)
+				return (-1);
+			memcpy(str, r, n < sizeof(str) ? n : sizeof(str) - 1);
+			str[n < sizeof(str) ? n : sizeof(str) - 1] = '\0';
+			r += n;
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			w = LOGREC_PRINT(str);
+			break;
+		case 'p':
+			LOGREC_GET(r, end, ptr);
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			w = LOGREC_PRINT(ptr);
+			break;
+		default:
+			return (-1);
+		}
+
+		if (w > 0)
+			o += (uint32_t)w < size - o ? (uint32_t)w : size - o - 1;
+	}
+	out[o] = '\0';
+
+#undef LOGREC_PRINT
+
+	return (o);
+}
@@ -0,0 +1,554 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inet.h"
+#include "log.h"
+#include "lpm.h"
+
+/*
+ * A multibit trie with a wide root, DIR-24-8 for IPv4 and 16 then eight
+ * bit strides for IPv6. Every prefix is expanded to the entries it covers
+ * so a lookup is one load per level, IPv4 needs at most two.
+ *
+ * An entry is 32 bits, written with a single atomic store:
+ *
+ *	31	valid
+ *	30	extended, the value is the index of a group of 256 entries
+ *	22-29	depth of the prefix the entry was expanded from
+ *	0-21	next hop or group
+ *
+ * Updates are done by a single writer while readers go on without locks.
+ * A group is filled before the entry pointing to it is published, and a
+ * group released by a delete is only recycled by lpm_reclaim(), which the
+ * writer calls once no reader can still be walking it.
+ */
+#define LPM_VALID	0x80000000U
+#define LPM_EXT		0x40000000U
+#define LPM_DEPTH(e)	(((e) >> 22) & 0xff)
+#define LPM_VALUE(e)	((e) & 0x3fffff)
+#define LPM_ENTRY(d, v)	(LPM_VALID | (uint32_t)(d) << 22 | (v))
+
+#define LPM_GROUP	256
+
+struct lpm_rule {
+	uint8_t		addr[16];
+	uint32_t	nh;
+	uint8_t		depth;
+	uint8_t		used;
+};
+
+struct lpm {
+	uint32_t	*root;
+	uint32_t	*grp;		/* n_grp * LPM_GROUP entries */
+	uint32_t	*free_grp;	/* stack of free groups */
+	uint32_t	*retired;	/* released, waiting for lpm_reclaim() */
+	uint32_t	 n_grp;
+	uint32_t	 n_free;
+	uint32_t	 n_retired;
+	uint8_t		 alen;		/* address length in bytes */
+	uint8_t		 root_bits;
+	struct lpm_rule	*rule;		/* open addressing, for deletes */
+	uint32_t	 rule_mask;
+	uint32_t	 n_rule;
+};
+
+static void		 lpm_mask(uint8_t *, const uint8_t *, uint8_t, uint8_t);
+static uint32_t		 lpm_rule_hash(const uint8_t *, uint8_t);
+static struct lpm_rule	*lpm_rule_find(const lpm *, const uint8_t *, uint8_t);
+static int		 lpm_rule_grow(lpm *);
+static void		 lpm_rule_del(lpm *, struct lpm_rule *);
+static uint32_t		 lpm_index(const lpm *, const uint8_t *, uint32_t);
+static void		 lpm_fill(lpm *, uint32_t *, uint32_t, uint32_t, uint32_t,
+			    uint8_t);
+static void		 lpm_replace(lpm *, uint32_t *, uint32_t, uint32_t, uint8_t,
+			    uint32_t);
+static void		 lpm_retire(lpm *, uint32_t);
+
+static inline void
+lpm_store(uint32_t *e, uint32_t v)
+{
+	__atomic_store_n(e, v, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t
+lpm_load(const uint32_t *e)
+{
+	return (__atomic_load_n(e, __ATOMIC_ACQUIRE));
+}
+
+void
+lpm_mask(uint8_t *dst, const uint8_t *addr, uint8_t alen, uint8_t depth)
+{
+	uint8_t	i;
+
+	memset(dst, 0, 16);
+	for (i = 0; i < alen && depth; i++) {
+		if (depth >= 8) {
+			dst[i] = addr[i];
+			depth -= 8;
+		} else {
+			dst[i] = addr[i] & (0xff << (8 - depth));
+			depth = 0;
+		}
+	}
+}
+
+uint32_t
+lpm_rule_hash(const uint8_t *addr, uint8_t depth)
+{
+	uint64_t	a, b;
+
+	memcpy(&a, addr, 8);
+	memcpy(&b, addr + 8, 8);
+	return (inet_macaddr_hash(a ^ (b * 0x9e3779b97f4a7c15ULL) ^ depth));
+}
+
+struct lpm_rule *
+lpm_rule_find(const lpm *t, const uint8_t *addr, uint8_t depth)
+{
+	struct lpm_rule	*r;
+	uint32_t	 i;
+
+	i = lpm_rule_hash(addr, depth) & t->rule_mask;
+	for (;; i = (i + 1) & t->rule_mask) {
+		r = &t->rule[i];
+		if (!r->used)
+			return (r);
+		if (r->depth == depth && memcmp(r->addr, addr, 16) == 0)
+			return (r);
+	}
+}
+
+int
+lpm_rule_grow(lpm *t)
+{
+	struct lpm_rule	*old, *r;
+	uint32_t	 i, n;
+
+	old = t->rule;
+	n = t->rule_mask + 1;
+	if ((t->rule = calloc(n * 2, sizeof(*t->rule))) == NULL) {
+		t->rule = old;
+		return (-1);
+	}
+	t->rule_mask = n * 2 - 1;
+
+	for (i = 0; i < n; i++) {
+		if (!old[i].used)
+			continue;
+		r = lpm_rule_find(t, old[i].addr, old[i].depth);
+		*r = old[i];
+	}
+	free(old);
+
+	return (0);
+}
+
+/* backward shift deletion, keeps the probe sequences without tombstones */
+void
+lpm_rule_del(lpm *t, struct lpm_rule *r)
+{
+	uint32_t	i, j, home;
+
+	i = r - t->rule;
+	for (j = (i + 1) & t->rule_mask; t->rule[j].used;
+	    j = (j + 1) & t->rule_mask) {
+		home = lpm_rule_hash(t->rule[j].addr, t->rule[j].depth) &
+		    t->rule_mask;
+		if (((j - home) & t->rule_mask) >= ((j - i) & t->rule_mask)) {
+			t->rule[i] = t->rule[j];
+			i = j;
+		}
+	}
+	t->rule[i].used = 0;
+	t->n_rule--;
+}
+
+/* Returns the index of `addr' within the table of trie level `level'. */
+uint32_t
+lpm_index(const lpm *t, const uint8_t *addr, uint32_t level)
+{
+	if (level > 0)
+		return (addr[t->root_bits / 8 + level - 1]);
+	if (t->root_bits == 24)
+		return (addr[0] << 16 | addr[1] << 8 | addr[2]);
+	return (addr[0] << 8 | addr[1]);
+}
+
+/*
+ * Writes the entry `e' of depth `depth' over the entries [lo, hi) of
+ * `tbl' unless a longer prefix owns them, and down into the groups below.
+ */
+void
+lpm_fill(lpm *t, uint32_t *tbl, uint32_t lo, uint32_t hi, uint32_t e,
+    uint8_t depth)
+{
+	uint32_t	i, cur;
+
+	for (i = lo; i < hi; i++) {
+		cur = tbl[i];
+		if (cur & LPM_EXT)
+			lpm_fill(t, &t->grp[LPM_VALUE(cur) * LPM_GROUP], 0,
+			    LPM_GROUP, e, depth);
+		else if (!(cur & LPM_VALID) || LPM_DEPTH(cur) <= depth)
+			lpm_store(&tbl[i], e);
+	}
+}
+
+/*
+ * Writes the entry `e' over the entries [lo, hi) of `tbl', and the groups
+ * below, that were expanded from a prefix of depth `depth'.
+ */
+void
+lpm_replace(lpm *t, uint32_t *tbl, uint32_t lo, uint32_t hi, uint8_t depth,
+    uint32_t e)
+{
+	uint32_t	i, cur;
+
+	for (i = lo; i < hi; i++) {
+		cur = tbl[i];
+		if (cur & LPM_EXT)
+			lpm_replace(t, &t->grp[LPM_VALUE(cur) * LPM_GROUP], 0,
+			    LPM_GROUP, depth, e);
+		else if ((cur & LPM_VALID) && LPM_DEPTH(cur) == depth)
+			lpm_store(&tbl[i], e);
+	}
+}
+
+void
+lpm_retire(lpm *t, uint32_t g)
+{
+	t->retired[t->n_retired++] = g;
+}
+
+/*
+ * Creates an empty table for `ip_ver' 4 or 6 addresses. Prefixes longer
+ * than the root stride use groups of 256 entries, `n_grp' of them at
+ * most. If an error occurs, NULL is returned.
+ */
+lpm *
+lpm_new(const uint8_t ip_ver, const uint32_t n_grp)
+{
+	lpm		*t;
+	uint32_t	 i;
+
+	if ((ip_ver != 4 && ip_ver != 6) || n_grp > LPM_NH_MAX + 1) {
+		log_warnx("%s: invalid parameters", __func__);
+		return (NULL);
+	}
+
+	if ((t = calloc(1, sizeof(*t))) == NULL) {
+		log_warn("%s: calloc", __func__);
+		return (NULL);
+	}
+
+	t->alen = ip_ver == 4 ? 4 : 16;
+	t->root_bits = ip_ver == 4 ? 24 : 16;
+	t->n_grp = n_grp;
+	t->rule_mask = 63;
+
+	if ((t->root = calloc(1U << t->root_bits, sizeof(*t->root))) == NULL ||
+	    (t->rule = calloc(t->rule_mask + 1, sizeof(*t->rule))) == NULL) {
+		log_warn("%s: calloc", __func__);
+		goto error;
+	}
+
+	if (n_grp) {
+		if ((t->grp = malloc((size_t)n_grp * LPM_GROUP *
+		    sizeof(*t->grp))) == NULL ||
+		    (t->free_grp = malloc(n_grp * sizeof(uint32_t))) == NULL ||
+		    (t->retired = malloc(n_grp * sizeof(uint32_t))) == NULL) {
+			log_warn("%s: malloc", __func__);
+			goto error;
+		}
+		for (i = 0; i < n_grp; i++)
+			t->free_grp[i] = n_grp - 1 - i;
+		t->n_free = n_grp;
+	}
+
+	return (t);
+
+error:
+	lpm_free(t);
+	return (NULL);
+}
+
+void
+lpm_free(lpm *t)
+{
+	if (t == NULL)
+		return;
+
+	free(t->root);
+	free(t->grp);
+	free(t->free_grp);
+	free(t->retired);
+	free(t->rule);
+	free(t);
+}
+
+/*
+ * Routes the prefix `addr'/`depth' to the next hop `nh', `addr' being in
+ * network order. An existing route for the same prefix is replaced. If an
+ * error occurs, -1 is returned.
+ */
+int32_t
+lpm_add(lpm *t, const uint8_t *addr, const uint8_t depth, const uint32_t nh)
+{
+	struct lpm_rule	*r;
+	uint8_t		 key[16];
+	uint32_t	*tbl, *g, idx, cur, span, level, end, e, i, j;
+
+	if (depth > t->alen * 8 || nh > LPM_NH_MAX) {
+		log_warnx("%s: invalid route", __func__);
+		return (-1);
+	}
+
+	lpm_mask(key, addr, t->alen, depth);
+	e = LPM_ENTRY(depth, nh);
+
+	/* walk down to the level holding the prefix, splitting the entries
+	 * on the way into groups that inherit their route */
+	tbl = t->root;
+	end = t->root_bits;
+	idx = lpm_index(t, key, 0);
+	for (level = 1; depth > end; level++) {
+		cur = tbl[idx];
+		if (!(cur & LPM_EXT)) {
+			if (t->n_free == 0) {
+				log_warnx("%s: out of groups", __func__);
+				return (-1);
+			}
+			i = t->free_grp[--t->n_free];
+			g = &t->grp[i * LPM_GROUP];
+			for (j = 0; j < LPM_GROUP; j++)
+				g[j] = cur;
+			lpm_store(&tbl[idx], LPM_EXT | i);
+			cur = LPM_EXT | i;
+		}
+		tbl = &t->grp[LPM_VALUE(cur) * LPM_GROUP];
+		idx = lpm_index(t, key, level);
+		end += 8;
+	}
+
+	span = 1U << (end - depth);
+	idx &= ~(span - 1);
+	lpm_fill(t, tbl, idx, idx + span, e, depth);
+
+	r = lpm_rule_find(t, key, depth);
+	if (!r->used) {
+		memcpy(r->addr, key, 16);
+		r->depth = depth;
+		r->used = 1;
+		t->n_rule++;
+	}
+	r->nh = nh;
+
+	/* keep the rules at most half full, a failure only costs probes */
+	if (t->n_rule * 2 > t->rule_mask && lpm_rule_grow(t) < 0)
+		log_warn("%s: calloc", __func__);
+
+	return (0);
+}
+
+/*
+ * Removes the route of the prefix `addr'/`depth', its addresses fall back
+ * to the longest shorter prefix covering them. If the route doesn't
+ * exist, -1 is returned.
+ */
+int32_t
+lpm_del(lpm *t, const uint8_t *addr, const uint8_t depth)
+{
+	struct lpm_rule	*r, *cover;
+	uint8_t		 key[16], up[16];
+	uint32_t	*path[17], pidx[17];
+	uint32_t	*tbl, *g, idx, cur, span, level, end, e, i;
+	int		 d;
+
+	if (depth > t->alen * 8)
+		return (-1);
+
+	lpm_mask(key, addr, t->alen, depth);
+	r = lpm_rule_find(t, key, depth);
+	if (!r->used)
+		return (-1);
+	lpm_rule_del(t, r);
+
+	/* the entries go to the covering route, or become invalid */
+	e = 0;
+	for (d = depth - 1; d >= 0; d--) {
+		lpm_mask(up, key, t->alen, d);
+		cover = lpm_rule_find(t, up, d);
+		if (cover->used) {
+			e = LPM_ENTRY(d, cover->nh);
+			break;
+		}
+	}
+
+	tbl = t->root;
+	end = t->root_bits;
+	idx = lpm_index(t, key, 0);
+	for (level = 1; depth > end; level++) {
+		cur = tbl[idx];
+		if (!(cur & LPM_EXT))
+			return (0);
+		path[level] = tbl;
+		pidx[level] = idx;
+		tbl = &t->grp[LPM_VALUE(cur) * LPM_GROUP];
+		idx = lpm_index(t, key, level);
+		end += 8;
+	}
+
+	span = 1U << (end - depth);
+	idx &= ~(span - 1);
+	lpm_replace(t, tbl, idx, idx + span, depth, e);
+
+	/* fold back the groups left uniform, deepest first, as long as the
+	 * route they hold is short enough to live in the level above */
+	while (--level > 0) {
+		g = tbl;
+		for (i = 1; i < LPM_GROUP; i++)
+			if (g[i] != g[0])
+				break;
+		if (i < LPM_GROUP || (g[0] & LPM_EXT) || ((g[0] & LPM_VALID) &&
+		    LPM_DEPTH(g[0]) > t->root_bits + 8 * (level - 1)))
+			break;
+		tbl = path[level];
+		cur = tbl[pidx[level]];
+		lpm_store(&tbl[pidx[level]], g[0]);
+		lpm_retire(t, LPM_VALUE(cur));
+	}
+
+	return (0);
+}
+
+/*
+ * Makes the groups released by the deletes available again. The caller
+ * must make sure no lookup started before the deletes is still running.
+ */
+void
+lpm_reclaim(lpm *t)
+{
+	while (t->n_retired)
+		t->free_grp[t->n_free++] = t->retired[--t->n_retired];
+}
+
+/*
+ * Returns the next hop of the address `addr', in network order. If no
+ * route matches, LPM_MISS is returned.
+ */
+uint32_t
+lpm_lookup(const lpm *t, const uint8_t *addr)
+{
+	uint32_t	e, level;
+
+	e = lpm_load(&t->root[lpm_index(t, addr, 0)]);
+	for (level = 1; e & LPM_EXT; level++)
+		e = lpm_load(&t->grp[LPM_VALUE(e) * LPM_GROUP +
+		    addr[t->root_bits / 8 + level - 1]]);
+
+	return (e & LPM_VALID ? LPM_VALUE(e) : LPM_MISS);
+}
+
+/*
+ * Returns the next hop of the IPv4 address `ip', in host order, the way
+ * inet_parse() leaves them. If no route matches, LPM_MISS is returned.
+ */
+uint32_t
+lpm4_lookup(const lpm *t, const uint32_t ip)
+{
+	uint32_t	e;
+
+	e = lpm_load(&t->root[ip >> 8]);
+	if (e & LPM_EXT)
+		e = lpm_load(&t->grp[LPM_VALUE(e) * LPM_GROUP + (ip & 0xff)]);
+
+	return (e & LPM_VALID ? LPM_VALUE(e) : LPM_MISS);
+}
+
+/*
+ * Looks up `n' IPv4 addresses, in host order, into `nh'. The root entries
+ * are prefetched first so their cache misses overlap.
+ */
+void
+lpm4_lookup_burst(const lpm *t, const uint32_t *ip, uint32_t *nh,
+    const uint32_t n)
+{
+	uint32_t	i, e;
+
+	for (i = 0; i < n; i++)
+		__builtin_prefetch(&t->root[ip[i] >> 8]);
+
+	for (i = 0; i < n; i++) {
+		e = lpm_load(&t->root[ip[i] >> 8]);
+		nh[i] = e;
+		if (e & LPM_EXT)
+			__builtin_prefetch(&t->grp[LPM_VALUE(e) * LPM_GROUP +
+			    (ip[i] & 0xff)]);
+	}
+
+	for (i = 0; i < n; i++) {
+		e = nh[i];
+		if (e & LPM_EXT)
+			e = lpm_load(&t->grp[LPM_VALUE(e) * LPM_GROUP +
+			    (ip[i] & 0xff)]);
+		nh[i] = e & LPM_VALID ? LPM_VALUE(e) : LPM_MISS;
+	}
+}
+
+/*
+ * Looks up `n' IPv6 addresses into `nh', walking the tries level by level
+ * across the burst rather than address by address.
+ */
+void
+lpm6_lookup_burst(const lpm *t, const uint8_t (*addr)[16], uint32_t *nh,
+    const uint32_t n)
+{
+	uint32_t	i, e, level, more;
+
+	for (i = 0; i < n; i++)
+		__builtin_prefetch(&t->root[addr[i][0] << 8 | addr[i][1]]);
+
+	more = 0;
+	for (i = 0; i < n; i++) {
+		nh[i] = lpm_load(&t->root[addr[i][0] << 8 | addr[i][1]]);
+		more |= nh[i] & LPM_EXT;
+	}
+
+	for (level = 2; more && level < 16; level++) {
+		for (i = 0; i < n; i++)
+			if (nh[i] & LPM_EXT)
+				__builtin_prefetch(&t->grp[LPM_VALUE(nh[i]) *
+				    LPM_GROUP + addr[i][level]]);
+		more = 0;
+		for (i = 0; i < n; i++) {
+			if (!(nh[i] & LPM_EXT))
+				continue;
+			nh[i] = lpm_load(&t->grp[LPM_VALUE(nh[i]) * LPM_GROUP +
+			    addr[i][level]]);
+			more |= nh[i] & LPM_EXT;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		e = nh[i];
+		nh[i] = e & LPM_VALID ? LPM_VALUE(e) : LPM_MISS;
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LPM_H
+#define LPM_H
+
+#include <stdint.h>
+
+#define LPM_MISS	UINT32_MAX
+#define LPM_NH_MAX	0x3fffff	/* next hops are 22 bits */
+
+typedef struct lpm lpm;
+
+lpm		*lpm_new(const uint8_t, const uint32_t);
+void		 lpm_free(lpm *);
+int32_t		 lpm_add(lpm *, const uint8_t *, const uint8_t, const uint32_t);
+int32_t		 lpm_del(lpm *, const uint8_t *, const uint8_t);
+void		 lpm_reclaim(lpm *);
+uint32_t	 lpm_lookup(const lpm *, const uint8_t *);
+uint32_t	 lpm4_lookup(const lpm *, const uint32_t);
+void		 lpm4_lookup_burst(const lpm *, const uint32_t *, uint32_t *, const uint32_t);
+void		 lpm6_lookup_burst(const lpm *, const uint8_t (*)[16], uint32_t *, const uint32_t);
+
+#endif
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fbuf.h"
+#include "inet.h"
+#include "log.h"
+#include "pcapng.h"
+
+#define PCAPNG_SHB		0x0a0d0d0a
+#define PCAPNG_IDB		0x00000001
+#define PCAPNG_EPB		0x00000006
+#define PCAPNG_MAGIC		0x1a2b3c4d
+#define PCAPNG_LINKTYPE_ETH	1
+#define PCAPNG_OPT_TSRESOL	9
+#define PCAPNG_EPB_HDRLEN	28	/* block header up to the packet data */
+#define PCAPNG_IF_MAX		16
+#define PCAPNG_TSRESOL_DEC_MAX	19	/* 10^-19 s, 10^19 fits in 64 bits */
+#define PCAPNG_TSRESOL_BIN_MAX	63	/* 2^-63 s */
+#define PCAPNG_TSRESOL_VALID(r)	((r) & 0x80 ?				\
+	((r) & 0x7f) <= PCAPNG_TSRESOL_BIN_MAX : (r) <= PCAPNG_TSRESOL_DEC_MAX)
+#define PCAPNG_CHUNK		(4 * 1024 * 1024)
+
+/*
+ * The capture file is written through a shared mapping that slides forward
+ * by chunks, the file is grown ahead of the writes and trimmed on close.
+ * Frames are copied in the mapping and the kernel writes back the pages
+ * in the background, no syscall is made per frame.
+ */
+struct pcapng_writer {
+	int		 fd;
+	uint8_t		*map;
+	uint64_t	 base;		/* file offset of the mapping */
+	size_t		 pos;		/* write offset in the mapping */
+	size_t		 pgsz;
+	uint32_t	 snaplen;
+	uint64_t	 limit;
+	uint64_t	 drops;
+};
+
+static int32_t	 pcapng_reserve(pcapng_writer *, size_t);
+static void	 pcapng_put_epb(pcapng_writer *, const void *, uint32_t, uint64_t);
+static uint64_t	 pcapng_now(void);
+static uint64_t	 pcapng_ts_ns(uint64_t, uint8_t);
+static void	 pcapng_sleep_until(const struct timespec *);
+
+uint64_t
+pcapng_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Makes sure `need' bytes can be written at the current position, sliding
+ * the mapping forward if required. If the capture reached its size limit or
+ * an error occurs, -1 is returned.
+ */
+int32_t
+pcapng_reserve(pcapng_writer *w, size_t need)
+{
+	size_t	skip;
+
+	if (w->limit && w->base + w->pos + need > w->limit)
+		return (-1);
+
+	if (w->map && w->pos + need <= PCAPNG_CHUNK)
+		return (0);
+
+	if (w->map) {
+		munmap(w->map, PCAPNG_CHUNK);
+		skip = w->pos & ~(w->pgsz - 1);
+		w->base += skip;
+		w->pos -= skip;
+		w->map = NULL;
+	}
+
+	if (ftruncate(w->fd, w->base + PCAPNG_CHUNK) < 0) {
+		log_warn("%s: ftruncate", __func__);
+		return (-1);
+	}
+
+	if ((w->map = mmap(NULL, PCAPNG_CHUNK, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, w->fd, w->base)) == MAP_FAILED) {
+		log_warn("%s: mmap", __func__);
+		w->map = NULL;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Creates a capture file holding a single ethernet interface with a
+ * nanosecond time resolution. Frames are truncated to `snaplen' bytes, and
+ * the file stops growing at `limit' bytes, 0 meaning no limit. If an error
+ * occurs, NULL is returned.
+ */
+pcapng_writer *
+pcapng_writer_open(const char *path, const uint32_t snaplen, const uint64_t limit)
+{
+	pcapng_writer	*w;
+	uint32_t	*p;
+
+	if ((w = calloc(1, sizeof(*w))) == NULL)
+		return (NULL);
+
+	w->snaplen = snaplen ? snaplen : 65535;
+	w->limit = limit;
+	w->pgsz = sysconf(_SC_PAGESIZE);
+
+	if ((w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+		log_warn("%s: open %s", __func__, path);
+		free(w);
+		return (NULL);
+	}
+
+	if (pcapng_reserve(w, 28 + 32) < 0) {
+		close(w->fd);
+		free(w);
+		return (NULL);
+	}
+
+	/* section header block */
+	p = (uint32_t *)(w->map + w->pos);
+	p[0] = PCAPNG_SHB;
+	p[1] = 28;
+	p[2] = PCAPNG_MAGIC;
+	p[3] = 1;			/* major 1, minor 0 */
+	p[4] = p[5] = 0xffffffff;	/* unspecified section length */
+	p[6] = 28;
+	w->pos += 28;
+
+	/* interface description block, if_tsresol = 10^-9 */
+	p = (uint32_t *)(w->map + w->pos);
+	p[0] = PCAPNG_IDB;
+	p[1] = 32;
+	p[2] = PCAPNG_LINKTYPE_ETH;
+	p[3] = w->snaplen;
+	p[4] = PCAPNG_OPT_TSRESOL | 1 << 16;
+	p[5] = 9;
+	p[6] = 0;			/* opt_endofopt */
+	p[7] = 32;
+	w->pos += 32;
+
+	return (w);
+}
+
+void
+pcapng_put_epb(pcapng_writer *w, const void *frame, uint32_t len, uint64_t ts)
+{
+	uint32_t	*p, caplen, blklen;
+
+	caplen = len < w->snaplen ? len : w->snaplen;
+	blklen = PCAPNG_EPB_HDRLEN + ((caplen + 3) & ~3) + 4;
+
+	if (pcapng_reserve(w, blklen) < 0) {
+		w->drops++;
+		return;
+	}
+
+	p = (uint32_t *)(w->map + w->pos);
+	p[0] = PCAPNG_EPB;
+	p[1] = blklen;
+	p[2] = 0;			/* interface id */
+	p[3] = ts >> 32;
+	p[4] = (uint32_t)ts;
+	p[5] = caplen;
+	p[6] = len;
+	memcpy(&p[7], frame, caplen);
+	memset((uint8_t *)&p[7] + caplen, 0, ((caplen + 3) & ~3) - caplen);
+	*(uint32_t *)((uint8_t *)p + blklen - 4) = blklen;
+	w->pos += blklen;
+}
+
+/*
+ * Records one frame. If the frame couldn't be written, it is counted as a
+ * drop and -1 is returned.
+ */
+int32_t
+pcapng_write(pcapng_writer *w, const void *frame, const uint32_t len)
+{
+	uint64_t	drops = w->drops;
+
+	pcapng_put_epb(w, frame, len, pcapng_now());
+
+	return (drops == w->drops ? 0 : -1);
+}
+
+/*
+ * Records a burst of frames, they all share the timestamp of the burst so
+ * the clock is read once. Returns the number of frames written.
+ */
+int32_t
+pcapng_write_burst(pcapng_writer *w, struct fbuf **fb, const uint32_t n)
+{
+	uint64_t	ts, drops = w->drops;
+	uint32_t	i;
+
+	ts = pcapng_now();
+	for (i = 0; i < n; i++)
+		pcapng_put_epb(w, fb[i]->data, fb[i]->len, ts);
+
+	return (n - (w->drops - drops));
+}
+
+uint64_t
+pcapng_writer_drops(const pcapng_writer *w)
+{
+	return (w->drops);
+}
+
+/*
+ * Trims the file to what was written and closes it. If an error occurs,
+ * -1 is returned.
+ */
+int32_t
+pcapng_writer_close(pcapng_writer *w)
+{
+	int32_t	ret = 0;
+
+	if (w == NULL)
+		return (0);
+
+	if (w->map)
+		munmap(w->map, PCAPNG_CHUNK);
+	if (ftruncate(w->fd, w->base + w->pos) < 0)
+		ret = -1;
+	if (close(w->fd) < 0)
+		ret = -1;
+	free(w);
+
+	return (ret);
+}
+
+/*
+ * Converts a timestamp expressed in the if_tsresol unit of its interface
+ * to nanoseconds, saturated. Any if_tsresol is safe, a unit too small
+ * gives 0.
+ */
+uint64_t
+pcapng_ts_ns(uint64_t ts, uint8_t tsresol)
+{
+	uint8_t		e = tsresol & 0x7f;
+	uint64_t	m = 1, hi, lo, mid;
+
+	if (tsresol & 0x80) {
+		if (e > PCAPNG_TSRESOL_BIN_MAX)
+			return (0);
+		/* ts * 10^9 on 128 bits, hi:lo, from the halves of ts */
+		lo = (ts & 0xffffffff) * 1000000000;
+		mid = (ts >> 32) * 1000000000;
+		hi = mid >> 32;
+		mid <<= 32;
+		lo += mid;
+		hi += lo < mid;
+		if (e == 0)
+			return (hi != 0 ? UINT64_MAX : lo);
+		if (hi >> e != 0)
+			return (UINT64_MAX);
+		return (hi << (64 - e) | lo >> e);
+	}
+
+	if (e <= 9) {
+		while (e++ < 9)
+			m *= 10;
+		return (ts > UINT64_MAX / m ? UINT64_MAX : ts * m);
+	}
+	/* 10^(e - 9) is then larger than any timestamp */
+	if (e > PCAPNG_TSRESOL_DEC_MAX + 9)
+		return (0);
+	while (e-- > 9)
+		m *= 10;
+	return (ts / m);
+}
+
+/*
+ * Sleeps until the CLOCK_MONOTONIC time `due'. The delay is relative, as
+ * not every system has clock_nanosleep().
+ */
+void
+pcapng_sleep_until(const struct timespec *due)
+{
+	struct timespec	now, d;
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		d.tv_sec = due->tv_sec - now.tv_sec;
+		d.tv_nsec = due->tv_nsec - now.tv_nsec;
+		if (d.tv_nsec < 0) {
+			d.tv_sec--;
+			d.tv_nsec += 1000000000;
+		}
+		if (d.tv_sec < 0 || (d.tv_sec == 0 && d.tv_nsec == 0))
+			return;
+		if (nanosleep(&d, NULL) == 0 || errno != EINTR)
+			return;
+	}
+}
+
+/*
+ * Feeds every frame of a capture file to `cb', parsed and classified by
+ * inet_parse(). Frames are replayed as fast as possible, or spaced as they
+ * were recorded with PCAPNG_REPLAY_TIMED. The timestamp handed to `cb' is
+ * in nanoseconds. Returns the number of frames replayed, or -1 if the file
+ * can't be read.
+ */
+int64_t
+pcapng_replay(const char *path, const uint32_t flags,
+    void (*cb)(const struct inet_frame *, uint64_t, void *), void *arg)
+{
+	struct inet_frame	 f;
+	struct timespec		 start, due;
+	struct stat		 st;
+	const uint8_t		*map, *blk, *opt;
+	uint64_t		 off, ts, ts0 = 0, gap;
+	uint32_t		 type, len, caplen, ifid, n_if = 0, olen;
+	uint8_t			 tsresol[PCAPNG_IF_MAX];
+	int64_t			 count = 0;
+	int			 fd, swap = 0;
+
+#define RD32(p)	(swap ? __builtin_bswap32(*(const uint32_t *)(p)) : \
+		    *(const uint32_t *)(p))
+#define RD16(p)	(swap ? __builtin_bswap16(*(const uint16_t *)(p)) : \
+		    *(const uint16_t *)(p))
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		log_warn("%s: open %s", __func__, path);
+		return (-1);
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < 28) {
+		close(fd);
+		return (-1);
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_warn("%s: mmap", __func__);
+		return (-1);
+	}
+	madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (off = 0; off + 12 <= (uint64_t)st.st_size; off += len) {
+		blk = map + off;
+		type = *(const uint32_t *)blk;
+		if (type == PCAPNG_SHB) {
+			swap = *(const uint32_t *)(blk + 8) != PCAPNG_MAGIC;
+			n_if = 0;
+		}
+		len = RD32(blk + 4);
+		if (len < 12 || (len & 3) || off + len > (uint64_t)st.st_size) {
+			log_warnx("%s: %s: truncated block", __func__, path);
+			break;
+		}
+
+		switch (RD32(blk)) {
+		case PCAPNG_IDB:
+			if (n_if == PCAPNG_IF_MAX)
+				break;
+			tsresol[n_if] = 6;
+			for (opt = blk + 16; opt + 4 <= blk + len - 4;
+			    opt += 4 + ((olen + 3) & ~3)) {
+				olen = RD16(opt + 2);
+				if (RD16(opt) == 0)
+					break;
+				if (RD16(opt) != PCAPNG_OPT_TSRESOL || olen != 1)
+					continue;
+				if (!PCAPNG_TSRESOL_VALID(opt[4]))
+					log_warnx("%s: %s: invalid if_tsresol %u",
+					    __func__, path, opt[4]);
+				else
+					tsresol[n_if] = opt[4];
+			}
+			n_if++;
+			break;
+		case PCAPNG_EPB:
+			if (len < PCAPNG_EPB_HDRLEN + 4)
+				break;
+			ifid = RD32(blk + 8);
+			caplen = RD32(blk + 20);
+			if (ifid >= n_if || caplen > len - PCAPNG_EPB_HDRLEN - 4)
+				break;
+			ts = pcapng_ts_ns((uint64_t)RD32(blk + 12) << 32 |
+			    RD32(blk + 16), tsresol[ifid]);
+
+			if (flags & PCAPNG_REPLAY_TIMED) {
+				if (count == 0)
+					ts0 = ts;
+				gap = ts > ts0 ? ts - ts0 : 0;
+				due.tv_sec = start.tv_sec + gap / 1000000000;
+				due.tv_nsec = start.tv_nsec + gap % 1000000000;
+				if (due.tv_nsec >= 1000000000) {
+					due.tv_sec++;
+					due.tv_nsec -= 1000000000;
+				}
+				pcapng_sleep_until(&due);
+			}
+
+			if (inet_parse(&f, blk + PCAPNG_EPB_HDRLEN, caplen) == 0) {
+				cb(&f, ts, arg);
+				count++;
+			}
+			break;
+		}
+	}
+
+#undef RD32
+#undef RD16
+
+	munmap((void *)map, st.st_size);
+
+	return (count);
+}
+
+#endif
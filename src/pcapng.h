@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PCAPNG_H
+#define PCAPNG_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+#include "inet.h"
+
+#define PCAPNG_REPLAY_TIMED	0x1	/* honor the recorded inter-frame gaps */
+
+typedef struct pcapng_writer pcapng_writer;
+
+pcapng_writer	*pcapng_writer_open(const char *, const uint32_t, const uint64_t);
+int32_t		 pcapng_write(pcapng_writer *, const void *, const uint32_t);
+int32_t		 pcapng_write_burst(pcapng_writer *, struct fbuf **, const uint32_t);
+uint64_t	 pcapng_writer_drops(const pcapng_writer *);
+int32_t		 pcapng_writer_close(pcapng_writer *);
+int64_t		 pcapng_replay(const char *, const uint32_t,
+		    void (*)(const struct inet_frame *, uint64_t, void *), void *);
+
+#endif
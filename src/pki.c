@@ -33,6 +33,7 @@
 #include <openssl/rand.h>
 #include <openssl/x509v3.h>
 
+#define LOG_CAT	LOG_CAT_PKI
 #include "log.h"
 #include "pki.h"
 
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fbuf.h"
+#include "inet.h"
+#include "police.h"
+
+#define POLICE_WAYS	4	/* entries per set, one cache line */
+#define POLICE_SHIFT	10	/* tokens are counted in 1/1024 frame */
+
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE	CLOCK_MONOTONIC
+#endif
+
+/*
+ * A token bucket. Tokens are refilled lazily, when the bucket is hit,
+ * from the milliseconds elapsed since the last refill.
+ */
+struct police_tb {
+	uint64_t	macaddr;	/* tagged with bit 48, 0 is free */
+	uint32_t	tokens;
+	uint32_t	stamp;		/* ms */
+};
+
+/*
+ * The policer of one network. Sources live in a set associative table,
+ * a source missing from a full set takes the place of the least recently
+ * refilled entry, so memory stays bounded whatever the number of MACs.
+ */
+struct police {
+	struct police_tb	*set;
+	uint32_t		 mask;		/* number of sets - 1 */
+	uint32_t		 src_rate;	/* tokens per ms */
+	uint32_t		 src_burst;
+	uint32_t		 net_rate;
+	uint32_t		 net_burst;
+	struct police_tb	 net;
+	struct police_stats	 stats;
+};
+
+static uint32_t		 police_clock(void);
+static int		 police_take(struct police_tb *, uint32_t, uint32_t, uint32_t);
+static struct police_tb	*police_source(police *, uint64_t, uint32_t);
+
+uint32_t
+police_clock(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ((uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000));
+}
+
+/*
+ * Refills the bucket then takes one frame worth of tokens from it. If the
+ * bucket is empty, 0 is returned.
+ */
+int
+police_take(struct police_tb *tb, uint32_t now, uint32_t rate, uint32_t burst)
+{
+	uint64_t	refill;
+
+	if (now != tb->stamp) {
+		refill = (uint64_t)(now - tb->stamp) * rate + tb->tokens;
+		tb->tokens = refill > burst ? burst : refill;
+		tb->stamp = now;
+	}
+
+	if (tb->tokens < (1 << POLICE_SHIFT))
+		return (0);
+
+	tb->tokens -= 1 << POLICE_SHIFT;
+	return (1);
+}
+
+struct police_tb *
+police_source(police *p, uint64_t macaddr, uint32_t now)
+{
+	struct police_tb	*s, *victim;
+	uint32_t		 i;
+
+	macaddr |= 1ULL << 48;
+	s = &p->set[(inet_macaddr_hash(macaddr) & p->mask) * POLICE_WAYS];
+	victim = &s[0];
+	for (i = 0; i < POLICE_WAYS; i++) {
+		if (s[i].macaddr == macaddr)
+			return (&s[i]);
+		if (s[i].macaddr == 0) {
+			victim = &s[i];
+			break;
+		}
+		if ((int32_t)(s[i].stamp - victim->stamp) < 0)
+			victim = &s[i];
+	}
+
+	if (victim->macaddr)
+		p->stats.evictions++;
+
+	/* a new source starts with a full bucket */
+	victim->macaddr = macaddr;
+	victim->tokens = p->src_burst;
+	victim->stamp = now;
+
+	return (victim);
+}
+
+/*
+ * Creates the policer of a network. Every source may flood `src_rate'
+ * frames per second with bursts of `src_burst' frames, and the network as
+ * a whole `net_rate' frames per second with bursts of `net_burst' frames.
+ * About `max_src' sources are tracked. If an error occurs, NULL is
+ * returned.
+ */
+police *
+police_new(const uint32_t max_src, const uint32_t src_rate, const uint32_t src_burst,
+    const uint32_t net_rate, const uint32_t net_burst)
+{
+	police		*p;
+	uint32_t	 n;
+
+	if (max_src == 0 || src_burst == 0 || net_burst == 0 ||
+	    src_burst > UINT32_MAX >> POLICE_SHIFT ||
+	    net_burst > UINT32_MAX >> POLICE_SHIFT)
+		return (NULL);
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		return (NULL);
+
+	for (n = 1; n * POLICE_WAYS < max_src; n <<= 1)
+		;
+	if ((p->set = calloc(n * POLICE_WAYS, sizeof(*p->set))) == NULL) {
+		free(p);
+		return (NULL);
+	}
+
+	p->mask = n - 1;
+	p->src_rate = ((uint64_t)src_rate << POLICE_SHIFT) / 1000;
+	p->src_burst = src_burst << POLICE_SHIFT;
+	p->net_rate = ((uint64_t)net_rate << POLICE_SHIFT) / 1000;
+	p->net_burst = net_burst << POLICE_SHIFT;
+	p->net.tokens = p->net_burst;
+	p->net.stamp = police_clock();
+
+	return (p);
+}
+
+void
+police_free(police *p)
+{
+	if (p == NULL)
+		return;
+
+	free(p->set);
+	free(p);
+}
+
+/*
+ * Polices a burst of frames about to be flooded, broadcast, multicast or
+ * unknown unicast. The frames within the rates are compacted at the
+ * front of the array and their count is returned, the others are dropped
+ * and their reference released. The clock is read once per burst.
+ */
+uint32_t
+police_burst(police *p, struct fbuf **fb, const uint32_t n)
+{
+	struct police_tb	*src;
+	uint32_t		 now, i, kept = 0;
+
+	now = police_clock();
+
+	for (i = 0; i < n; i++) {
+		if (fb[i]->len < ETHER_HDR_LEN) {
+			fbuf_unref(fb[i]);
+			continue;
+		}
+
+		/* the source is charged first, a storming host can't drain
+		 * the tokens of the network */
+		src = police_source(p,
+		    inet_macaddr_u64(fb[i]->data + ETHER_ADDR_LEN), now);
+		if (!police_take(src, now, p->src_rate, p->src_burst)) {
+			p->stats.drop_src++;
+			fbuf_unref(fb[i]);
+			continue;
+		}
+		if (!police_take(&p->net, now, p->net_rate, p->net_burst)) {
+			p->stats.drop_net++;
+			fbuf_unref(fb[i]);
+			continue;
+		}
+
+		fb[kept++] = fb[i];
+	}
+	p->stats.passed += kept;
+
+	return (kept);
+}
+
+void
+police_stats(const police *p, struct police_stats *stats)
+{
+	*stats = p->stats;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef POLICE_H
+#define POLICE_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+
+typedef struct police police;
+
+struct police_stats {
+	uint64_t	passed;
+	uint64_t	drop_src;	/* over the per-source rate */
+	uint64_t	drop_net;	/* over the per-network rate */
+	uint64_t	evictions;	/* sources recycled from a full table */
+};
+
+police		*police_new(const uint32_t, const uint32_t, const uint32_t,
+		    const uint32_t, const uint32_t);
+void		 police_free(police *);
+uint32_t	 police_burst(police *, struct fbuf **, const uint32_t);
+void		 police_stats(const police *, struct police_stats *);
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fbuf.h"
+#include "inet.h"
+#include "repl.h"
+
+#define REPL_BUCKETS	256
+#define REPL_CACHELINE	64
+
+/*
+ * Single producer, single consumer ring of frame pointers. The producer is
+ * the thread flooding the network, the consumer is the peer I/O. Indexes
+ * run freely and are masked on access, the ring size is a power of two.
+ */
+struct repl_queue {
+	uint32_t	 head __attribute__((aligned(REPL_CACHELINE)));
+	uint32_t	 tail __attribute__((aligned(REPL_CACHELINE)));
+	uint32_t	 mask;
+	uint64_t	 drops;
+	struct fbuf	*ring[];
+};
+
+struct repl_members {
+	struct repl_queue	**q;
+	uint32_t		  n;
+	uint32_t		  cap;
+};
+
+struct repl_group {
+	SLIST_ENTRY(repl_group)	 next;
+	uint64_t		 macaddr;
+	struct repl_members	 members;
+};
+
+/*
+ * The replication state of one network: every peer of the broadcast
+ * domain, and the multicast groups with their own membership list.
+ * Unknown multicast groups are flooded like broadcast.
+ */
+struct repl {
+	struct repl_members		 peers;
+	SLIST_HEAD(, repl_group)	 bucket[REPL_BUCKETS];
+};
+
+static int32_t			 repl_members_add(struct repl_members *, struct repl_queue *);
+static int32_t			 repl_members_del(struct repl_members *, struct repl_queue *);
+static struct repl_group	*repl_group_find(struct repl *, uint64_t);
+static struct repl_members	*repl_target(struct repl *, struct fbuf *);
+static uint32_t			 repl_fanout(struct repl_members *, struct fbuf **,
+				    struct repl_queue **, uint32_t);
+
+struct repl_queue *
+repl_queue_new(const uint32_t size)
+{
+	struct repl_queue	*q;
+	uint32_t		 n;
+
+	for (n = 1; n < size; n <<= 1)
+		;
+
+	if (posix_memalign((void **)&q, REPL_CACHELINE,
+	    sizeof(*q) + n * sizeof(struct fbuf *)) != 0)
+		return (NULL);
+
+	q->head = q->tail = 0;
+	q->mask = n - 1;
+	q->drops = 0;
+
+	return (q);
+}
+
+/*
+ * Releases the queue and every frame still waiting in it.
+ */
+void
+repl_queue_free(struct repl_queue *q)
+{
+	struct fbuf	*fb[REPL_BURST_MAX];
+	uint32_t	 i, n;
+
+	if (q == NULL)
+		return;
+
+	while ((n = repl_queue_dequeue_burst(q, fb, REPL_BURST_MAX)) > 0)
+		for (i = 0; i < n; i++)
+			fbuf_unref(fb[i]);
+
+	free(q);
+}
+
+/*
+ * Pushes up to `n' frame pointers with a single publication of the tail.
+ * Returns the number of frames enqueued, the others are counted as drops
+ * and remain owned by the caller.
+ */
+uint32_t
+repl_queue_enqueue_burst(struct repl_queue *q, struct fbuf **fb, const uint32_t n)
+{
+	uint32_t	head, tail, room, i, k;
+
+	tail = q->tail;
+	head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	room = q->mask + 1 - (tail - head);
+
+	k = n < room ? n : room;
+	for (i = 0; i < k; i++)
+		q->ring[(tail + i) & q->mask] = fb[i];
+
+	__atomic_store_n(&q->tail, tail + k, __ATOMIC_RELEASE);
+	q->drops += n - k;
+
+	return (k);
+}
+
+/*
+ * Pops up to `n' frame pointers. The references travel with the pointers,
+ * the consumer releases them with fbuf_unref() once the frame is sent.
+ */
+uint32_t
+repl_queue_dequeue_burst(struct repl_queue *q, struct fbuf **fb, const uint32_t n)
+{
+	uint32_t	head, tail, avail, i, k;
+
+	head = q->head;
+	tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	avail = tail - head;
+
+	k = n < avail ? n : avail;
+	for (i = 0; i < k; i++)
+		fb[i] = q->ring[(head + i) & q->mask];
+
+	__atomic_store_n(&q->head, head + k, __ATOMIC_RELEASE);
+
+	return (k);
+}
+
+uint64_t
+repl_queue_drops(const struct repl_queue *q)
+{
+	return (q->drops);
+}
+
+int32_t
+repl_members_add(struct repl_members *m, struct repl_queue *q)
+{
+	struct repl_queue	**tmp;
+	uint32_t		  i;
+
+	for (i = 0; i < m->n; i++)
+		if (m->q[i] == q)
+			return (0);
+
+	if (m->n == m->cap) {
+		if ((tmp = realloc(m->q, (m->cap ? m->cap * 2 : 16) *
+		    sizeof(*tmp))) == NULL)
+			return (-1);
+		m->q = tmp;
+		m->cap = m->cap ? m->cap * 2 : 16;
+	}
+	m->q[m->n++] = q;
+
+	return (0);
+}
+
+int32_t
+repl_members_del(struct repl_members *m, struct repl_queue *q)
+{
+	uint32_t	i;
+
+	for (i = 0; i < m->n; i++) {
+		if (m->q[i] == q) {
+			m->q[i] = m->q[--m->n];
+			return (0);
+		}
+	}
+
+	return (-1);
+}
+
+struct repl_group *
+repl_group_find(struct repl *r, uint64_t macaddr)
+{
+	struct repl_group	*g;
+
+	SLIST_FOREACH(g, &r->bucket[inet_macaddr_hash(macaddr) % REPL_BUCKETS], next)
+		if (g->macaddr == macaddr)
+			return (g);
+
+	return (NULL);
+}
+
+struct repl *
+repl_new(void)
+{
+	struct repl	*r;
+	int		 i;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return (NULL);
+
+	for (i = 0; i < REPL_BUCKETS; i++)
+		SLIST_INIT(&r->bucket[i]);
+
+	return (r);
+}
+
+/*
+ * Releases the replication state. The peer queues are owned by the caller
+ * and are not released.
+ */
+void
+repl_free(struct repl *r)
+{
+	struct repl_group	*g;
+	int			 i;
+
+	if (r == NULL)
+		return;
+
+	for (i = 0; i < REPL_BUCKETS; i++) {
+		while ((g = SLIST_FIRST(&r->bucket[i])) != NULL) {
+			SLIST_REMOVE_HEAD(&r->bucket[i], next);
+			free(g->members.q);
+			free(g);
+		}
+	}
+	free(r->peers.q);
+	free(r);
+}
+
+/*
+ * Adds a peer queue to the broadcast domain. If an error occurs, -1 is
+ * returned. Membership changes must be done by the flooding thread.
+ */
+int32_t
+repl_peer_add(struct repl *r, struct repl_queue *q)
+{
+	return (repl_members_add(&r->peers, q));
+}
+
+/*
+ * Removes a peer queue from the broadcast domain and from every multicast
+ * group it joined. If the peer is unknown, -1 is returned.
+ */
+int32_t
+repl_peer_del(struct repl *r, struct repl_queue *q)
+{
+	struct repl_group	*g;
+	int			 i;
+
+	for (i = 0; i < REPL_BUCKETS; i++)
+		SLIST_FOREACH(g, &r->bucket[i], next)
+			repl_members_del(&g->members, q);
+
+	return (repl_members_del(&r->peers, q));
+}
+
+/*
+ * Subscribes a peer queue to the multicast group `macaddr', the group is
+ * created on the first join. If an error occurs, -1 is returned.
+ */
+int32_t
+repl_group_join(struct repl *r, const uint8_t *macaddr, struct repl_queue *q)
+{
+	struct repl_group	*g;
+	uint64_t		 key;
+
+	key = inet_macaddr_u64(macaddr);
+	if ((g = repl_group_find(r, key)) == NULL) {
+		if ((g = calloc(1, sizeof(*g))) == NULL)
+			return (-1);
+		g->macaddr = key;
+		SLIST_INSERT_HEAD(&r->bucket[inet_macaddr_hash(key) % REPL_BUCKETS],
+		    g, next);
+	}
+
+	return (repl_members_add(&g->members, q));
+}
+
+/*
+ * Unsubscribes a peer queue from the multicast group `macaddr', the group
+ * is removed with its last member. If the peer isn't a member, -1 is
+ * returned.
+ */
+int32_t
+repl_group_leave(struct repl *r, const uint8_t *macaddr, struct repl_queue *q)
+{
+	struct repl_group	*g;
+	uint64_t		 key;
+	int32_t			 ret;
+
+	key = inet_macaddr_u64(macaddr);
+	if ((g = repl_group_find(r, key)) == NULL)
+		return (-1);
+
+	ret = repl_members_del(&g->members, q);
+	if (g->members.n == 0) {
+		SLIST_REMOVE(&r->bucket[inet_macaddr_hash(key) % REPL_BUCKETS],
+		    g, repl_group, next);
+		free(g->members.q);
+		free(g);
+	}
+
+	return (ret);
+}
+
+/*
+ * Returns the membership list a frame is flooded to: the group members for
+ * a known multicast group, every peer otherwise.
+ */
+struct repl_members *
+repl_target(struct repl *r, struct fbuf *fb)
+{
+	struct repl_group	*g;
+
+	if (inet_macaddr_type(fb->data) != ADDR_MULTICAST)
+		return (&r->peers);
+
+	if ((g = repl_group_find(r, inet_macaddr_u64(fb->data))) == NULL)
+		return (&r->peers);
+
+	return (&g->members);
+}
+
+/*
+ * Hands a run of frames sharing the same membership list to every member
+ * queue. Each frame is referenced once for all the members up front, so a
+ * consumer can't release it while we are still pushing, and the surplus is
+ * given back once every queue was served.
+ */
+uint32_t
+repl_fanout(struct repl_members *m, struct fbuf **fb, struct repl_queue **ingress,
+    uint32_t n)
+{
+	struct fbuf	*vec[REPL_BURST_MAX];
+	uint32_t	 idx[REPL_BURST_MAX];
+	uint32_t	 sent[REPL_BURST_MAX];
+	uint32_t	 i, j, k, c, total = 0;
+
+	for (i = 0; i < n; i++) {
+		fbuf_ref_n(fb[i], m->n);
+		sent[i] = 0;
+	}
+
+	for (j = 0; j < m->n; j++) {
+		for (i = 0, k = 0; i < n; i++) {
+			if (ingress && ingress[i] == m->q[j])
+				continue;	/* split horizon */
+			vec[k] = fb[i];
+			idx[k++] = i;
+		}
+		c = repl_queue_enqueue_burst(m->q[j], vec, k);
+		for (i = 0; i < c; i++)
+			sent[idx[i]]++;
+		total += c;
+	}
+
+	/* drop the surplus references along with the caller's one */
+	for (i = 0; i < n; i++)
+		fbuf_unref_n(fb[i], m->n + 1 - sent[i]);
+
+	return (total);
+}
+
+/*
+ * Floods a burst of frames to the network without copying them. Broadcast
+ * and unknown destinations reach every peer, multicast reaches the group
+ * members, and a frame is never sent back to its ingress peer. `ingress'
+ * may be NULL for locally originated frames. The caller's reference on
+ * every frame is consumed. Returns the number of pointers enqueued.
+ */
+uint32_t
+repl_flood_burst(struct repl *r, struct fbuf **fb, struct repl_queue **ingress,
+    const uint32_t n)
+{
+	struct repl_members	*m, *run;
+	uint32_t		 i, start = 0, total = 0;
+
+	if (n == 0)
+		return (0);
+
+	run = repl_target(r, fb[0]);
+	for (i = 1; i <= n; i++) {
+		m = (i < n) ? repl_target(r, fb[i]) : NULL;
+		if (m == run && i - start < REPL_BURST_MAX)
+			continue;
+		total += repl_fanout(run, fb + start,
+		    ingress ? ingress + start : NULL, i - start);
+		start = i;
+		run = m;
+	}
+
+	return (total);
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef REPL_H
+#define REPL_H
+
+#include <stdint.h>
+
+#include "fbuf.h"
+
+#define REPL_BURST_MAX	32
+
+struct repl;
+struct repl_queue;
+
+struct repl_queue	*repl_queue_new(const uint32_t);
+void			 repl_queue_free(struct repl_queue *);
+uint32_t		 repl_queue_enqueue_burst(struct repl_queue *, struct fbuf **, const uint32_t);
+uint32_t		 repl_queue_dequeue_burst(struct repl_queue *, struct fbuf **, const uint32_t);
+uint64_t		 repl_queue_drops(const struct repl_queue *);
+
+struct repl		*repl_new(void);
+void			 repl_free(struct repl *);
+int32_t			 repl_peer_add(struct repl *, struct repl_queue *);
+int32_t			 repl_peer_del(struct repl *, struct repl_queue *);
+int32_t			 repl_group_join(struct repl *, const uint8_t *, struct repl_queue *);
+int32_t			 repl_group_leave(struct repl *, const uint8_t *, struct repl_queue *);
+uint32_t		 repl_flood_burst(struct repl *, struct fbuf **, struct repl_queue **, const uint32_t);
+
+#endif
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Frame path benchmark. A synthetic mix of frames is generated once, then
+ * driven through classification, flow hashing, MAC lookup and replication
+ * in bursts, the way a switch would process them.
+ *
+ * usage: bench_frame [-n frames] [-m macs] [-p peers] [-b bcast%]
+ *	  [-M mcast%] [-v vlan%] [-s size|imix], size from 64 to 1920
+ */
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#else
+#define PERF_COUNT_HW_CPU_CYCLES	0
+#define PERF_COUNT_HW_CACHE_MISSES	0
+#define PERF_EVENT_IOC_ENABLE		0
+#define PERF_EVENT_IOC_DISABLE		0
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fbuf.h"
+#include "inet.h"
+#include "repl.h"
+
+#define BURST		32
+#define WORKSET		8192
+#define N_FLOWS		1024
+
+struct mac_entry {
+	uint64_t	macaddr;
+	uint32_t	peer;
+};
+
+/* The forwarding table of the switch, open addressing on packed MACs. */
+struct mac_table {
+	struct mac_entry	*e;
+	uint32_t		 mask;
+};
+
+static uint64_t	rnd_state = 0x853c49e6748fea9bULL;
+
+static uint32_t
+rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return ((uint32_t)rnd_state);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static int
+perf_open(uint32_t config)
+{
+#ifdef __linux__
+	struct perf_event_attr	attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+	return (-1);
+#endif
+}
+
+static uint64_t
+perf_read(int fd)
+{
+	uint64_t	v = 0;
+
+	if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v))
+		return (0);
+	return (v);
+}
+
+static void
+mac_table_insert(struct mac_table *t, uint64_t macaddr, uint32_t peer)
+{
+	uint32_t	i;
+
+	for (i = inet_macaddr_hash(macaddr) & t->mask; t->e[i].macaddr;
+	    i = (i + 1) & t->mask)
+		;
+	t->e[i].macaddr = macaddr;
+	t->e[i].peer = peer;
+}
+
+static int32_t
+mac_table_lookup(struct mac_table *t, uint64_t macaddr)
+{
+	uint32_t	i;
+
+	for (i = inet_macaddr_hash(macaddr) & t->mask; t->e[i].macaddr;
+	    i = (i + 1) & t->mask)
+		if (t->e[i].macaddr == macaddr)
+			return (t->e[i].peer);
+	return (-1);
+}
+
+static void
+mac_host(uint8_t *macaddr, uint32_t idx)
+{
+	macaddr[0] = 0x02;	/* locally administered unicast */
+	macaddr[1] = 0x4e;
+	macaddr[2] = idx >> 24;
+	macaddr[3] = idx >> 16;
+	macaddr[4] = idx >> 8;
+	macaddr[5] = idx;
+}
+
+static uint32_t
+frame_size(const char *dist)
+{
+	uint32_t	r;
+
+	if (strcmp(dist, "imix") != 0)
+		return (atoi(dist));
+
+	/* simple IMIX, 7:4:1 */
+	r = rnd() % 12;
+	return (r < 7 ? 64 : r < 11 ? 576 : 1500);
+}
+
+static void
+frame_build(struct fbuf *fb, uint32_t n_macs, uint32_t bcast, uint32_t mcast,
+    uint32_t vlan, const char *dist)
+{
+	uint8_t		*p;
+	uint32_t	 size, r, flow, off = 12;
+
+	size = frame_size(dist);
+	p = fbuf_append(fb, size);
+	memset(p, 0, size);
+
+	r = rnd() % 100;
+	if (r < bcast)
+		memset(p, 0xff, ETHER_ADDR_LEN);
+	else if (r < bcast + mcast) {
+		p[0] = 0x01; p[1] = 0x00; p[2] = 0x5e;
+		p[5] = rnd() % 16;
+	} else
+		mac_host(p, rnd() % n_macs);
+	mac_host(p + ETHER_ADDR_LEN, rnd() % n_macs);
+
+	if (rnd() % 100 < vlan) {
+		p[off++] = 0x81; p[off++] = 0x00;
+		p[off++] = 0x00; p[off++] = 1 + rnd() % 100;
+	}
+	p[off++] = 0x08; p[off++] = 0x00;
+
+	/* IPv4 + UDP or TCP */
+	flow = rnd() % N_FLOWS;
+	p[off] = 0x45;
+	p[off + 2] = (size - off) >> 8;
+	p[off + 3] = size - off;
+	p[off + 8] = 64;
+	p[off + 9] = flow & 1 ? 17 : 6;
+	p[off + 12] = 10; p[off + 14] = flow >> 8; p[off + 15] = flow;
+	p[off + 16] = 10; p[off + 17] = 1; p[off + 19] = flow % 7;
+	off += 20;
+	p[off] = 0xc0; p[off + 1] = flow;
+	p[off + 2] = 0x01; p[off + 3] = 0xbb;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct mac_table	 tbl;
+	struct fbuf_pool	*pool;
+	struct fbuf		*work[WORKSET], *burst[BURST], *flood[BURST], *out[BURST];
+	struct repl		*r;
+	struct repl_queue	**q;
+	struct inet_frame	 f;
+	const char		*dist = "imix";
+	uint64_t		 n_frames = 10000000, done, t0, t1, pushes = 0;
+	uint64_t		 cyc, miss;
+	uint32_t		 n_macs = 4096, n_peers = 64, bcast = 5, mcast = 5;
+	uint32_t		 vlan = 20, i, j, k, nf, hash = 0;
+	int32_t			 peer;
+	int			 ch, fd_cyc, fd_miss;
+	uint8_t			 grp[ETHER_ADDR_LEN] = { 0x01, 0x00, 0x5e, 0, 0, 0 };
+
+	while ((ch = getopt(argc, argv, "n:m:p:b:M:v:s:")) != -1) {
+		switch (ch) {
+		case 'n': n_frames = strtoull(optarg, NULL, 10); break;
+		case 'm': n_macs = atoi(optarg); break;
+		case 'p': n_peers = atoi(optarg); break;
+		case 'b': bcast = atoi(optarg); break;
+		case 'M': mcast = atoi(optarg); break;
+		case 'v': vlan = atoi(optarg); break;
+		case 's': dist = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-n frames] [-m macs] "
+			    "[-p peers] [-b bcast%%] [-M mcast%%] [-v vlan%%] "
+			    "[-s 64-%d|imix]\n", argv[0],
+			    FBUF_SIZE - FBUF_HEADROOM);
+			return (1);
+		}
+	}
+	/* the frames are built in a single fbuf, past the headroom */
+	if (n_frames == 0 || n_macs == 0 || n_peers == 0 ||
+	    bcast + mcast > 100 || (strcmp(dist, "imix") != 0 &&
+	    (atoi(dist) < 64 || atoi(dist) > FBUF_SIZE - FBUF_HEADROOM))) {
+		fprintf(stderr, "invalid parameters\n");
+		return (1);
+	}
+
+	/* forwarding table, every host lives behind one of the peers */
+	for (k = 1; k < n_macs * 2; k <<= 1)
+		;
+	tbl.mask = k - 1;
+	tbl.e = calloc(k, sizeof(*tbl.e));
+	for (i = 0; i < n_macs; i++) {
+		mac_host(grp, i);
+		mac_table_insert(&tbl, inet_macaddr_u64(grp), i % n_peers);
+	}
+
+	r = repl_new();
+	q = calloc(n_peers, sizeof(*q));
+	for (i = 0; i < n_peers; i++) {
+		q[i] = repl_queue_new(BURST * 4);
+		repl_peer_add(r, q[i]);
+	}
+	/* half of the multicast groups have subscribers */
+	memcpy(grp, (uint8_t[]){ 0x01, 0x00, 0x5e, 0, 0, 0 }, ETHER_ADDR_LEN);
+	for (i = 0; i < 8; i++) {
+		grp[5] = i;
+		for (j = 0; j < n_peers; j += 4)
+			repl_group_join(r, grp, q[(i + j) % n_peers]);
+	}
+
+	pool = fbuf_pool_new(WORKSET + BURST, FBUF_SIZE);
+	for (i = 0; i < WORKSET; i++) {
+		work[i] = fbuf_alloc(pool);
+		frame_build(work[i], n_macs, bcast, mcast, vlan, dist);
+	}
+
+	fd_cyc = perf_open(PERF_COUNT_HW_CPU_CYCLES);
+	fd_miss = perf_open(PERF_COUNT_HW_CACHE_MISSES);
+	if (fd_cyc >= 0)
+		ioctl(fd_cyc, PERF_EVENT_IOC_ENABLE, 0);
+	if (fd_miss >= 0)
+		ioctl(fd_miss, PERF_EVENT_IOC_ENABLE, 0);
+
+	t0 = now_ns();
+	for (done = 0; done < n_frames; done += BURST) {
+		for (i = 0, nf = 0; i < BURST; i++) {
+			burst[i] = work[(done + i) % WORKSET];
+			inet_parse(&f, burst[i]->data, burst[i]->len);
+			hash ^= inet_flow_hash(&f);
+
+			fbuf_ref(burst[i]);
+			peer = -1;
+			if (f.addr_type == ADDR_UNICAST)
+				peer = mac_table_lookup(&tbl,
+				    inet_macaddr_u64(burst[i]->data));
+			if (peer < 0)
+				flood[nf++] = burst[i];
+			else if (repl_queue_enqueue_burst(q[peer], &burst[i], 1))
+				pushes++;
+			else
+				fbuf_unref(burst[i]);
+		}
+		pushes += repl_flood_burst(r, flood, NULL, nf);
+
+		/* the peers drain their queue */
+		for (i = 0; i < n_peers; i++)
+			while ((k = repl_queue_dequeue_burst(q[i], out, BURST)) > 0)
+				for (j = 0; j < k; j++)
+					fbuf_unref(out[j]);
+	}
+	t1 = now_ns();
+
+	if (fd_cyc >= 0)
+		ioctl(fd_cyc, PERF_EVENT_IOC_DISABLE, 0);
+	if (fd_miss >= 0)
+		ioctl(fd_miss, PERF_EVENT_IOC_DISABLE, 0);
+	cyc = perf_read(fd_cyc);
+	miss = perf_read(fd_miss);
+
+	printf("frames %llu, macs %u, peers %u, bcast %u%%, mcast %u%%, "
+	    "vlan %u%%, size %s\n", (unsigned long long)done, n_macs, n_peers,
+	    bcast, mcast, vlan, dist);
+	printf("%.2f Mpps, %.1f ns/frame, %.2f pushes/frame\n",
+	    done * 1e3 / (t1 - t0), (double)(t1 - t0) / done,
+	    (double)pushes / done);
+	if (fd_cyc >= 0 || fd_miss >= 0)
+		printf("%.1f cycles/frame, %.3f cache-misses/frame\n",
+		    (double)cyc / done, (double)miss / done);
+	else
+		printf("perf counters unavailable\n");
+	printf("hash %08x\n", hash);
+
+	for (i = 0; i < WORKSET; i++)
+		fbuf_unref(work[i]);
+	for (i = 0; i < n_peers; i++)
+		repl_queue_free(q[i]);
+	repl_free(r);
+	fbuf_pool_free(pool);
+	free(q);
+	free(tbl.e);
+
+	return (0);
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Checks the compiled ACL engine against a linear scan of the rules, on
+ * random rule lists and random frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acl.h"
+#include "inet.h"
+
+#define ROUNDS		200
+#define FRAMES		2000
+#define FRAME_LEN	100
+
+static uint64_t	rnd_state = 0x853c49e6748fea9bULL;
+
+static uint32_t
+rnd(uint32_t n)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return ((uint32_t)rnd_state % n);
+}
+
+static int
+prefix_match(const uint8_t *a, const uint8_t *p, int plen)
+{
+	int	b;
+
+	for (b = 0; b < plen; b++)
+		if (((a[b / 8] >> (7 - b % 8)) & 1) !=
+		    ((p[b / 8] >> (7 - b % 8)) & 1))
+			return (0);
+	return (1);
+}
+
+/* Returns the index of the first rule matching the frame, or -1. */
+static int32_t
+linear(const struct acl_rule *r, uint32_t n, const struct inet_frame *f)
+{
+	const struct acl_rule	*x;
+	const uint8_t		*src, *dst;
+	uint8_t			 s4[4], d4[4];
+	uint32_t		 i;
+	int			 ip, l4;
+
+	for (i = 0; i < 4; i++) {
+		s4[i] = f->src.v4 >> (24 - 8 * i);
+		d4[i] = f->dst.v4 >> (24 - 8 * i);
+	}
+	src = f->ip_ver == 4 ? s4 : f->src.v6;
+	dst = f->ip_ver == 4 ? d4 : f->dst.v6;
+	ip = f->ip_ver == 4 || f->ip_ver == 6;
+	l4 = f->l4_off && (f->ip_proto == 6 || f->ip_proto == 17);
+
+	for (i = 0; i < n; i++) {
+		x = &r[i];
+		if ((x->fields & ACL_SRC_MAC) &&
+		    memcmp(x->src_mac, f->data + ETHER_ADDR_LEN,
+		    ETHER_ADDR_LEN) != 0)
+			continue;
+		if ((x->fields & ACL_DST_MAC) &&
+		    memcmp(x->dst_mac, f->data, ETHER_ADDR_LEN) != 0)
+			continue;
+		if ((x->fields & ACL_ETHERTYPE) && x->ethertype != f->ethertype)
+			continue;
+		if ((x->fields & ACL_VLAN) && x->vlan != f->vlan)
+			continue;
+		if ((x->fields & ACL_PROTO) &&
+		    (!ip || x->proto != f->ip_proto))
+			continue;
+		if ((x->fields & ACL_SRC_IP) && (!ip ||
+		    x->ip_ver != f->ip_ver ||
+		    !prefix_match(src, x->src_ip, x->src_plen)))
+			continue;
+		if ((x->fields & ACL_DST_IP) && (!ip ||
+		    x->ip_ver != f->ip_ver ||
+		    !prefix_match(dst, x->dst_ip, x->dst_plen)))
+			continue;
+		if ((x->fields & ACL_SPORT) && (!l4 ||
+		    f->sport < x->sport_lo || f->sport > x->sport_hi))
+			continue;
+		if ((x->fields & ACL_DPORT) && (!l4 ||
+		    f->dport < x->dport_lo || f->dport > x->dport_hi))
+			continue;
+		return (i);
+	}
+
+	return (-1);
+}
+
+static void
+rule_build(struct acl_rule *x)
+{
+	static const uint8_t	 mac[] = { 0x02, 0, 0, 0, 0 };
+
+	memset(x, 0, sizeof(*x));
+	x->action = 1 + rnd(2);
+	x->ip_ver = rnd(2) ? 4 : 6;
+
+	if (rnd(5) == 0) {
+		x->fields |= ACL_SRC_MAC;
+		memcpy(x->src_mac, mac, sizeof(mac));
+		x->src_mac[5] = rnd(4);
+	}
+	if (rnd(5) == 0) {
+		x->fields |= ACL_DST_MAC;
+		memcpy(x->dst_mac, mac, sizeof(mac));
+		x->dst_mac[5] = rnd(4);
+	}
+	if (rnd(6) == 0) {
+		x->fields |= ACL_ETHERTYPE;
+		x->ethertype = rnd(2) ? 0x0800 : 0x86dd;
+	}
+	if (rnd(6) == 0) {
+		x->fields |= ACL_VLAN;
+		x->vlan = rnd(3);
+	}
+	if (rnd(3) == 0) {
+		x->fields |= ACL_SRC_IP;
+		x->src_ip[0] = 10;
+		x->src_ip[1] = rnd(4);
+		x->src_ip[2] = rnd(256);
+		x->src_plen = rnd(x->ip_ver == 4 ? 33 : 40);
+	}
+	if (rnd(3) == 0) {
+		x->fields |= ACL_DST_IP;
+		x->dst_ip[0] = 10;
+		x->dst_ip[1] = rnd(4);
+		x->dst_plen = rnd(20);
+	}
+	if (rnd(4) == 0) {
+		x->fields |= ACL_PROTO;
+		x->proto = rnd(2) ? 6 : 17;
+	}
+	if (rnd(4) == 0) {
+		x->fields |= ACL_SPORT;
+		x->sport_lo = rnd(100);
+		x->sport_hi = x->sport_lo + rnd(100);
+	}
+	if (rnd(4) == 0) {
+		x->fields |= ACL_DPORT;
+		x->dport_lo = rnd(100);
+		x->dport_hi = rnd(3) ? x->dport_lo + rnd(50) : 65535;
+	}
+}
+
+/* An IPv4, IPv6 or ARP frame, maybe VLAN tagged. */
+static void
+frame_build(uint8_t *p)
+{
+	static const uint8_t	 mac[] = { 0x02, 0, 0, 0, 0 };
+	uint8_t			*ip, *l4;
+	int			 off = 12;
+
+	memset(p, 0, FRAME_LEN);
+	memcpy(p, mac, sizeof(mac));
+	p[5] = rnd(4);
+	memcpy(p + ETHER_ADDR_LEN, mac, sizeof(mac));
+	p[11] = rnd(4);
+
+	if (rnd(2)) {
+		p[off] = 0x81;
+		p[off + 3] = rnd(3);
+		off += 4;
+	}
+
+	ip = p + off + 2;
+	switch (rnd(3)) {
+	case 0:
+		p[off] = 0x08;
+		ip[0] = 0x45;
+		ip[9] = rnd(2) ? 6 : 17;
+		ip[12] = 10;
+		ip[13] = rnd(4);
+		ip[14] = rnd(256);
+		ip[15] = rnd(256);
+		ip[16] = 10;
+		ip[17] = rnd(4);
+		ip[18] = rnd(256);
+		l4 = ip + 20;
+		l4[1] = rnd(210);
+		l4[3] = rnd(210);
+		break;
+	case 1:
+		p[off] = 0x86;
+		p[off + 1] = 0xdd;
+		ip[0] = 0x60;
+		ip[6] = rnd(2) ? 6 : 17;
+		ip[8] = 10;
+		ip[9] = rnd(4);
+		ip[10] = rnd(256);
+		ip[24] = 10;
+		ip[25] = rnd(4);
+		l4 = ip + 40;
+		l4[1] = rnd(210);
+		l4[3] = rnd(210);
+		break;
+	default:
+		p[off] = 0x08;
+		p[off + 1] = 0x06;
+		break;
+	}
+}
+
+int
+main(void)
+{
+	struct acl_rule		*r;
+	struct inet_frame	 f;
+	acl_set			*s;
+	uint8_t			 frame[FRAME_LEN], action;
+	uint32_t		 round, i, n, bad = 0;
+	int32_t			 got, want;
+
+	for (round = 0; round < ROUNDS; round++) {
+		n = 1 + rnd(300);
+		if ((r = calloc(n, sizeof(*r))) == NULL)
+			return (1);
+		for (i = 0; i < n; i++)
+			rule_build(&r[i]);
+
+		if ((s = acl_compile(r, n, ACL_DENY)) == NULL) {
+			fprintf(stderr, "round %u: acl_compile failed\n", round);
+			return (1);
+		}
+
+		for (i = 0; i < FRAMES; i++) {
+			frame_build(frame);
+			inet_parse(&f, frame, FRAME_LEN);
+			action = acl_classify(s, &f, &got);
+			want = linear(r, n, &f);
+			if (got != want || action !=
+			    (want < 0 ? ACL_DENY : r[want].action)) {
+				if (bad++ < 5)
+					fprintf(stderr, "round %u: rule %d, "
+					    "expected %d\n", round, got, want);
+			}
+		}
+
+		acl_set_free(s);
+		free(r);
+	}
+
+	if (bad != 0) {
+		fprintf(stderr, "%u mismatches\n", bad);
+		return (1);
+	}
+
+	return (0);
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Round-trips frames through the compression stage, and feeds the decoder
+ * blocks it must reject.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "comp.h"
+#include "fbuf.h"
+
+#define MAX_LEN		65536
+#define POOL_SIZE	(FBUF_HEADROOM + MAX_LEN + 64)
+#define STREAM		2000
+#define FUZZ		2000
+
+enum { RANDOM, REPEAT, PERIOD, MIXED, NKIND };
+
+static const char	*kind_names[] = { "random", "repeat", "period", "mixed" };
+
+static const uint32_t	 sizes[] = { 1, 12, 13, 63, 64, 65, 79, 80, 270,
+			    271, 1500, 2048, 65534, 65535, 65536 };
+
+static struct fbuf_pool	*pool;
+static uint8_t		 src[MAX_LEN];
+static uint32_t		 bad;
+static uint64_t		 rnd_state = 0x853c49e6748fea9bULL;
+
+static uint32_t
+rnd(uint32_t n)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return ((uint32_t)rnd_state % n);
+}
+
+/*
+ * Fills `len' bytes of a kind: random, a single byte, a short period, or
+ * a random run long enough to need extension bytes followed by a period.
+ */
+static void
+fill(uint8_t *p, uint32_t len, int kind)
+{
+	uint32_t	i, period, lit;
+
+	period = 2 + rnd(6);
+	lit = rnd(2) ? 15 : 15 + 255 + rnd(300);
+	for (i = 0; i < len; i++)
+		switch (kind) {
+		case RANDOM:
+			p[i] = rnd(256);
+			break;
+		case REPEAT:
+			p[i] = 'a';
+			break;
+		case PERIOD:
+			p[i] = i < period ? rnd(256) : p[i - period];
+			break;
+		default:
+			p[i] = i < lit || i < period ? rnd(256) :
+			    p[i - period];
+			break;
+		}
+}
+
+/*
+ * Compresses then restores `len' bytes of `src'. Returns the encoding
+ * picked by the compressor, or -1 if the frame didn't come back intact.
+ */
+static int
+roundtrip(comp *c, uint32_t len)
+{
+	struct fbuf	*fb;
+	int		 enc;
+
+	if ((fb = fbuf_alloc(pool)) == NULL || fbuf_append(fb, len) == NULL)
+		return (-1);
+	memcpy(fb->data, src, len);
+
+	if (comp_frame(c, &fb) < 0) {
+		fbuf_unref(fb);
+		return (-1);
+	}
+	enc = fb->data[0];
+	if (decomp(&fb, pool) < 0 || fb->len != len ||
+	    memcmp(fb->data, src, len) != 0)
+		enc = -1;
+	fbuf_unref(fb);
+
+	return (enc);
+}
+
+/*
+ * Decodes a LZ4 block claimed to restore `len' bytes. A rejected frame
+ * must be left untouched. Returns what decomp() did, or -2 if it failed
+ * but modified the frame.
+ */
+static int
+decode(const uint8_t *blk, uint32_t blen, uint32_t len, uint8_t *out)
+{
+	struct fbuf	*fb, *orig;
+	uint8_t		*h;
+	int		 ret;
+
+	if ((fb = fbuf_alloc(pool)) == NULL ||
+	    (h = fbuf_append(fb, COMP_HDRLEN + blen)) == NULL)
+		return (-2);
+	h[0] = COMP_LZ4;
+	h[1] = 0;
+	h[2] = len >> 8;
+	h[3] = len;
+	memcpy(h + COMP_HDRLEN, blk, blen);
+
+	orig = fb;
+	if ((ret = decomp(&fb, pool)) < 0) {
+		if (fb != orig || fb->len != COMP_HDRLEN + blen ||
+		    memcmp(fb->data + COMP_HDRLEN, blk, blen) != 0)
+			ret = -2;
+	} else if (fb->len != len)
+		ret = -2;
+	else if (out != NULL)
+		memcpy(out, fb->data, len);
+	fbuf_unref(fb);
+
+	return (ret);
+}
+
+static void
+expect(const char *what, int got, int want)
+{
+	if (got != want) {
+		fprintf(stderr, "%s: got %d, expected %d\n", what, got, want);
+		bad++;
+	}
+}
+
+static void
+test_sizes(void)
+{
+	comp		*c;
+	uint32_t	 i, len;
+	int		 kind, enc;
+
+	for (kind = 0; kind < NKIND; kind++)
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			len = sizes[i];
+			fill(src, len, kind);
+
+			/* a fresh context, no flow is bypassed yet */
+			if ((c = comp_new(pool)) == NULL) {
+				bad++;
+				return;
+			}
+			enc = roundtrip(c, len);
+			comp_free(c);
+
+			/* a mixed frame may be all random up to 570 bytes */
+			if (enc < 0 || (kind == RANDOM && enc != COMP_RAW) ||
+			    (kind != RANDOM && len >= (kind == MIXED ?
+			    2048 : 80) && len < MAX_LEN && enc != COMP_LZ4)) {
+				fprintf(stderr, "%s, %u bytes: encoding %d\n",
+				    kind_names[kind], len, enc);
+				bad++;
+			}
+		}
+}
+
+/* Many frames through one context, its hash table outlives them. */
+static void
+test_stream(void)
+{
+	comp		*c;
+	uint32_t	 i, len;
+	int		 kind;
+
+	if ((c = comp_new(pool)) == NULL) {
+		bad++;
+		return;
+	}
+	for (i = 0; i < STREAM; i++) {
+		kind = rnd(NKIND);
+		len = 1 + rnd(i % 50 == 0 ? MAX_LEN - 1 : 1500);
+		fill(src, len, kind);
+		if (roundtrip(c, len) < 0) {
+			fprintf(stderr, "stream %u: %s, %u bytes\n", i,
+			    kind_names[kind], len);
+			bad++;
+		}
+	}
+	comp_free(c);
+}
+
+static void
+test_malformed(void)
+{
+	/* "abcd", then a match of 4 bytes 1 byte back, then "e" */
+	uint8_t	blk[] = { 0x40, 'a', 'b', 'c', 'd', 0x01, 0x00, 0x10, 'e' };
+	/* "abcd", then a match of 15 + 255 + 4 bytes, then "e" */
+	uint8_t	ext[] = { 0x4f, 'a', 'b', 'c', 'd', 0x01, 0x00, 255, 0, 0x10,
+		    'e' };
+	uint8_t	lit[600], out[16];
+
+	expect("valid block", decode(blk, sizeof(blk), 9, out), 0);
+	if (memcmp(out, "abcddddde", 9) != 0) {
+		fprintf(stderr, "valid block: wrong output\n");
+		bad++;
+	}
+
+	blk[5] = 0;
+	expect("offset 0", decode(blk, sizeof(blk), 9, NULL), -1);
+	blk[5] = 4;
+	expect("offset to the start", decode(blk, sizeof(blk), 9, NULL), 0);
+	blk[5] = 5;
+	expect("offset past the start", decode(blk, sizeof(blk), 9, NULL), -1);
+	blk[5] = 0;
+	blk[6] = 1;
+	expect("offset far past the start", decode(blk, sizeof(blk), 9, NULL),
+	    -1);
+	blk[5] = 1;
+	blk[6] = 0;
+
+	expect("shorter than claimed", decode(blk, sizeof(blk), 10, NULL), -1);
+	expect("longer than claimed", decode(blk, sizeof(blk), 8, NULL), -1);
+	expect("truncated offset", decode(blk, 6, 9, NULL), -1);
+	expect("truncated literals", decode(blk, 4, 9, NULL), -1);
+
+	expect("long match", decode(ext, sizeof(ext), 279, NULL), 0);
+	expect("match past the output", decode(ext, sizeof(ext), 278, NULL),
+	    -1);
+	expect("unterminated match length", decode(ext, 8, 279, NULL), -1);
+
+	/* 15 + 255 + 255 + 10 literals, fewer in the block */
+	memset(lit, 'x', sizeof(lit));
+	lit[0] = 0xf0;
+	lit[1] = 255;
+	lit[2] = 255;
+	lit[3] = 10;
+	expect("overlong literal run", decode(lit, 4 + 500, 535, NULL), -1);
+	expect("literal run", decode(lit, 4 + 535, 535, NULL), 0);
+	expect("literal run past the output", decode(lit, 4 + 535, 534, NULL),
+	    -1);
+	expect("unterminated literal length", decode(lit, 3, 535, NULL), -1);
+}
+
+/* Flipped bits must be caught or decode to the claimed length. */
+static void
+test_fuzz(void)
+{
+	comp		*c;
+	struct fbuf	*fb;
+	uint8_t		 blk[2048];
+	uint32_t	 i, k, len, blen;
+	int		 ret;
+
+	if ((c = comp_new(pool)) == NULL) {
+		bad++;
+		return;
+	}
+	for (i = 0; i < FUZZ; i++) {
+		len = 80 + rnd(1400);
+		fill(src, len, PERIOD + rnd(2));
+		if ((fb = fbuf_alloc(pool)) == NULL ||
+		    fbuf_append(fb, len) == NULL) {
+			bad++;
+			break;
+		}
+		memcpy(fb->data, src, len);
+		if (comp_frame(c, &fb) < 0 || fb->data[0] != COMP_LZ4) {
+			fbuf_unref(fb);
+			continue;
+		}
+		blen = fb->len - COMP_HDRLEN;
+		memcpy(blk, fb->data + COMP_HDRLEN, blen);
+		fbuf_unref(fb);
+
+		for (k = 0; k < 3; k++)
+			blk[rnd(blen)] ^= 1 << rnd(8);
+		if ((ret = decode(blk, blen, len, NULL)) < -1) {
+			fprintf(stderr, "fuzz %u: %d\n", i, ret);
+			bad++;
+		}
+	}
+	comp_free(c);
+}
+
+int
+main(void)
+{
+	if ((pool = fbuf_pool_new(16, POOL_SIZE)) == NULL)
+		return (1);
+
+	test_sizes();
+	test_stream();
+	test_malformed();
+	test_fuzz();
+
+	fbuf_pool_free(pool);
+
+	if (bad != 0) {
+		fprintf(stderr, "%u failures\n", bad);
+		return (1);
+	}
+
+	return (0);
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Checks that the arguments recorded by logrec_encode() are formatted by
+ * logrec_decode() byte for byte as vsnprintf() formats them, across the
+ * flags, widths, precisions, length modifiers and conversions, and that
+ * what can't be deferred is refused.
+ */
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <wchar.h>
+
+#include "logrec.h"
+
+#define BUF_SIZE	4096
+#define FMT_SIZE	64
+#define SWEEP_MAX	24
+
+/* the conversions of characters, strings and pointers take the first 2 */
+static const char	*flags[] = { "", "-", "+", " ", "#", "0", "'", "-+",
+			    "#0" };
+static const char	*widths[] = { "", "1", "12", "*" };
+static const char	*precs[] = { "", ".", ".0", ".5", ".*" };
+static const int	 stars[] = { 3, -1, -9 };
+
+static uint8_t		 args[BUF_SIZE];
+static char		 want[BUF_SIZE];
+static char		 got[BUF_SIZE];
+static uint32_t		 bad, checked;
+
+/*
+ * Encodes and decodes the arguments of `format', and compares the result
+ * with vsnprintf(), at every output size up to one byte past the length,
+ * or a few of them for the long records.
+ */
+static void
+check(const char *format, ...)
+{
+	va_list		 list, copy;
+	int32_t		 n, len, size;
+
+	va_start(list, format);
+	va_copy(copy, list);
+	len = vsnprintf(want, sizeof(want), format, copy);
+	va_end(copy);
+	n = logrec_encode(args, sizeof(args), format, list);
+	va_end(list);
+
+	checked++;
+	if (n < 0) {
+		fprintf(stderr, "\"%s\": not encoded\n", format);
+		bad++;
+		return;
+	}
+
+	for (size = len + 1; size > 0;
+	    size = size > SWEEP_MAX && size > len ? len :
+	    size > SWEEP_MAX ? SWEEP_MAX : size - 1) {
+		if (size < len + 1)
+			want[size - 1] = '\0';
+		memset(got, 0x55, size);
+		if (logrec_decode(got, size, format, args, n) !=
+		    (size > len ? len : size - 1) ||
+		    memcmp(got, want, size) != 0) {
+			fprintf(stderr, "\"%s\", %d bytes: \"%s\", expected "
+			    "\"%s\"\n", format, size, got, want);
+			bad++;
+			return;
+		}
+	}
+}
+
+/* Checks that the arguments of `format' aren't encoded in `size' bytes. */
+static void
+refuse(uint32_t size, const char *format, ...)
+{
+	va_list	 list;
+
+	va_start(list, format);
+	if (logrec_encode(args, size, format, list) != -1) {
+		fprintf(stderr, "\"%s\", %u bytes: encoded\n", format, size);
+		bad++;
+	}
+	va_end(list);
+}
+
+/* Calls check() with the arguments of the stars of `fmt' before `v'. */
+#define CHECK(fmt, nstar, s, v) do {					\
+	if ((nstar) == 0)						\
+		check((fmt), (v));					\
+	else if ((nstar) == 1)						\
+		check((fmt), (s)[0], (v));				\
+	else								\
+		check((fmt), (s)[0], (s)[1], (v));			\
+} while (0)
+
+/* Runs one specification over the values of its type. */
+static void
+spec(const char *fl, const char *wd, const char *pr, const char *mod,
+    char conv, const int *s)
+{
+	static const long long	 ints[] = { 0, 1, -1, 42, 300, -129,
+				    70000, INT_MAX, INT_MIN, LLONG_MAX,
+				    LLONG_MIN };
+	static const double	 dbls[] = { 0.0, -0.0, 1.5, -2.25, 1e300,
+				    -1e-300, DBL_MIN, 123456.789 };
+	static const char	*strs[] = { "", "a", "abcdef", "with spaces" };
+	char			 fmt[FMT_SIZE];
+	size_t			 i;
+	int			 nstar;
+
+	snprintf(fmt, sizeof(fmt), "<%%%s%s%s%s%c>", fl, wd, pr, mod, conv);
+	nstar = (strchr(wd, '*') != NULL) + (strchr(pr, '*') != NULL);
+
+	switch (conv) {
+	case 'd':
+	case 'i':
+		for (i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+			if (strcmp(mod, "hh") == 0 || strcmp(mod, "h") == 0 ||
+			    *mod == '\0')
+				CHECK(fmt, nstar, s, (int)ints[i]);
+			else if (strcmp(mod, "l") == 0)
+				CHECK(fmt, nstar, s, (long)ints[i]);
+			else if (strcmp(mod, "j") == 0)
+				CHECK(fmt, nstar, s, (intmax_t)ints[i]);
+			else if (strcmp(mod, "z") == 0)
+				CHECK(fmt, nstar, s, (ssize_t)ints[i]);
+			else if (strcmp(mod, "t") == 0)
+				CHECK(fmt, nstar, s, (ptrdiff_t)ints[i]);
+			else
+				CHECK(fmt, nstar, s, ints[i]);
+		}
+		break;
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		for (i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+			if (strcmp(mod, "hh") == 0 || strcmp(mod, "h") == 0 ||
+			    *mod == '\0')
+				CHECK(fmt, nstar, s, (unsigned int)ints[i]);
+			else if (strcmp(mod, "l") == 0)
+				CHECK(fmt, nstar, s, (unsigned long)ints[i]);
+			else if (strcmp(mod, "j") == 0)
+				CHECK(fmt, nstar, s, (uintmax_t)ints[i]);
+			else if (strcmp(mod, "z") == 0)
+				CHECK(fmt, nstar, s, (size_t)ints[i]);
+			else if (strcmp(mod, "t") == 0)
+				CHECK(fmt, nstar, s, (ptrdiff_t)ints[i]);
+			else
+				CHECK(fmt, nstar, s,
+				    (unsigned long long)ints[i]);
+		}
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		for (i = 0; i < sizeof(dbls) / sizeof(dbls[0]); i++)
+			if (*mod == 'L')
+				CHECK(fmt, nstar, s, (long double)dbls[i]);
+			else
+				CHECK(fmt, nstar, s, dbls[i]);
+		if (*mod != 'L') {
+			CHECK(fmt, nstar, s, HUGE_VAL);
+			CHECK(fmt, nstar, s, -HUGE_VAL);
+		}
+		break;
+	case 'c':
+		CHECK(fmt, nstar, s, 'z');
+		CHECK(fmt, nstar, s, ' ');
+		break;
+	case 's':
+		for (i = 0; i < sizeof(strs) / sizeof(strs[0]); i++)
+			CHECK(fmt, nstar, s, strs[i]);
+		break;
+	case 'p':
+		CHECK(fmt, nstar, s, (void *)NULL);
+		CHECK(fmt, nstar, s, (void *)0x1234);
+		CHECK(fmt, nstar, s, (void *)args);
+		break;
+	}
+}
+
+/* Runs a conversion over the widths, precisions and star arguments. */
+static void
+spec_all(const char *fl, const char *mod, char conv)
+{
+	size_t	w, p, k;
+	int	s[2];
+
+	for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+		for (p = 0; p < sizeof(precs) / sizeof(precs[0]); p++)
+			for (k = 0; k < sizeof(stars) / sizeof(stars[0]); k++) {
+				s[0] = stars[k];
+				s[1] = stars[(k + 1) % 3];
+				spec(fl, widths[w], precs[p], mod, conv, s);
+				/* the stars only matter to `*' */
+				if (*widths[w] != '*' &&
+				    strcmp(precs[p], ".*") != 0)
+					break;
+			}
+}
+
+static void
+test_matrix(void)
+{
+	static const struct {
+		const char	*mods;	/* separated by spaces */
+		const char	*convs;
+		int		 nflags;
+	} convs[] = {
+		{ " hh h l ll q j z t", "di", 9 },
+		{ " hh h l ll j z t", "uoxX", 9 },
+		{ " L", "eEfFgGaA", 9 },
+		{ "", "cs", 2 },
+		{ "", "p", 2 },
+	};
+	char		 mods[32], *mod, *next;
+	const char	*c;
+	size_t		 i;
+	int		 f;
+
+	for (i = 0; i < sizeof(convs) / sizeof(convs[0]); i++)
+		for (c = convs[i].convs; *c != '\0'; c++) {
+			snprintf(mods, sizeof(mods), "%s", convs[i].mods);
+			for (mod = mods; mod != NULL; mod = next) {
+				if ((next = strchr(mod, ' ')) != NULL)
+					*next++ = '\0';
+				for (f = 0; f < convs[i].nflags; f++)
+					spec_all(flags[f], mod, *c);
+			}
+		}
+}
+
+static void
+test_formats(void)
+{
+	char	long_str[300];
+
+	memset(long_str, 'y', sizeof(long_str) - 1);
+	long_str[sizeof(long_str) - 1] = '\0';
+
+	check("");
+	check("no conversion");
+	check("100%% done, %d%%", 42);
+	check("%s=%d, %s=%#x, %5.2f%%", "a", -7, "b", 255U, 99.5);
+	check("%-*d|%*.*s|%c%c", 8, 12, -10, 3, "truncated", 'o', 'k');
+	check("%hhd %hd %ld %lld %zu %jd %td", 300, 70000, LONG_MIN,
+	    LLONG_MAX, (size_t)-1, (intmax_t)-5, (ptrdiff_t)9);
+	check("%Lf %Le %La", 1.25L, -1e100L, 3.0L);
+	check("%s %s", long_str, long_str);
+	check("%c", '\0');
+}
+
+static void
+test_refused(void)
+{
+	int	n;
+
+	refuse(BUF_SIZE, "%n", &n);
+	refuse(BUF_SIZE, "%d %n", 1, &n);
+	refuse(BUF_SIZE, "%ls", L"wide");
+	refuse(BUF_SIZE, "%lc", (wint_t)'w');
+	refuse(BUF_SIZE, "%C", (wint_t)'w');
+	refuse(BUF_SIZE, "%S", L"wide");
+	refuse(BUF_SIZE, "%m");
+	refuse(BUF_SIZE, "trailing %");
+
+	/* the arguments must fit */
+	refuse(0, "%d", 1);
+	refuse(7, "%d", 1);
+	refuse(15, "%d %d", 1, 2);
+	refuse(sizeof(long double) - 1, "%Lf", 1.0L);
+	refuse(sizeof(void *) - 1, "%p", args);
+	refuse(1, "%s", "x");
+	refuse(2 + 8 - 1, "%s %d", "", 1);
+}
+
+static int32_t
+encode(uint32_t size, const char *format, ...)
+{
+	va_list	 list;
+	int32_t	 n;
+
+	va_start(list, format);
+	n = logrec_encode(args, size, format, list);
+	va_end(list);
+
+	return (n);
+}
+
+/* A string too long is cut, not refused, and decodes to a prefix. */
+static void
+test_cut(void)
+{
+	const char	*s = "a string longer than the buffer";
+	char		 str[2000];
+	int32_t		 n;
+
+	if ((n = encode(2 + 10, "%s", s)) != 12 ||
+	    logrec_decode(got, sizeof(got), "%s", args, n) != 10 ||
+	    strcmp(got, "a string l") != 0) {
+		fprintf(stderr, "cut string: %d, \"%s\"\n", n, got);
+		bad++;
+	}
+	if ((n = encode(2, "%s!", s)) != 2 ||
+	    logrec_decode(got, sizeof(got), "%s!", args, n) != 1 ||
+	    strcmp(got, "!") != 0) {
+		fprintf(stderr, "empty cut string: %d, \"%s\"\n", n, got);
+		bad++;
+	}
+
+	memset(str, 'z', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+	if ((n = encode(sizeof(args), "%s", str)) != 2 + (int32_t)strlen(str) ||
+	    logrec_decode(got, sizeof(got), "%s", args, n) <= 0 ||
+	    strncmp(got, str, strlen(got)) != 0) {
+		fprintf(stderr, "long string: %d\n", n);
+		bad++;
+	}
+
+	/* the arguments must match the format to be decoded */
+	n = encode(sizeof(args), "%d", 1);
+	if (logrec_decode(got, sizeof(got), "%d %d", args, n) != -1 ||
+	    logrec_decode(got, sizeof(got), "%d", args, n - 1) != -1) {
+		fprintf(stderr, "short arguments decoded\n");
+		bad++;
+	}
+}
+
+/*
+ * A precision bounds the string, which needn't be terminated within it.
+ * What follows the array isn't, and would be recorded if read.
+ */
+static void
+test_precision(void)
+{
+	struct {
+		char	s[3];
+		char	after[16];
+	} u;
+	int32_t	 n;
+
+	memcpy(u.s, "abc", sizeof(u.s));
+	memset(u.after, 'X', sizeof(u.after) - 1);
+	u.after[sizeof(u.after) - 1] = '\0';
+
+	check("%.3s|", u.s);
+	check("%.*s|", 3, u.s);
+	check("%.*s|", 2, u.s);
+	check("%.0s|", u.s);
+	check("%-8.3s|", u.s);
+	check("%*.*s|", -6, 3, u.s);
+	check("%.2s %.*s|", u.s, 1, u.s);
+	if ((n = encode(sizeof(args), "%.3s", u.s)) != 2 + 3 ||
+	    (n = encode(sizeof(args), "%.*s", 3, u.s)) != 4 + 2 + 3) {
+		fprintf(stderr, "unterminated string: %d bytes\n", n);
+		bad++;
+	}
+
+	/* without a precision, or a negative one, the string is all there */
+	check("%.*s|", -1, "terminated");
+	check("%.99999s|", "terminated");
+	check("%.5s|", "terminated");
+}
+
+int
+main(void)
+{
+	test_matrix();
+	test_formats();
+	test_refused();
+	test_cut();
+	test_precision();
+
+	if (bad != 0) {
+		fprintf(stderr, "%u of %u records differ\n", bad, checked);
+		return (1);
+	}
+
+	return (0);
+}
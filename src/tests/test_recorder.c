@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2026 Nicolas Bouliane <nicboul@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Fills a flight recorder past its size, corrupts some of its entries the
+ * way a crash would leave them, and checks that log_recorder_read() only
+ * hands back the intact records, oldest first.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include "log.h"
+
+#define ENTRIES		16
+#define RECORDS		40		/* the first 24 are overwritten */
+#define FIRST		(RECORDS - ENTRIES)
+
+/* the layout of an entry, from log.c */
+#define FR_ENTRY	256
+
+struct fr_entry {
+	uint64_t	seq;
+	uint64_t	ns;
+	uint32_t	tid;
+	int32_t		err;
+	uint8_t		lvl;
+	uint8_t		text;
+	uint16_t	flen;
+	uint16_t	alen;
+	uint8_t		data[];
+};
+
+#define FR_DATA		(FR_ENTRY - sizeof(struct fr_entry))
+
+static char		 got[RECORDS][128];
+static int		 ngot;
+static uint32_t		 bad;
+
+static void
+collect(const char *line)
+{
+	const char	*body;
+
+	if ((body = strstr(line, "> ")) == NULL || ngot == RECORDS) {
+		bad++;
+		return;
+	}
+	snprintf(got[ngot++], sizeof(got[0]), "%s", body + 2);
+}
+
+/* Reads the recorder, expecting the records of `want', in order. */
+static void
+expect(const char *what, const char *path, const int *want, int n)
+{
+	char	line[128];
+	int	i, ret;
+
+	ngot = 0;
+	if ((ret = log_recorder_read(path, collect)) != n || ngot != n) {
+		fprintf(stderr, "%s: %d records, expected %d\n", what, ret, n);
+		bad++;
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if (want[i] < 0)
+			snprintf(line, sizeof(line), "wide %ls\n", L"chars");
+		else
+			snprintf(line, sizeof(line), "record %d\n", want[i]);
+		if (strcmp(got[i], line) != 0) {
+			fprintf(stderr, "%s: record %d is \"%s\", expected "
+			    "\"%s\"\n", what, i, got[i], line);
+			bad++;
+		}
+	}
+}
+
+static struct fr_entry *
+entry(uint8_t *fr, int record)
+{
+	return ((struct fr_entry *)(fr + ((record % ENTRIES) + 1) * FR_ENTRY));
+}
+
+int
+main(void)
+{
+	char		 path[] = "/tmp/test_recorderXXXXXX";
+	struct stat	 st;
+	uint8_t		*fr, magic[8];
+	int		 want[RECORDS];
+	int		 fd, i, n;
+
+	if ((fd = mkstemp(path)) == -1)
+		return (1);
+	close(fd);
+
+	if (log_recorder_open(path, ENTRIES) == -1) {
+		unlink(path);
+		return (1);
+	}
+	for (i = 0; i < RECORDS; i++)
+		if (i == FIRST + 1)
+			log_info("wide %ls", L"chars");
+		else
+			log_info("record %d", i);
+	log_recorder_close();
+
+	/*
+	 * The last ENTRIES records, the wide one written as text. The ring
+	 * wrapped, they start in the middle of the file.
+	 */
+	for (i = 0; i < ENTRIES; i++)
+		want[i] = i == 1 ? -1 : FIRST + i;
+	expect("intact", path, want, ENTRIES);
+
+	if ((fd = open(path, O_RDWR)) == -1 || fstat(fd, &st) == -1 ||
+	    (fr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0)) == MAP_FAILED) {
+		unlink(path);
+		return (1);
+	}
+	close(fd);
+
+	/* an entry being written, then ones whose lengths run past it */
+	entry(fr, FIRST + 2)->seq = 0;
+	entry(fr, FIRST + 4)->alen = FR_DATA + 1;
+	entry(fr, FIRST + 5)->flen = FR_DATA;
+	entry(fr, FIRST + 6)->flen = 0xffff;
+	entry(fr, FIRST + 7)->alen = 0xffff;
+
+	/* a format cut short, a level or a position out of place */
+	memset(entry(fr, FIRST + 9)->data, 'x', entry(fr, FIRST + 9)->flen);
+	entry(fr, FIRST + 10)->lvl = 0;
+	entry(fr, FIRST + 11)->lvl = LOG_LVL_WARN + 1;
+	entry(fr, FIRST + 12)->seq += 1;
+	entry(fr, FIRST + 13)->flen = 0;
+
+	n = 0;
+	for (i = 0; i < ENTRIES; i++)
+		if (i == 1)
+			want[n++] = -1;
+		else if (i != 2 && (i < 4 || i > 7) && (i < 9 || i > 13))
+			want[n++] = FIRST + i;
+	expect("corrupted", path, want, n);
+
+	memcpy(magic, fr, sizeof(magic));
+	memset(fr, 0, sizeof(magic));
+	ngot = 0;
+	if (log_recorder_read(path, collect) != -1 || ngot != 0) {
+		fprintf(stderr, "bad magic: read\n");
+		bad++;
+	}
+	memcpy(fr, magic, sizeof(magic));
+	munmap(fr, st.st_size);
+
+	/* an entry missing */
+	ngot = 0;
+	if (truncate(path, FR_ENTRY * ENTRIES) == -1 ||
+	    log_recorder_read(path, collect) != -1 || ngot != 0) {
+		fprintf(stderr, "truncated file: read\n");
+		bad++;
+	}
+	unlink(path);
+
+	if (bad != 0) {
+		fprintf(stderr, "%u failures\n", bad);
+		return (1);
+	}
+
+	return (0);
+}